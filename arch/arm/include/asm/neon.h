@@ -0,0 +1,30 @@
+/*
+ * linux/arch/arm/include/asm/neon.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_NEON_H
+#define __ASM_NEON_H
+
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+#ifdef __ARM_NEON__
+
+/*
+ * NEON code must live in its own compilation unit, built with
+ * -mfpu=neon, and be called from a different unit between
+ * kernel_neon_begin() and kernel_neon_end(). Otherwise GCC is free to
+ * emit NEON instructions outside of the pair.
+ */
+#define kernel_neon_begin()	BUILD_BUG_ON(1)
+
+#else
+void kernel_neon_begin(void);
+#endif
+void kernel_neon_end(void);
+
+#endif /* __ASM_NEON_H */
@@ -135,6 +135,14 @@ pmd_populate(struct mm_struct *mm, pmd_t *pmdp, pgtable_t ptep)
 }
 #define pmd_pgtable(pmd) pmd_page(pmd)
 
+/*
+ * A pmd on the stack has no room for the second entry, and only needs
+ * to lead pte_offset_map() to the table.
+ */
+#define pmd_populate_temp(mm, pmdp, ptep) \
+	(*(pmdp) = __pmd((page_to_phys(ptep) + PTE_HWTABLE_OFF) | \
+			 _PAGE_USER_TABLE))
+
 #endif /* CONFIG_MMU */
 
 #endif
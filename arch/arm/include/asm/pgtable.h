@@ -181,7 +181,7 @@ extern pgd_t swapper_pg_dir[PTRS_PER_PGD];
 
 #define pmd_none(pmd)		(!pmd_val(pmd))
 #define pmd_present(pmd)	(pmd_val(pmd))
-#define pmd_bad(pmd)		(pmd_val(pmd) & 2)
+#define pmd_bad(pmd)		((pmd_val(pmd) & PMD_TYPE_MASK) != PMD_TYPE_TABLE)
 
 #define copy_pmd(pmdpd,pmdps)		\
 	do {				\
@@ -202,7 +202,9 @@ static inline pte_t *pmd_page_vaddr(pmd_t pmd)
 	return __va(pmd_val(pmd) & PHYS_MASK & (s32)PAGE_MASK);
 }
 
-#define pmd_page(pmd)		pfn_to_page(__phys_to_pfn(pmd_val(pmd) & PHYS_MASK))
+#define pmd_page(pmd)		pfn_to_page(__phys_to_pfn(pmd_val(pmd) & PHYS_MASK & \
+				((pmd_val(pmd) & PMD_TYPE_TABLE) ? \
+				 PAGE_MASK : SECTION_MASK)))
 
 /* we don't need complex calculations here as the pmd is folded into the pgd */
 #define pmd_addr_end(addr,end)	(end)
@@ -284,6 +286,108 @@ static inline pte_t pte_modify(pte_t pte, pgprot_t newprot)
 	return pte;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * A transparent huge pmd is a pair of 1MB sections, pmd_t holding the
+ * first and set_pmd_at() deriving the second.  Sections have no bits to
+ * spare, so as with the hardware ptes a huge pmd is young by being
+ * valid: an old, not present or splitting one only loses the section
+ * type, which makes the MMU ignore the rest of the entry and fault.
+ */
+#define PMD_SECT_SPLITTING	(_AT(pmdval_t, 1) << 8)	/* domain bit, only when invalid */
+
+#define pmd_trans_huge(pmd)	(pmd_val(pmd) && !(pmd_val(pmd) & PMD_TYPE_TABLE))
+#define pmd_trans_splitting(pmd) (pmd_val(pmd) & PMD_SECT_SPLITTING)
+#define pmd_young(pmd)		((pmd_val(pmd) & PMD_TYPE_MASK) == PMD_TYPE_SECT)
+#define pmd_write(pmd)		(!(pmd_val(pmd) & PMD_SECT_APX))
+
+#define PMD_BIT_FUNC(fn,op) \
+static inline pmd_t pmd_##fn(pmd_t pmd) { pmd_val(pmd) op; return pmd; }
+
+PMD_BIT_FUNC(wrprotect,	 |= PMD_SECT_APX);
+PMD_BIT_FUNC(mkwrite,	 &= ~PMD_SECT_APX);
+PMD_BIT_FUNC(mkold,	 &= ~PMD_TYPE_MASK);
+PMD_BIT_FUNC(mknotpresent, &= ~PMD_TYPE_MASK);
+PMD_BIT_FUNC(mksplitting, = (pmd_val(pmd) & ~PMD_TYPE_MASK) | PMD_SECT_SPLITTING);
+PMD_BIT_FUNC(mkhuge,	 |= PMD_TYPE_SECT);
+
+static inline pmd_t pmd_mkyoung(pmd_t pmd)
+{
+	if (!pmd_trans_splitting(pmd))
+		pmd_val(pmd) |= PMD_TYPE_SECT;
+	return pmd;
+}
+
+/* Only anonymous memory is mapped huge, and it is always dirty */
+static inline pmd_t pmd_mkdirty(pmd_t pmd) { return pmd; }
+
+/*
+ * With TEX remapping the four L_PTE_MT_* bits are not decoded: bits 2 and
+ * 3 are copied to B and C, and bit 4 becomes TEX[0], see set_pte_ext() in
+ * proc-v7.S.
+ */
+#define L_PTE_MT_TEX0		(_AT(pteval_t, 1) << 4)
+
+/*
+ * Section attributes for the protection bits of a user pte.  The memory
+ * type becomes TEX[0], C and B, as set_pte_ext() builds it for small
+ * pages.
+ */
+static inline pmdval_t pmd_sect_prot(pgprot_t prot)
+{
+	pteval_t val = pgprot_val(prot);
+	pmdval_t sect = PMD_DOMAIN(DOMAIN_USER) | PMD_SECT_AP_WRITE |
+			PMD_SECT_nG;
+
+	sect |= val & (PMD_SECT_CACHEABLE | PMD_SECT_BUFFERABLE);
+	if (val & L_PTE_MT_TEX0)
+		sect |= PMD_SECT_TEX(1);
+	if (val & L_PTE_RDONLY)
+		sect |= PMD_SECT_APX;
+	if (val & L_PTE_USER)
+		sect |= PMD_SECT_AP_READ;
+	if (val & L_PTE_XN)
+		sect |= PMD_SECT_XN;
+	if (val & L_PTE_SHARED)
+		sect |= PMD_SECT_S;
+	return sect;
+}
+
+#define pfn_pmd(pfn,prot)	__pmd(__pfn_to_phys(pfn) | pmd_sect_prot(prot))
+#define mk_pmd(page,prot)	pfn_pmd(page_to_pfn(page), prot)
+
+static inline pmd_t pmd_modify(pmd_t pmd, pgprot_t newprot)
+{
+	const pmdval_t mask = PMD_SECT_XN | PMD_SECT_APX | PMD_SECT_AP_READ;
+	pmd_val(pmd) = (pmd_val(pmd) & ~mask) | (pmd_sect_prot(newprot) & mask);
+	return pmd;
+}
+
+/*
+ * Also used to put a page table back, whose second half follows the
+ * first 256 hardware ptes.
+ */
+#define set_pmd_at(mm,addr,pmdp,pmd)					\
+	do {								\
+		pmdval_t __val = pmd_val(pmd);				\
+		(pmdp)[0] = __pmd(__val);				\
+		(pmdp)[1] = __pmd(!__val ? 0 : __val +			\
+			(pmd_trans_huge(__pmd(__val)) ? SECTION_SIZE :	\
+			 256 * sizeof(pte_t)));				\
+		flush_pmd_entry(pmdp);					\
+	} while (0)
+
+#define __HAVE_ARCH_PMDP_GET_AND_CLEAR
+#define pmdp_get_and_clear(mm,addr,pmdp)				\
+	({								\
+		pmd_t __old = *(pmdp);					\
+		pmd_clear(pmdp);					\
+		__old;							\
+	})
+
+#define has_transparent_hugepage()	(1)
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * Encode and decode a swap entry.  Swap entries are stored in the Linux
  * page tables as follows:
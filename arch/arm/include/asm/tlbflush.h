@@ -588,6 +588,9 @@ static inline void update_mmu_cache(struct vm_area_struct *vma,
 }
 #endif
 
+/* Huge pmds are only mapped on ARMv6K and later */
+#define update_mmu_cache_pmd(vma, addr, pmd) do { } while (0)
+
 #endif
 
 #endif /* CONFIG_MMU */
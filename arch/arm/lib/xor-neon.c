@@ -0,0 +1,129 @@
+/*
+ * linux/arch/arm/lib/xor-neon.c
+ *
+ * NEON inner loops of the xor_blocks() templates in asm/xor.h. They are
+ * kept in their own unit since only this file is built with -mfpu=neon;
+ * callers wrap them in kernel_neon_begin()/kernel_neon_end().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/raid/xor.h>
+
+#ifndef __ARM_NEON__
+#error You should compile this file with '-mfloat-abi=softfp -mfpu=neon'
+#endif
+
+#include <arm_neon.h>
+
+/* Every function handles one 64 byte line per iteration */
+#define LINE	64
+
+#define LOAD(p)							\
+	v0 = vld1q_u64((p) + 0); v1 = vld1q_u64((p) + 2);	\
+	v2 = vld1q_u64((p) + 4); v3 = vld1q_u64((p) + 6)
+
+#define XOR(p)								\
+	v0 = veorq_u64(v0, vld1q_u64((p) + 0));				\
+	v1 = veorq_u64(v1, vld1q_u64((p) + 2));				\
+	v2 = veorq_u64(v2, vld1q_u64((p) + 4));				\
+	v3 = veorq_u64(v3, vld1q_u64((p) + 6))
+
+#define STORE(p)						\
+	vst1q_u64((p) + 0, v0); vst1q_u64((p) + 2, v1);		\
+	vst1q_u64((p) + 4, v2); vst1q_u64((p) + 6, v3)
+
+static void xor_neon_inner_2(unsigned long bytes, unsigned long *p1,
+			     unsigned long *p2)
+{
+	uint64_t *d = (uint64_t *)p1, *s1 = (uint64_t *)p2;
+	unsigned long lines = bytes / LINE;
+	uint64x2_t v0, v1, v2, v3;
+
+	do {
+		LOAD(d);
+		XOR(s1);
+		STORE(d);
+		d += LINE / 8;
+		s1 += LINE / 8;
+	} while (--lines);
+}
+
+static void xor_neon_inner_3(unsigned long bytes, unsigned long *p1,
+			     unsigned long *p2, unsigned long *p3)
+{
+	uint64_t *d = (uint64_t *)p1, *s1 = (uint64_t *)p2;
+	uint64_t *s2 = (uint64_t *)p3;
+	unsigned long lines = bytes / LINE;
+	uint64x2_t v0, v1, v2, v3;
+
+	do {
+		LOAD(d);
+		XOR(s1);
+		XOR(s2);
+		STORE(d);
+		d += LINE / 8;
+		s1 += LINE / 8;
+		s2 += LINE / 8;
+	} while (--lines);
+}
+
+static void xor_neon_inner_4(unsigned long bytes, unsigned long *p1,
+			     unsigned long *p2, unsigned long *p3,
+			     unsigned long *p4)
+{
+	uint64_t *d = (uint64_t *)p1, *s1 = (uint64_t *)p2;
+	uint64_t *s2 = (uint64_t *)p3, *s3 = (uint64_t *)p4;
+	unsigned long lines = bytes / LINE;
+	uint64x2_t v0, v1, v2, v3;
+
+	do {
+		LOAD(d);
+		XOR(s1);
+		XOR(s2);
+		XOR(s3);
+		STORE(d);
+		d += LINE / 8;
+		s1 += LINE / 8;
+		s2 += LINE / 8;
+		s3 += LINE / 8;
+	} while (--lines);
+}
+
+static void xor_neon_inner_5(unsigned long bytes, unsigned long *p1,
+			     unsigned long *p2, unsigned long *p3,
+			     unsigned long *p4, unsigned long *p5)
+{
+	uint64_t *d = (uint64_t *)p1, *s1 = (uint64_t *)p2;
+	uint64_t *s2 = (uint64_t *)p3, *s3 = (uint64_t *)p4;
+	uint64_t *s4 = (uint64_t *)p5;
+	unsigned long lines = bytes / LINE;
+	uint64x2_t v0, v1, v2, v3;
+
+	do {
+		LOAD(d);
+		XOR(s1);
+		XOR(s2);
+		XOR(s3);
+		XOR(s4);
+		STORE(d);
+		d += LINE / 8;
+		s1 += LINE / 8;
+		s2 += LINE / 8;
+		s3 += LINE / 8;
+		s4 += LINE / 8;
+	} while (--lines);
+}
+
+struct xor_block_template const xor_block_neon_inner = {
+	.name	= "__inner_neon__",
+	.do_2	= xor_neon_inner_2,
+	.do_3	= xor_neon_inner_3,
+	.do_4	= xor_neon_inner_4,
+	.do_5	= xor_neon_inner_5,
+};
+EXPORT_SYMBOL(xor_block_neon_inner);
+
+MODULE_LICENSE("GPL");
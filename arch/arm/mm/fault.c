@@ -213,20 +213,28 @@ void do_bad_area(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
 #define VM_FAULT_BADACCESS	0x020000
 
 /*
- * Check that the permissions on the VMA allow for the fault which occurred.
+ * The VMA permissions, any one of which allows the fault which occurred.
  * If we encountered a write fault, we must have write permission, otherwise
  * we allow any permission.
  */
-static inline bool access_error(unsigned int fsr, struct vm_area_struct *vma)
+static inline unsigned long fsr_vm_flags(unsigned int fsr)
 {
-	unsigned int mask = VM_READ | VM_WRITE | VM_EXEC;
+	unsigned long mask = VM_READ | VM_WRITE | VM_EXEC;
 
 	if (fsr & FSR_WRITE)
 		mask = VM_WRITE;
 	if (fsr & FSR_LNX_PF)
 		mask = VM_EXEC;
 
-	return vma->vm_flags & mask ? false : true;
+	return mask;
+}
+
+/*
+ * Check that the permissions on the VMA allow for the fault which occurred.
+ */
+static inline bool access_error(unsigned int fsr, struct vm_area_struct *vma)
+{
+	return vma->vm_flags & fsr_vm_flags(fsr) ? false : true;
 }
 
 static int __kprobes
@@ -291,6 +299,29 @@ do_page_fault(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
 	if (in_atomic() || !mm)
 		goto no_context;
 
+	/*
+	 * Try without mmap_sem first, so that we do not wait for another
+	 * thread changing the address space.  Bad accesses and anything
+	 * else out of the ordinary take the usual path below.
+	 */
+	if (user_mode(regs) || search_exception_tables(regs->ARM_pc)) {
+		fault = handle_speculative_fault(mm, addr & PAGE_MASK, flags,
+						 fsr_vm_flags(fsr));
+		if (fault != VM_FAULT_RETRY) {
+			perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS, 1, regs, addr);
+			if (fault & VM_FAULT_MAJOR) {
+				tsk->maj_flt++;
+				perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1,
+						regs, addr);
+			} else {
+				tsk->min_flt++;
+				perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1,
+						regs, addr);
+			}
+			return 0;
+		}
+	}
+
 	/*
 	 * As per x86, we may deadlock here.  However, since the kernel only
 	 * validly references user space from well defined areas of the code,
@@ -493,11 +524,17 @@ do_translation_fault(unsigned long addr, unsigned int fsr,
 
 /*
  * Some section permission faults need to be handled gracefully.
- * They can happen due to a __{get,put}_user during an oops.
+ * They can happen due to a __{get,put}_user during an oops.  User
+ * space sections are transparent huge pages, write protected for
+ * copy on write.
  */
 static int
 do_sect_fault(unsigned long addr, unsigned int fsr, struct pt_regs *regs)
 {
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (addr < TASK_SIZE)
+		return do_page_fault(addr, fsr, regs);
+#endif
 	do_bad_area(addr, fsr, regs);
 	return 0;
 }
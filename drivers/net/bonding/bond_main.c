@@ -45,6 +45,8 @@
 #include <linux/ip.h>
 #include <linux/tcp.h>
 #include <linux/udp.h>
+#include <linux/ipv6.h>
+#include <net/ipv6.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/init.h>
@@ -158,7 +160,8 @@ MODULE_PARM_DESC(min_links, "Minimum number of available links before turning on
 module_param(xmit_hash_policy, charp, 0);
 MODULE_PARM_DESC(xmit_hash_policy, "balance-xor and 802.3ad hashing method; "
 				   "0 for layer 2 (default), 1 for layer 3+4, "
-				   "2 for layer 2+3");
+				   "2 for layer 2+3, 3 for layer 3+4 with "
+				   "fragments hashed by IP id");
 module_param(arp_interval, int, 0);
 MODULE_PARM_DESC(arp_interval, "arp interval in milliseconds");
 module_param_array(arp_ip_target, charp, NULL, 0);
@@ -214,6 +217,7 @@ const struct bond_parm_tbl xmit_hashtype_tbl[] = {
 {	"layer2",		BOND_XMIT_POLICY_LAYER2},
 {	"layer3+4",		BOND_XMIT_POLICY_LAYER34},
 {	"layer2+3",		BOND_XMIT_POLICY_LAYER23},
+{	"layer3+4+frag",	BOND_XMIT_POLICY_LAYER34_FRAG},
 {	NULL,			-1},
 };
 
@@ -1213,6 +1217,97 @@ static void bond_detach_slave(struct bonding *bond, struct slave *slave)
 	bond->slave_cnt--;
 }
 
+static bool bond_slave_arr_has(struct bond_slave_arr *arr,
+			       struct slave *slave)
+{
+	int i;
+
+	for (i = 0; i < arr->count + arr->qcount; i++)
+		if (arr->arr[i] == slave)
+			return true;
+	return false;
+}
+
+/*
+ * Rebuild bond->slave_arr from the slave list. Must be called after any
+ * change to the list or to the state of a slave that the transmit path
+ * of the current mode depends on. The old array is kept when nothing
+ * changed, so the periodic monitors may call this freely.
+ *
+ * skipslave is the slave being released, if any. Without memory for a
+ * new array the old one stays in use, unless it still holds skipslave.
+ *
+ * bond->lock held for reading or writing by caller.
+ */
+void bond_update_slave_arr(struct bonding *bond, struct slave *skipslave)
+{
+	struct bond_slave_arr *new_arr, *old_arr;
+	struct ad_info ad_info;
+	struct slave *slave;
+	int agg_id = -1;
+	int i;
+
+	spin_lock_bh(&bond->slave_arr_lock);
+	old_arr = rcu_dereference_protected(bond->slave_arr,
+				lockdep_is_held(&bond->slave_arr_lock));
+
+	new_arr = kmalloc(sizeof(*new_arr) +
+			  2 * bond->slave_cnt * sizeof(struct slave *),
+			  GFP_ATOMIC);
+	if (!new_arr) {
+		if (!skipslave || !old_arr ||
+		    !bond_slave_arr_has(old_arr, skipslave)) {
+			spin_unlock_bh(&bond->slave_arr_lock);
+			return;
+		}
+		/* never leave a released slave reachable */
+		pr_warning("%s: Warning: no memory for the slave array, transmit disabled\n",
+			   bond->dev->name);
+		rcu_assign_pointer(bond->slave_arr, NULL);
+		goto out;
+	}
+
+	if (bond->params.mode == BOND_MODE_8023AD &&
+	    !bond_3ad_get_active_agg_info(bond, &ad_info))
+		agg_id = ad_info.aggregator_id;
+
+	new_arr->count = 0;
+	bond_for_each_slave(bond, slave, i) {
+		if (!SLAVE_IS_OK(slave))
+			continue;
+		if (bond->params.mode == BOND_MODE_8023AD) {
+			struct aggregator *agg =
+				SLAVE_AD_INFO(slave).port.aggregator;
+
+			if (!agg || agg->aggregator_identifier != agg_id)
+				continue;
+		}
+		new_arr->arr[new_arr->count++] = slave;
+	}
+
+	new_arr->qcount = 0;
+	bond_for_each_slave(bond, slave, i) {
+		if (slave->queue_id)
+			new_arr->arr[new_arr->count + new_arr->qcount++] = slave;
+	}
+
+	if (old_arr && old_arr->count == new_arr->count &&
+	    old_arr->qcount == new_arr->qcount &&
+	    !memcmp(old_arr->arr, new_arr->arr,
+		    (new_arr->count + new_arr->qcount) *
+		    sizeof(struct slave *))) {
+		spin_unlock_bh(&bond->slave_arr_lock);
+		kfree(new_arr);
+		return;
+	}
+
+	rcu_assign_pointer(bond->slave_arr, new_arr);
+out:
+	spin_unlock_bh(&bond->slave_arr_lock);
+	if (old_arr)
+		kfree_rcu(old_arr, rcu);
+}
+
 #ifdef CONFIG_NET_POLL_CONTROLLER
 static inline int slave_enable_netpoll(struct slave *slave)
 {
@@ -1846,6 +1941,10 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev)
 		bond_is_active_slave(new_slave) ? "n active" : " backup",
 		new_slave->link != BOND_LINK_DOWN ? "n up" : " down");
 
+	read_lock(&bond->lock);
+	bond_update_slave_arr(bond, NULL);
+	read_unlock(&bond->lock);
+
 	/* enslave is successful */
 	return 0;
 
@@ -1963,6 +2062,7 @@ int bond_release(struct net_device *bond_dev, struct net_device *slave_dev)
 
 	/* release the slave from its bond */
 	bond_detach_slave(bond, slave);
+	bond_update_slave_arr(bond, slave);
 
 	if (bond->primary_slave == slave)
 		bond->primary_slave = NULL;
@@ -2066,6 +2166,8 @@ int bond_release(struct net_device *bond_dev, struct net_device *slave_dev)
 
 	slave_dev->priv_flags &= ~IFF_BONDING;
 
+	/* lockless transmitters may still see the slave */
+	synchronize_net();
 	kfree(slave);
 
 	return 0;  /* deletion OK */
@@ -2121,6 +2223,7 @@ static int bond_release_all(struct net_device *bond_dev)
 
 		slave_dev = slave->dev;
 		bond_detach_slave(bond, slave);
+		bond_update_slave_arr(bond, slave);
 
 		/* now that the slave is detached, unlock and perform
 		 * all the undo steps that should not be called from
@@ -2494,6 +2597,7 @@ do_failover:
 		unblock_netpoll_tx();
 	}
 
+	bond_update_slave_arr(bond, NULL);
 	bond_set_carrier(bond);
 }
 
@@ -2866,6 +2970,8 @@ void bond_loadbalance_arp_mon(struct work_struct *work)
 		unblock_netpoll_tx();
 	}
 
+	bond_update_slave_arr(bond, NULL);
+
 re_arm:
 	if (bond->params.arp_interval)
 		queue_delayed_work(bond->wq, &bond->arp_work, delta_in_ticks);
@@ -3229,12 +3335,11 @@ static int bond_slave_netdev_event(unsigned long event,
 					bond_3ad_adapter_duplex_changed(slave);
 			}
 		}
-
-		break;
+		/* fall through */
 	case NETDEV_DOWN:
-		/*
-		 * ... Or is it this?
-		 */
+		read_lock(&bond->lock);
+		bond_update_slave_arr(bond, NULL);
+		read_unlock(&bond->lock);
 		break;
 	case NETDEV_CHANGEMTU:
 		/*
@@ -3379,6 +3484,79 @@ static int bond_xmit_hash_policy_l23(struct sk_buff *skb, int count)
 	return (data->h_dest[5] ^ data->h_source[5]) % count;
 }
 
+/*
+ * XOR of the TCP or UDP ports at offset @thoff, 0 if they are not there.
+ */
+static u32 bond_l4_hash(const struct sk_buff *skb, int thoff)
+{
+	const __be16 *ports;
+	__be16 _ports[2];
+
+	ports = skb_header_pointer(skb, thoff, sizeof(_ports), _ports);
+	if (!ports)
+		return 0;
+	return ntohs(ports[0] ^ ports[1]);
+}
+
+/*
+ * Layer 3+4 hash of an IPv4 or IPv6 packet. Fragments carry no ports
+ * past the first one, so they are hashed on layer 3 alone, or with
+ * @frag_id on layer 3 and the fragment id, which keeps the fragments of
+ * a datagram together while spreading fragmented flows over the slaves.
+ * Returns -1 for anything else.
+ */
+static int bond_l34_hash(const struct sk_buff *skb, bool frag_id)
+{
+	int noff = skb_network_offset(skb);
+
+	if (skb->protocol == htons(ETH_P_IP)) {
+		const struct iphdr *iph;
+		struct iphdr _iph;
+		u32 layer4_xor = 0;
+
+		iph = skb_header_pointer(skb, noff, sizeof(_iph), &_iph);
+		if (!iph)
+			return -1;
+		if (ip_is_fragment(iph)) {
+			if (frag_id)
+				layer4_xor = ntohs(iph->id);
+		} else if (iph->protocol == IPPROTO_TCP ||
+			   iph->protocol == IPPROTO_UDP) {
+			layer4_xor = bond_l4_hash(skb, noff + iph->ihl * 4);
+		}
+		return layer4_xor ^ (ntohl(iph->saddr ^ iph->daddr) & 0xffff);
+	}
+
+	if (skb->protocol == htons(ETH_P_IPV6)) {
+		const struct ipv6hdr *ip6h;
+		struct ipv6hdr _ip6h;
+		const __be32 *s, *d;
+		u32 layer4_xor = 0;
+
+		ip6h = skb_header_pointer(skb, noff, sizeof(_ip6h), &_ip6h);
+		if (!ip6h)
+			return -1;
+		noff += sizeof(*ip6h);
+		if (ip6h->nexthdr == IPPROTO_TCP ||
+		    ip6h->nexthdr == IPPROTO_UDP) {
+			layer4_xor = bond_l4_hash(skb, noff);
+		} else if (ip6h->nexthdr == NEXTHDR_FRAGMENT && frag_id) {
+			const struct frag_hdr *fh;
+			struct frag_hdr _fh;
+
+			fh = skb_header_pointer(skb, noff, sizeof(_fh), &_fh);
+			if (fh)
+				layer4_xor = ntohl(fh->identification) & 0xffff;
+		}
+		s = ip6h->saddr.s6_addr32;
+		d = ip6h->daddr.s6_addr32;
+		return layer4_xor ^ (ntohl(s[0] ^ d[0] ^ s[1] ^ d[1] ^
+					   s[2] ^ d[2] ^ s[3] ^ d[3]) & 0xffff);
+	}
+
+	return -1;
+}
+
 /*
  * Hash for the output device based upon layer 3 and layer 4 data. If
  * the packet is a frag or not TCP or UDP, just use layer 3 data.  If it is
@@ -3387,20 +3565,25 @@ static int bond_xmit_hash_policy_l23(struct sk_buff *skb, int count)
 static int bond_xmit_hash_policy_l34(struct sk_buff *skb, int count)
 {
 	struct ethhdr *data = (struct ethhdr *)skb->data;
-	struct iphdr *iph = ip_hdr(skb);
-	__be16 *layer4hdr = (__be16 *)((u32 *)iph + iph->ihl);
-	int layer4_xor = 0;
+	int hash = bond_l34_hash(skb, false);
 
-	if (skb->protocol == htons(ETH_P_IP)) {
-		if (!ip_is_fragment(iph) &&
-		    (iph->protocol == IPPROTO_TCP ||
-		     iph->protocol == IPPROTO_UDP)) {
-			layer4_xor = ntohs((*layer4hdr ^ *(layer4hdr + 1)));
-		}
-		return (layer4_xor ^
-			((ntohl(iph->saddr ^ iph->daddr)) & 0xffff)) % count;
+	if (hash >= 0)
+		return hash % count;
 
-	}
+	return (data->h_dest[5] ^ data->h_source[5]) % count;
+}
+
+/*
+ * As bond_xmit_hash_policy_l34(), but fragments are hashed on layer 3
+ * and their IP id, so that fragmented UDP flows are spread as well.
+ */
+static int bond_xmit_hash_policy_l34_frag(struct sk_buff *skb, int count)
+{
+	struct ethhdr *data = (struct ethhdr *)skb->data;
+	int hash = bond_l34_hash(skb, true);
+
+	if (hash >= 0)
+		return hash % count;
 
 	return (data->h_dest[5] ^ data->h_source[5]) % count;
 }
@@ -3437,6 +3620,7 @@ static int bond_open(struct net_device *bond_dev)
 		}
 		read_unlock(&bond->curr_slave_lock);
 	}
+	bond_update_slave_arr(bond, NULL);
 	read_unlock(&bond->lock);
 
 	INIT_DELAYED_WORK(&bond->mcast_work, bond_resend_igmp_join_requests_delayed);
@@ -3922,12 +4106,37 @@ unwind:
 	return res;
 }
 
+/*
+ * Return the first slave able to transmit in @slaves, starting at index
+ * @n. The array may lag behind a link change by one monitor run.
+ */
+static struct slave *bond_slave_arr_pick(struct bond_slave_arr *slaves,
+					 unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < slaves->count; i++) {
+		struct slave *slave = slaves->arr[n];
+
+		if (SLAVE_IS_OK(slave))
+			return slave;
+		if (++n == slaves->count)
+			n = 0;
+	}
+	return NULL;
+}
+
 static int bond_xmit_roundrobin(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
-	struct slave *slave, *start_at;
-	int i, slave_no, res = 1;
+	struct bond_slave_arr *slaves;
+	struct slave *slave = NULL;
 	struct iphdr *iph = ip_hdr(skb);
+	int res = 1;
+
+	slaves = rcu_dereference(bond->slave_arr);
+	if (!slaves || !slaves->count)
+		goto out;
 
 	/*
 	 * Start with the curr_active_slave that joined the bond as the
@@ -3938,37 +4147,23 @@ static int bond_xmit_roundrobin(struct sk_buff *skb, struct net_device *bond_dev
 	 */
 	if ((iph->protocol == IPPROTO_IGMP) &&
 	    (skb->protocol == htons(ETH_P_IP))) {
-
-		read_lock(&bond->curr_slave_lock);
-		slave = bond->curr_active_slave;
-		read_unlock(&bond->curr_slave_lock);
-
+		slave = ACCESS_ONCE(bond->curr_active_slave);
 		if (!slave)
 			goto out;
+		if (!SLAVE_IS_OK(slave))
+			slave = bond_slave_arr_pick(slaves, 0);
 	} else {
 		/*
-		 * Concurrent TX may collide on rr_tx_counter; we accept
-		 * that as being rare enough not to justify using an
-		 * atomic op here.
+		 * Every cpu keeps its own position so that the counter
+		 * does not bounce between them on each packet.
 		 */
-		slave_no = bond->rr_tx_counter++ % bond->slave_cnt;
-
-		bond_for_each_slave(bond, slave, i) {
-			slave_no--;
-			if (slave_no < 0)
-				break;
-		}
+		slave = bond_slave_arr_pick(slaves,
+				this_cpu_inc_return(*bond->rr_tx_counter) %
+				slaves->count);
 	}
 
-	start_at = slave;
-	bond_for_each_slave_from(bond, slave, i, start_at) {
-		if (IS_UP(slave->dev) &&
-		    (slave->link == BOND_LINK_UP) &&
-		    bond_is_active_slave(slave)) {
-			res = bond_dev_queue_xmit(bond, skb, slave->dev);
-			break;
-		}
-	}
+	if (slave)
+		res = bond_dev_queue_xmit(bond, skb, slave->dev);
 
 out:
 	if (res) {
@@ -3987,53 +4182,38 @@ out:
 static int bond_xmit_activebackup(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
+	struct slave *slave = ACCESS_ONCE(bond->curr_active_slave);
 	int res = 1;
 
-	read_lock(&bond->curr_slave_lock);
-
-	if (bond->curr_active_slave)
-		res = bond_dev_queue_xmit(bond, skb,
-			bond->curr_active_slave->dev);
+	if (slave)
+		res = bond_dev_queue_xmit(bond, skb, slave->dev);
 
 	if (res)
 		/* no suitable interface, frame not sent */
 		dev_kfree_skb(skb);
 
-	read_unlock(&bond->curr_slave_lock);
-
 	return NETDEV_TX_OK;
 }
 
 /*
  * In bond_xmit_xor() , we determine the output device by using a pre-
  * determined xmit_hash_policy(), If the selected device is not enabled,
- * find the next active slave.
+ * find the next active slave. Serves 802.3ad as well, whose slave array
+ * only holds the ports of the active aggregator.
  */
 static int bond_xmit_xor(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
-	struct slave *slave, *start_at;
-	int slave_no;
-	int i;
+	struct bond_slave_arr *slaves;
+	struct slave *slave;
 	int res = 1;
 
-	slave_no = bond->xmit_hash_policy(skb, bond->slave_cnt);
-
-	bond_for_each_slave(bond, slave, i) {
-		slave_no--;
-		if (slave_no < 0)
-			break;
-	}
-
-	start_at = slave;
-
-	bond_for_each_slave_from(bond, slave, i, start_at) {
-		if (IS_UP(slave->dev) &&
-		    (slave->link == BOND_LINK_UP) &&
-		    bond_is_active_slave(slave)) {
+	slaves = rcu_dereference(bond->slave_arr);
+	if (slaves && slaves->count) {
+		slave = bond_slave_arr_pick(slaves,
+				bond->xmit_hash_policy(skb, slaves->count));
+		if (slave)
 			res = bond_dev_queue_xmit(bond, skb, slave->dev);
-			break;
-		}
 	}
 
 	if (res) {
@@ -4050,22 +4230,19 @@ static int bond_xmit_xor(struct sk_buff *skb, struct net_device *bond_dev)
 static int bond_xmit_broadcast(struct sk_buff *skb, struct net_device *bond_dev)
 {
 	struct bonding *bond = netdev_priv(bond_dev);
-	struct slave *slave, *start_at;
+	struct bond_slave_arr *slaves;
 	struct net_device *tx_dev = NULL;
-	int i;
+	unsigned int i;
 	int res = 1;
 
-	read_lock(&bond->curr_slave_lock);
-	start_at = bond->curr_active_slave;
-	read_unlock(&bond->curr_slave_lock);
-
-	if (!start_at)
+	slaves = rcu_dereference(bond->slave_arr);
+	if (!slaves)
 		goto out;
 
-	bond_for_each_slave_from(bond, slave, i, start_at) {
-		if (IS_UP(slave->dev) &&
-		    (slave->link == BOND_LINK_UP) &&
-		    bond_is_active_slave(slave)) {
+	for (i = 0; i < slaves->count; i++) {
+		struct slave *slave = slaves->arr[i];
+
+		if (SLAVE_IS_OK(slave)) {
 			if (tx_dev) {
 				struct sk_buff *skb2 = skb_clone(skb, GFP_ATOMIC);
 				if (!skb2) {
@@ -4107,6 +4284,9 @@ static void bond_set_xmit_hash_policy(struct bonding *bond)
 	case BOND_XMIT_POLICY_LAYER34:
 		bond->xmit_hash_policy = bond_xmit_hash_policy_l34;
 		break;
+	case BOND_XMIT_POLICY_LAYER34_FRAG:
+		bond->xmit_hash_policy = bond_xmit_hash_policy_l34_frag;
+		break;
 	case BOND_XMIT_POLICY_LAYER2:
 	default:
 		bond->xmit_hash_policy = bond_xmit_hash_policy_l2;
@@ -4120,26 +4300,29 @@ static void bond_set_xmit_hash_policy(struct bonding *bond)
 static inline int bond_slave_override(struct bonding *bond,
 				      struct sk_buff *skb)
 {
-	int i, res = 1;
+	struct bond_slave_arr *slaves;
 	struct slave *slave = NULL;
-	struct slave *check_slave;
+	unsigned int i;
+	int res = 1;
 
 	if (!skb->queue_mapping)
 		return 1;
 
+	slaves = rcu_dereference(bond->slave_arr);
+	if (!slaves)
+		return 1;
+
 	/* Find out if any slaves have the same mapping as this skb. */
-	bond_for_each_slave(bond, check_slave, i) {
-		if (check_slave->queue_id == skb->queue_mapping) {
-			slave = check_slave;
+	for (i = slaves->count; i < slaves->count + slaves->qcount; i++) {
+		if (slaves->arr[i]->queue_id == skb->queue_mapping) {
+			slave = slaves->arr[i];
 			break;
 		}
 	}
 
 	/* If the slave isn't UP, use default transmit policy. */
-	if (slave && slave->queue_id && IS_UP(slave->dev) &&
-	    (slave->link == BOND_LINK_UP)) {
+	if (slave && IS_UP(slave->dev) && (slave->link == BOND_LINK_UP))
 		res = bond_dev_queue_xmit(bond, skb, slave->dev);
-	}
 
 	return res;
 }
@@ -4187,7 +4370,7 @@ static netdev_tx_t __bond_start_xmit(struct sk_buff *skb, struct net_device *dev
 	case BOND_MODE_BROADCAST:
 		return bond_xmit_broadcast(skb, dev);
 	case BOND_MODE_8023AD:
-		return bond_3ad_xmit_xor(skb, dev);
+		return bond_xmit_xor(skb, dev);
 	case BOND_MODE_ALB:
 	case BOND_MODE_TLB:
 		return bond_alb_xmit(skb, dev);
@@ -4213,6 +4396,13 @@ static netdev_tx_t bond_start_xmit(struct sk_buff *skb, struct net_device *dev)
 	if (is_netpoll_tx_blocked(dev))
 		return NETDEV_TX_BUSY;
 
+	if (TX_LOCKLESS(bond->params.mode)) {
+		rcu_read_lock();
+		ret = __bond_start_xmit(skb, dev);
+		rcu_read_unlock();
+		return ret;
+	}
+
 	read_lock(&bond->lock);
 
 	if (bond->slave_cnt)
@@ -4301,6 +4491,8 @@ static void bond_destructor(struct net_device *bond_dev)
 	struct bonding *bond = netdev_priv(bond_dev);
 	if (bond->wq)
 		destroy_workqueue(bond->wq);
+	kfree(rcu_dereference_protected(bond->slave_arr, 1));
+	free_percpu(bond->rr_tx_counter);
 	free_netdev(bond_dev);
 }
 
@@ -4311,6 +4503,7 @@ static void bond_setup(struct net_device *bond_dev)
 	/* initialize rwlocks */
 	rwlock_init(&bond->lock);
 	rwlock_init(&bond->curr_slave_lock);
+	spin_lock_init(&bond->slave_arr_lock);
 
 	bond->params = bonding_defaults;
 
@@ -4792,6 +4985,10 @@ static int bond_init(struct net_device *bond_dev)
 	spin_lock_init(&(bond_info->tx_hashtbl_lock));
 	spin_lock_init(&(bond_info->rx_hashtbl_lock));
 
+	bond->rr_tx_counter = alloc_percpu(u32);
+	if (!bond->rr_tx_counter)
+		return -ENOMEM;
+
 	bond->wq = create_singlethread_workqueue(bond_dev->name);
 	if (!bond->wq)
 		return -ENOMEM;
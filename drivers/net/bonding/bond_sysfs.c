@@ -1521,6 +1521,7 @@ static ssize_t bonding_store_queue_id(struct device *d,
 
 	/* Actually set the qids for the slave */
 	update_slave->queue_id = qid;
+	bond_update_slave_arr(bond, NULL);
 
 	read_unlock(&bond->lock);
 out:
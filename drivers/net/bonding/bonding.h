@@ -56,6 +56,14 @@
 #define TX_QUEUE_OVERRIDE(mode)				\
 			(((mode) == BOND_MODE_ACTIVEBACKUP) ||	\
 			 ((mode) == BOND_MODE_ROUNDROBIN))
+
+/*
+ * Modes whose transmit path only needs bond->slave_arr and
+ * curr_active_slave, both read under RCU without bond->lock.
+ */
+#define TX_LOCKLESS(mode)				\
+			(((mode) != BOND_MODE_TLB) &&		\
+			 ((mode) != BOND_MODE_ALB))
 /*
  * Less bad way to call ioctl from within the kernel; this needs to be
  * done some other way to get the call out of interrupt context.
@@ -196,6 +204,19 @@ struct slave {
 #endif
 };
 
+/*
+ * Snapshot of the slave list for the transmit path. arr[0..count) are
+ * the slaves the current mode may transmit on, arr[count..count+qcount)
+ * the slaves with a queue_id for the queue override. Replaced as a whole
+ * by bond_update_slave_arr(), never modified once published.
+ */
+struct bond_slave_arr {
+	struct rcu_head rcu;
+	unsigned int count;
+	unsigned int qcount;
+	struct slave *arr[0];
+};
+
 /*
  * Link pseudo-state only used internally by monitors
  */
@@ -209,6 +230,12 @@ struct slave {
  *    (It is unnecessary when the write-lock is put with bond->lock.)
  * 3) When we lock with bond->curr_slave_lock, we must lock with bond->lock
  *    beforehand.
+ * 4) bond->slave_arr_lock serializes rebuilds of bond->slave_arr. It nests
+ *    inside both of the above and the transmit path never takes it.
+ *
+ * A slave is freed only after a grace period once it is gone from the
+ * list, slave_arr and curr_active_slave, so that TX_LOCKLESS modes may
+ * use them under rcu_read_lock() alone.
  */
 struct bonding {
 	struct   net_device *dev; /* first - useful for panic debug */
@@ -232,8 +259,10 @@ struct bonding {
 	struct   list_head bond_list;
 	struct   netdev_hw_addr_list mc_list;
 	int      (*xmit_hash_policy)(struct sk_buff *, int);
+	struct   bond_slave_arr __rcu *slave_arr;
+	spinlock_t slave_arr_lock;
 	__be32   master_ip;
-	u16      rr_tx_counter;
+	u32      __percpu *rr_tx_counter;
 	struct   ad_bond_info ad_info;
 	struct   alb_bond_info alb_info;
 	struct   bond_params params;
@@ -397,6 +426,7 @@ void bond_set_mode_ops(struct bonding *bond, int mode);
 int bond_parse_parm(const char *mode_arg, const struct bond_parm_tbl *tbl);
 void bond_select_active_slave(struct bonding *bond);
 void bond_change_active_slave(struct bonding *bond, struct slave *new_active);
+void bond_update_slave_arr(struct bonding *bond, struct slave *skipslave);
 void bond_create_debugfs(void);
 void bond_destroy_debugfs(void);
 void bond_debug_register(struct bonding *bond);
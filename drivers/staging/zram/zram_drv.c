@@ -30,6 +30,8 @@
 #include <linux/highmem.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
+#include <linux/percpu.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -104,6 +106,58 @@ static int page_zero_filled(void *ptr)
 	return 1;
 }
 
+static const struct zram_backend zram_backends[] = {
+	{
+		.name		= "lzo",
+		.workmem_size	= LZO1X_MEM_COMPRESS,
+		.compress	= lzo1x_1_compress,
+		.decompress	= lzo1x_decompress_safe,
+	},
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	{
+		.name		= "lz4",
+		.workmem_size	= LZ4_MEM_COMPRESS,
+		.compress	= lz4_compress,
+		.decompress	= lz4_decompress_safe,
+	}, {
+		.name		= "lz4hc",
+		.workmem_size	= LZ4HC_MEM_COMPRESS,
+		.compress	= lz4hc_compress,
+		.decompress	= lz4_decompress_safe,
+	},
+#endif
+};
+
+const struct zram_backend *zram_find_backend(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++)
+		if (sysfs_streq(name, zram_backends[i].name))
+			return &zram_backends[i];
+
+	return NULL;
+}
+
+/* Lists the available backends, the one of zram in brackets */
+ssize_t zram_show_backends(struct zram *zram, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++) {
+		const struct zram_backend *backend = &zram_backends[i];
+
+		if (backend == zram->backend)
+			len += sprintf(buf + len, "[%s] ", backend->name);
+		else
+			len += sprintf(buf + len, "%s ", backend->name);
+	}
+	buf[len - 1] = '\n';
+
+	return len;
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,15 +187,13 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+/* Called with tb_lock held for writing */
 static void zram_free_page(struct zram *zram, size_t index)
 {
-	u32 clen;
-	void *obj;
-
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	unsigned long handle = zram->table[index].handle;
+	u32 clen = zram->table[index].size;
 
-	if (unlikely(!page)) {
+	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
@@ -155,17 +207,13 @@ static void zram_free_page(struct zram *zram, size_t index)
 
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page((struct page *)handle);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
+	zs_free(zram->mem_pool, handle);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
@@ -173,76 +221,78 @@ out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void zram_update_mem_used_max(struct zram *zram)
 {
-	struct page *page = bvec->bv_page;
-	void *user_mem;
+	u64 used = zs_get_total_size_bytes(zram->mem_pool) +
+		((u64)(zram->stats.pages_expand) << PAGE_SHIFT);
 
-	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	kunmap_atomic(user_mem, KM_USER0);
+	spin_lock(&zram->stat64_lock);
+	if (used > zram->stats.mem_used_max)
+		zram->stats.mem_used_max = used;
+	spin_unlock(&zram->stat64_lock);
+}
 
-	flush_dcache_page(page);
+static inline int is_partial_io(struct bio_vec *bvec)
+{
+	return bvec->bv_len != PAGE_SIZE;
 }
 
-static void handle_uncompressed_page(struct zram *zram, struct bio_vec *bvec,
-				     u32 index, int offset)
+/* Decompresses the page at index into mem, which is PAGE_SIZE long */
+static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 {
-	struct page *page = bvec->bv_page;
-	unsigned char *user_mem, *cmem;
+	int ret = 0;
+	size_t clen = PAGE_SIZE;
+	unsigned long handle;
+	unsigned char *cmem;
 
-	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1);
+	read_lock(&zram->tb_lock);
+	handle = zram->table[index].handle;
 
-	memcpy(user_mem + bvec->bv_offset, cmem + offset, bvec->bv_len);
-	kunmap_atomic(cmem, KM_USER1);
-	kunmap_atomic(user_mem, KM_USER0);
+	if (zram_test_flag(zram, index, ZRAM_ZERO) || !handle) {
+		read_unlock(&zram->tb_lock);
+		memset(mem, 0, PAGE_SIZE);
+		return 0;
+	}
 
-	flush_dcache_page(page);
-}
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		cmem = kmap_atomic((struct page *)handle, KM_USER1);
+		memcpy(mem, cmem, PAGE_SIZE);
+		kunmap_atomic(cmem, KM_USER1);
+	} else {
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+		ret = zram->backend->decompress(cmem, zram->table[index].size,
+						mem, &clen);
+		zs_unmap_object(zram->mem_pool, handle);
+	}
+	read_unlock(&zram->tb_lock);
 
-static inline int is_partial_io(struct bio_vec *bvec)
-{
-	return bvec->bv_len != PAGE_SIZE;
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret || clen != PAGE_SIZE)) {
+		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return -EIO;
+	}
+
+	return 0;
 }
 
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset, struct bio *bio)
 {
 	int ret;
-	size_t clen;
 	struct page *page;
-	struct zobj_header *zheader;
-	unsigned char *user_mem, *cmem, *uncmem = NULL;
+	unsigned char *user_mem, *uncmem = NULL;
 
 	page = bvec->bv_page;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-		handle_zero_page(bvec);
-		return 0;
-	}
-
-	/* Requested page is not present in compressed area */
-	if (unlikely(!zram->table[index].page)) {
-		pr_debug("Read before write: sector=%lu, size=%u",
-			 (ulong)(bio->bi_sector), bio->bi_size);
-		handle_zero_page(bvec);
-		return 0;
-	}
-
-	/* Page is stored uncompressed since it's incompressible */
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		handle_uncompressed_page(zram, bvec, index, offset);
-		return 0;
-	}
-
 	if (is_partial_io(bvec)) {
 		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 		if (!uncmem) {
 			pr_info("Error allocating temp memory!\n");
 			return -ENOMEM;
@@ -252,139 +302,89 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	user_mem = kmap_atomic(page, KM_USER0);
 	if (!is_partial_io(bvec))
 		uncmem = user_mem;
-	clen = PAGE_SIZE;
-
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-		zram->table[index].offset;
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    xv_get_object_size(cmem) - sizeof(*zheader),
-				    uncmem, &clen);
+	ret = zram_decompress_page(zram, uncmem, index);
 
 	if (is_partial_io(bvec)) {
-		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
-		       bvec->bv_len);
+		if (!ret)
+			memcpy(user_mem + bvec->bv_offset, uncmem + offset,
+			       bvec->bv_len);
 		kfree(uncmem);
 	}
-
-	kunmap_atomic(cmem, KM_USER1);
 	kunmap_atomic(user_mem, KM_USER0);
 
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		zram_stat64_inc(zram, &zram->stats.failed_reads);
+	if (ret)
 		return ret;
-	}
 
 	flush_dcache_page(page);
 
 	return 0;
 }
 
-static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
-{
-	int ret;
-	size_t clen = PAGE_SIZE;
-	struct zobj_header *zheader;
-	unsigned char *cmem;
-
-	if (zram_test_flag(zram, index, ZRAM_ZERO) ||
-	    !zram->table[index].page) {
-		memset(mem, 0, PAGE_SIZE);
-		return 0;
-	}
-
-	cmem = kmap_atomic(zram->table[index].page, KM_USER0) +
-		zram->table[index].offset;
-
-	/* Page is stored uncompressed since it's incompressible */
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		memcpy(mem, cmem, PAGE_SIZE);
-		kunmap_atomic(cmem, KM_USER0);
-		return 0;
-	}
-
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    xv_get_object_size(cmem) - sizeof(*zheader),
-				    mem, &clen);
-	kunmap_atomic(cmem, KM_USER0);
-
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		zram_stat64_inc(zram, &zram->stats.failed_reads);
-		return ret;
-	}
-
-	return 0;
-}
-
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			   int offset)
 {
 	int ret;
-	u32 store_offset;
 	size_t clen;
-	struct zobj_header *zheader;
-	struct page *page, *page_store;
+	size_t handle_size = 0;
+	unsigned long handle = 0;
+	struct page *page, *page_store = NULL;
+	struct zram_stream *zstrm;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
 		 * This is a partial IO. We need to read the full page
 		 * before to write the changes.
 		 */
-		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 		if (!uncmem) {
 			pr_info("Error allocating temp memory!\n");
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_read_before_write(zram, uncmem, index);
-		if (ret) {
-			kfree(uncmem);
+		ret = zram_decompress_page(zram, uncmem, index);
+		if (ret)
 			goto out;
-		}
+
+		user_mem = kmap_atomic(page, KM_USER0);
+		memcpy(uncmem + offset, user_mem + bvec->bv_offset,
+		       bvec->bv_len);
+		kunmap_atomic(user_mem, KM_USER0);
 	}
 
+compress_again:
 	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
+	 * Nothing below may sleep until the stream is put back. Memory is
+	 * first asked for without direct reclaim; if that fails, it is
+	 * allocated outside of the stream and the page compressed again.
 	 */
-	if (zram->table[index].page ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
-
-	user_mem = kmap_atomic(page, KM_USER0);
+	zstrm = get_cpu_ptr(zram->streams);
+	src = uncmem ? uncmem : kmap_atomic(page, KM_USER0);
 
-	if (is_partial_io(bvec))
-		memcpy(uncmem + offset, user_mem + bvec->bv_offset,
-		       bvec->bv_len);
-	else
-		uncmem = user_mem;
+	if (page_zero_filled(src)) {
+		if (!uncmem)
+			kunmap_atomic(src, KM_USER0);
+		put_cpu_ptr(zram->streams);
 
-	if (page_zero_filled(uncmem)) {
-		kunmap_atomic(user_mem, KM_USER0);
-		if (is_partial_io(bvec))
-			kfree(uncmem);
+		write_lock(&zram->tb_lock);
+		zram_free_page(zram, index);
 		zram_stat_inc(&zram->stats.pages_zero);
 		zram_set_flag(zram, index, ZRAM_ZERO);
+		write_unlock(&zram->tb_lock);
 		ret = 0;
 		goto out;
 	}
 
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       zram->compress_workmem);
-
-	kunmap_atomic(user_mem, KM_USER0);
-	if (is_partial_io(bvec))
-			kfree(uncmem);
-
-	if (unlikely(ret != LZO_E_OK)) {
+	clen = ZRAM_STREAM_BUFFER_SIZE;
+	ret = zram->backend->compress(src, PAGE_SIZE, zstrm->buffer, &clen,
+				      zstrm->workmem);
+	if (unlikely(ret)) {
+		if (!uncmem)
+			kunmap_atomic(src, KM_USER0);
+		put_cpu_ptr(zram->streams);
 		pr_err("Compression failed! err=%d\n", ret);
 		goto out;
 	}
@@ -395,62 +395,103 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	 * errors which has side effect of hanging the system.
 	 */
 	if (unlikely(clen > max_zpage_size)) {
-		clen = PAGE_SIZE;
-		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-		if (unlikely(!page_store)) {
+		if (!page_store)
+			page_store = alloc_page(GFP_NOWAIT | __GFP_NOWARN |
+						__GFP_HIGHMEM);
+		if (!page_store) {
+			if (!uncmem)
+				kunmap_atomic(src, KM_USER0);
+			put_cpu_ptr(zram->streams);
+			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+			if (page_store)
+				goto compress_again;
 			pr_info("Error allocating memory for "
 				"incompressible page: %u\n", index);
 			ret = -ENOMEM;
 			goto out;
 		}
 
-		store_offset = 0;
-		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_inc(&zram->stats.pages_expand);
-		zram->table[index].page = page_store;
-		src = kmap_atomic(page, KM_USER0);
-		goto memstore;
-	}
+		clen = PAGE_SIZE;
+		cmem = kmap_atomic(page_store, KM_USER1);
+		memcpy(cmem, src, PAGE_SIZE);
+		kunmap_atomic(cmem, KM_USER1);
+	} else {
+		/* Retried with a different outcome: size it again */
+		if (handle && clen > handle_size) {
+			zs_free(zram->mem_pool, handle);
+			handle = 0;
+		}
+		if (!handle) {
+			handle = zs_malloc(zram->mem_pool, clen, GFP_NOWAIT |
+					   __GFP_NOWARN | __GFP_HIGHMEM);
+			handle_size = clen;
+		}
+		if (!handle) {
+			if (!uncmem)
+				kunmap_atomic(src, KM_USER0);
+			put_cpu_ptr(zram->streams);
+			handle = zs_malloc(zram->mem_pool, clen,
+					   GFP_NOIO | __GFP_HIGHMEM);
+			if (handle)
+				goto compress_again;
+			pr_info("Error allocating memory for compressed "
+				"page: %u, size=%zu\n", index, clen);
+			ret = -ENOMEM;
+			goto out;
+		}
 
-	if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-		      &zram->table[index].page, &store_offset,
-		      GFP_NOIO | __GFP_HIGHMEM)) {
-		pr_info("Error allocating memory for compressed "
-			"page: %u, size=%zu\n", index, clen);
-		ret = -ENOMEM;
-		goto out;
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+		memcpy(cmem, zstrm->buffer, clen);
+		zs_unmap_object(zram->mem_pool, handle);
 	}
 
-memstore:
-	zram->table[index].offset = store_offset;
-
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-		zram->table[index].offset;
+	if (!uncmem)
+		kunmap_atomic(src, KM_USER0);
+	put_cpu_ptr(zram->streams);
 
-#if 0
-	/* Back-reference needed for memory defragmentation */
-	if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-		zheader = (struct zobj_header *)cmem;
-		zheader->table_idx = index;
-		cmem += sizeof(*zheader);
+	/* Drop whatever an earlier attempt allocated for the other case */
+	if (clen == PAGE_SIZE && handle) {
+		zs_free(zram->mem_pool, handle);
+		handle = 0;
+	} else if (clen != PAGE_SIZE && page_store) {
+		__free_page(page_store);
+		page_store = NULL;
 	}
-#endif
 
-	memcpy(cmem, src, clen);
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	write_lock(&zram->tb_lock);
+	zram_free_page(zram, index);
 
-	kunmap_atomic(cmem, KM_USER1);
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-		kunmap_atomic(src, KM_USER0);
+	if (page_store) {
+		zram->table[index].handle = (unsigned long)page_store;
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_inc(&zram->stats.pages_expand);
+	} else {
+		zram->table[index].handle = handle;
+		zram->table[index].size = clen;
+	}
 
 	/* Update stats */
 	zram_stat64_add(zram, &zram->stats.compr_size, clen);
 	zram_stat_inc(&zram->stats.pages_stored);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_inc(&zram->stats.good_compress);
+	write_unlock(&zram->tb_lock);
+
+	zram_update_mem_used_max(zram);
+	kfree(uncmem);
 
 	return 0;
 
 out:
+	kfree(uncmem);
+	if (handle)
+		zs_free(zram->mem_pool, handle);
+	if (page_store)
+		__free_page(page_store);
 	if (ret)
 		zram_stat64_inc(zram, &zram->stats.failed_writes);
 	return ret;
@@ -459,19 +500,10 @@ out:
 static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 			int offset, struct bio *bio, int rw)
 {
-	int ret;
-
-	if (rw == READ) {
-		down_read(&zram->lock);
-		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-		up_read(&zram->lock);
-	} else {
-		down_write(&zram->lock);
-		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
-	}
+	if (rw == READ)
+		return zram_bvec_read(zram, bvec, index, offset, bio);
 
-	return ret;
+	return zram_bvec_write(zram, bvec, index, offset);
 }
 
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
@@ -583,6 +615,46 @@ error:
 	bio_io_error(bio);
 }
 
+static void zram_free_streams(struct zram *zram)
+{
+	int cpu;
+
+	if (!zram->streams)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_stream *zstrm = per_cpu_ptr(zram->streams, cpu);
+
+		vfree(zstrm->workmem);
+		free_pages((unsigned long)zstrm->buffer,
+			   get_order(ZRAM_STREAM_BUFFER_SIZE));
+	}
+	free_percpu(zram->streams);
+	zram->streams = NULL;
+}
+
+static int zram_alloc_streams(struct zram *zram)
+{
+	int cpu;
+
+	zram->streams = alloc_percpu(struct zram_stream);
+	if (!zram->streams)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_stream *zstrm = per_cpu_ptr(zram->streams, cpu);
+
+		zstrm->workmem = vzalloc(zram->backend->workmem_size);
+		/* Output may exceed the input for incompressible data */
+		zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL |
+				__GFP_ZERO, get_order(ZRAM_STREAM_BUFFER_SIZE));
+		if (!zstrm->workmem || !zstrm->buffer)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
 void __zram_reset_device(struct zram *zram)
 {
 	size_t index;
@@ -590,33 +662,26 @@ void __zram_reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	zram_free_streams(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+		unsigned long handle = zram->table[index].handle;
 
-		if (!page)
+		if (!handle)
 			continue;
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
+			__free_page((struct page *)handle);
 		else
-			xv_free(zram->mem_pool, page, offset);
+			zs_free(zram->mem_pool, handle);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -646,17 +711,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail_no_table;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_alloc_streams(zram);
+	if (ret) {
+		pr_err("Error allocating compression streams\n");
 		goto fail_no_table;
 	}
 
@@ -673,7 +730,7 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool("zram");
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -702,7 +759,9 @@ static void zram_slot_free_notify(struct block_device *bdev,
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->tb_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->tb_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -715,8 +774,9 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	init_rwsem(&zram->lock);
+	rwlock_init(&zram->tb_lock);
 	init_rwsem(&zram->init_lock);
+	zram->backend = &zram_backends[0];
 	spin_lock_init(&zram->stat64_lock);
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
@@ -18,7 +18,7 @@
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
 
-#include "xvmalloc.h"
+#include "../zsmalloc/zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +26,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -51,8 +39,8 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - sizeof(unsigned long)
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -81,8 +69,9 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
+	unsigned long handle;	/* zsmalloc handle, or the struct page
+				 * of an uncompressed page */
+	u16 size;	/* object size (excluding header) */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -95,20 +84,47 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
+	u64 mem_used_max;	/* peak of memory used, in bytes */
 	u32 pages_zero;		/* no. of zero filled pages */
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
 };
 
+/*
+ * Compression algorithm of a device. It may only be changed while the
+ * device is not initialized, so all pages of a device use the same one.
+ */
+struct zram_backend {
+	const char *name;
+	size_t workmem_size;
+	/* *dst_len is the room at dst on entry, the compressed size after */
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
+};
+
+/*
+ * Compression state of one cpu. Writes compress with preemption disabled
+ * in the stream of the local cpu, so they proceed in parallel.
+ */
+struct zram_stream {
+	void *workmem;
+	void *buffer;
+};
+
+/* Room for the compressed page, which may be larger than the page */
+#define ZRAM_STREAM_BUFFER_SIZE	(2 * PAGE_SIZE)
+
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	const struct zram_backend *backend;
+	struct zram_stream __percpu *streams;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
+	rwlock_t tb_lock;	/* protect table entries and the 32-bit
+				 * stats against concurrent updates */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -129,6 +145,8 @@ extern unsigned int zram_num_devices;
 extern struct attribute_group zram_disk_attr_group;
 #endif
 
+extern const struct zram_backend *zram_find_backend(const char *name);
+extern ssize_t zram_show_backends(struct zram *zram, char *buf);
 extern int zram_init_device(struct zram *zram);
 extern void __zram_reset_device(struct zram *zram);
 
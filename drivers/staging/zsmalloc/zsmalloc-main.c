@@ -0,0 +1,750 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are grouped by size into classes ZS_SIZE_CLASS_DELTA bytes
+ * apart, and each class packs its objects back to back into zspages of
+ * a few 0-order pages, so no higher order allocation is ever needed and
+ * little is lost at page ends.
+ *
+ * Callers get an opaque handle instead of an address. zs_map_object()
+ * turns it into a pointer that stays valid until zs_unmap_object(), with
+ * preemption disabled in between; only one object may be mapped per cpu
+ * at a time. Objects within one page are mapped with kmap_atomic(), those
+ * straddling two pages are copied through a per-cpu buffer.
+ *
+ * As nobody holds the address of an unmapped object, zs_compact() can
+ * move objects out of sparsely used zspages into fuller ones of the same
+ * class and free the pages left empty. A shrinker runs it under memory
+ * pressure.
+ *
+ * Locking: the class lock protects the zspages of a class and their free
+ * lists. The pin bit of a handle is held while its object is mapped or
+ * freed, and is taken before the class lock. Compaction runs under the
+ * class lock and only trylocks pins, skipping objects in use.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *zs_handle_cache;
+
+struct mapping_area {
+	char *vm_buf;		/* copy of an object spanning two pages */
+	char *vm_addr;		/* kmap_atomic() address, NULL if copied */
+	enum zs_mapmode vm_mm;	/* mapping mode */
+};
+
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * To reduce the waste at the end of the last page, a zspage of a class
+ * may consist of several pages. Pick the count that uses the largest
+ * share of the memory for objects.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	/* zspage order which gives maximum used size per KB */
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size;
+		int waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max_objects = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max_objects)
+		return ZS_FULL;
+	if (inuse * 4 >= max_objects * 3)
+		return ZS_ALMOST_FULL;
+	return ZS_ALMOST_EMPTY;
+}
+
+/*
+ * Moves the zspage to the list matching its current use and returns
+ * the group. ZS_EMPTY zspages are on no list: new ones not yet handed
+ * out, drained ones about to be freed and compaction sources.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+						struct zspage *zspage)
+{
+	enum fullness_group newfg = get_fullness_group(class, zspage);
+
+	if (newfg == zspage->fullness)
+		return newfg;
+
+	if (zspage->fullness != ZS_EMPTY)
+		list_del(&zspage->list);
+	if (newfg != ZS_EMPTY)
+		list_add(&zspage->list, &class->fullness_list[newfg]);
+	zspage->fullness = newfg;
+
+	return newfg;
+}
+
+/* Fullest zspage of the class that still has a free slot */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	struct list_head *head;
+
+	head = &class->fullness_list[ZS_ALMOST_FULL];
+	if (list_empty(head))
+		head = &class->fullness_list[ZS_ALMOST_EMPTY];
+	if (list_empty(head))
+		return NULL;
+
+	return list_first_entry(head, struct zspage, list);
+}
+
+static void obj_location(struct size_class *class, unsigned int idx,
+			unsigned int *page_idx, unsigned int *offset)
+{
+	unsigned long off = (unsigned long)idx * class->size;
+
+	*page_idx = off >> PAGE_SHIFT;
+	*offset = off & ~PAGE_MASK;
+}
+
+static unsigned long obj_header(struct size_class *class,
+				struct zspage *zspage, unsigned int idx)
+{
+	unsigned int page_idx, offset;
+	unsigned long val;
+	void *vaddr;
+
+	obj_location(class, idx, &page_idx, &offset);
+	vaddr = kmap_atomic(zspage->pages[page_idx], KM_USER0);
+	val = *(unsigned long *)(vaddr + offset);
+	kunmap_atomic(vaddr, KM_USER0);
+
+	return val;
+}
+
+static unsigned long xchg_obj_header(struct size_class *class,
+				struct zspage *zspage, unsigned int idx,
+				unsigned long val)
+{
+	unsigned int page_idx, offset;
+	unsigned long *hdr, old;
+	void *vaddr;
+
+	obj_location(class, idx, &page_idx, &offset);
+	vaddr = kmap_atomic(zspage->pages[page_idx], KM_USER0);
+	hdr = vaddr + offset;
+	old = *hdr;
+	*hdr = val;
+	kunmap_atomic(vaddr, KM_USER0);
+
+	return old;
+}
+
+/* Links all slots of a new zspage into its free list */
+static void init_zspage(struct size_class *class, struct zspage *zspage)
+{
+	unsigned int idx, page_idx, offset, cur = UINT_MAX;
+	void *vaddr = NULL;
+
+	for (idx = 0; idx < class->objs_per_zspage; idx++) {
+		obj_location(class, idx, &page_idx, &offset);
+		if (page_idx != cur) {
+			if (vaddr)
+				kunmap_atomic(vaddr, KM_USER0);
+			vaddr = kmap_atomic(zspage->pages[page_idx], KM_USER0);
+			cur = page_idx;
+		}
+		*(unsigned long *)(vaddr + offset) =
+			((unsigned long)(idx + 1) << 1) | OBJ_FREE_TAG;
+	}
+	kunmap_atomic(vaddr, KM_USER0);
+
+	zspage->freeobj = 0;
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	struct size_class *class = zspage->class;
+	int i;
+
+	for (i = 0; i < class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+				struct size_class *class, gfp_t flags)
+{
+	struct zspage *zspage;
+	int i;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+	init_zspage(class, zspage);
+
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+	return zspage;
+
+fail:
+	while (i--)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+/* Takes a free slot of zspage for h. Called with the class lock held. */
+static unsigned int obj_malloc(struct size_class *class,
+				struct zspage *zspage, struct zs_handle *h)
+{
+	unsigned int idx = zspage->freeobj;
+
+	zspage->freeobj = xchg_obj_header(class, zspage, idx,
+					(unsigned long)h) >> 1;
+	zspage->inuse++;
+	class->objs_used++;
+
+	return idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	xchg_obj_header(class, zspage, idx,
+			((unsigned long)zspage->freeobj << 1) | OBJ_FREE_TAG);
+	zspage->freeobj = idx;
+	zspage->inuse--;
+	class->objs_used--;
+}
+
+static void pin_handle(struct zs_handle *h)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, &h->obj);
+}
+
+static int trypin_handle(struct zs_handle *h)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, &h->obj);
+}
+
+static void unpin_handle(struct zs_handle *h)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, &h->obj);
+}
+
+static unsigned int handle_obj_idx(struct zs_handle *h)
+{
+	return h->obj >> 1;
+}
+
+/*
+ * Copies the payload of an object that spans two pages to or from buf.
+ * The header is left alone: it is never stale in memory, but would be in
+ * buf after a write-only mapping. Class sizes keep it within one page.
+ */
+static void copy_object(struct size_class *class, struct zspage *zspage,
+			unsigned int idx, char *buf, bool to_obj)
+{
+	unsigned int page_idx, offset, len;
+	int size = class->size - ZS_HANDLE_SIZE;
+	char *vaddr;
+
+	obj_location(class, idx, &page_idx, &offset);
+	offset += ZS_HANDLE_SIZE;
+	buf += ZS_HANDLE_SIZE;
+	while (size) {
+		len = min_t(unsigned int, size, PAGE_SIZE - offset);
+		vaddr = kmap_atomic(zspage->pages[page_idx], KM_USER0);
+		if (to_obj)
+			memcpy(vaddr + offset, buf, len);
+		else
+			memcpy(buf, vaddr + offset, len);
+		kunmap_atomic(vaddr, KM_USER0);
+
+		buf += len;
+		size -= len;
+		page_idx++;
+		offset = 0;
+	}
+}
+
+/* Copies an object, header included, from one slot to another */
+static void move_object(struct size_class *class,
+			struct zspage *d_zspage, unsigned int d_idx,
+			struct zspage *s_zspage, unsigned int s_idx)
+{
+	unsigned int s_page, s_off, d_page, d_off, len;
+	int size = class->size;
+	char *s_addr, *d_addr;
+
+	obj_location(class, s_idx, &s_page, &s_off);
+	obj_location(class, d_idx, &d_page, &d_off);
+	while (size) {
+		len = min_t(unsigned int, size, PAGE_SIZE - s_off);
+		len = min_t(unsigned int, len, PAGE_SIZE - d_off);
+
+		s_addr = kmap_atomic(s_zspage->pages[s_page], KM_USER0);
+		d_addr = kmap_atomic(d_zspage->pages[d_page], KM_USER1);
+		memcpy(d_addr + d_off, s_addr + s_off, len);
+		kunmap_atomic(d_addr, KM_USER1);
+		kunmap_atomic(s_addr, KM_USER0);
+
+		size -= len;
+		s_off += len;
+		if (s_off == PAGE_SIZE) {
+			s_off = 0;
+			s_page++;
+		}
+		d_off += len;
+		if (d_off == PAGE_SIZE) {
+			d_off = 0;
+			d_page++;
+		}
+	}
+}
+
+/* Enough free slots in the class to empty at least one zspage */
+static bool zs_can_compact(struct size_class *class)
+{
+	return class->objs_allocated - class->objs_used >=
+		class->objs_per_zspage;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+					struct size_class *class)
+{
+	struct list_head *almost_empty;
+	struct zspage *src, *dst;
+	struct zs_handle *h;
+	unsigned long hdr, freed = 0;
+	unsigned int idx, d_idx;
+
+	almost_empty = &class->fullness_list[ZS_ALMOST_EMPTY];
+
+	spin_lock(&class->lock);
+	while (zs_can_compact(class) && !list_empty(almost_empty)) {
+		/* Drain the oldest sparse zspage, off the lists meanwhile */
+		src = list_entry(almost_empty->prev, struct zspage, list);
+		list_del(&src->list);
+		src->fullness = ZS_EMPTY;
+
+		for (idx = 0; src->inuse && idx < class->objs_per_zspage;
+		     idx++) {
+			hdr = obj_header(class, src, idx);
+			if (hdr & OBJ_FREE_TAG)
+				continue;
+
+			h = (struct zs_handle *)hdr;
+			dst = find_get_zspage(class);
+			if (!dst || !trypin_handle(h))
+				break;
+
+			d_idx = obj_malloc(class, dst, h);
+			move_object(class, dst, d_idx, src, idx);
+			h->zspage = dst;
+			h->obj = ((unsigned long)d_idx << 1) |
+				 (h->obj & (1UL << HANDLE_PIN_BIT));
+			unpin_handle(h);
+
+			obj_free(class, src, idx);
+			fix_fullness_group(class, dst);
+		}
+
+		/* An object is mapped: try again on the next run */
+		if (src->inuse) {
+			fix_fullness_group(class, src);
+			break;
+		}
+
+		class->objs_allocated -= class->objs_per_zspage;
+		spin_unlock(&class->lock);
+
+		free_zspage(pool, src);
+		freed += class->pages_per_zspage;
+		cond_resched();
+
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - move objects together and free the pages left empty
+ * @pool: pool to compact
+ *
+ * Returns the number of pages freed. Must be called from process context.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	unsigned long freed = 0;
+	int i;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		freed += zs_compact_class(pool, &pool->size_class[i]);
+
+	atomic_long_add(freed, &pool->pages_compacted);
+	return freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+static unsigned long zs_compactable_pages(struct zs_pool *pool)
+{
+	unsigned long pages = 0;
+	int i;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		unsigned long unused;
+
+		unused = class->objs_allocated - class->objs_used;
+		pages += unused / class->objs_per_zspage *
+			 class->pages_per_zspage;
+	}
+
+	return pages;
+}
+
+static int zs_shrink(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					    shrinker);
+
+	if (sc->nr_to_scan)
+		zs_compact(pool);
+
+	return zs_compactable_pages(pool);
+}
+
+/**
+ * zs_create_pool - create an allocation pool
+ * @name: name of the pool, for messages
+ *
+ * Returns NULL if no memory is available.
+ */
+struct zs_pool *zs_create_pool(const char *name)
+{
+	struct zs_pool *pool;
+	int i, fg;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+					 PAGE_SIZE / class->size;
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->name = name;
+	pool->shrinker.shrink = zs_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	struct zspage *zspage, *tmp;
+	int i, fg;
+
+	unregister_shrinker(&pool->shrinker);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		if (class->objs_used)
+			pr_info("zsmalloc: %s: class size %d has %lu objects "
+				"left\n", pool->name, class->size,
+				class->objs_used);
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list) {
+				list_del(&zspage->list);
+				free_zspage(pool, zspage);
+			}
+		}
+	}
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - allocate block of given size from pool
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @flags: allocation flags for new zspages, may include __GFP_HIGHMEM
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	struct size_class *class;
+	struct zspage *zspage;
+	struct zs_handle *h;
+	unsigned int idx;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return 0;
+
+	h = kmem_cache_alloc(zs_handle_cache, flags & ~__GFP_HIGHMEM);
+	if (!h)
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(pool, class, flags);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(zs_handle_cache, h);
+			return 0;
+		}
+		spin_lock(&class->lock);
+		class->objs_allocated += class->objs_per_zspage;
+	}
+
+	idx = obj_malloc(class, zspage, h);
+	h->zspage = zspage;
+	h->obj = (unsigned long)idx << 1;
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)h;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fg;
+
+	if (unlikely(!handle))
+		return;
+
+	pin_handle(h);
+	zspage = h->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, handle_obj_idx(h));
+	fg = fix_fullness_group(class, zspage);
+	if (fg == ZS_EMPTY)
+		class->objs_allocated -= class->objs_per_zspage;
+	spin_unlock(&class->lock);
+	unpin_handle(h);
+
+	if (fg == ZS_EMPTY)
+		free_zspage(pool, zspage);
+	kmem_cache_free(zs_handle_cache, h);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: what the caller is going to do with the object
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped using
+ * this function. When done with the object, it must be unmapped using
+ * zs_unmap_object. Preemption stays disabled in between, so the caller
+ * must not sleep, and may not map another object meanwhile.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct size_class *class;
+	struct mapping_area *area;
+	unsigned int idx, page_idx, offset;
+
+	BUG_ON(!handle);
+
+	/* Keeps compaction away and disables preemption until unmap */
+	pin_handle(h);
+	class = h->zspage->class;
+	idx = handle_obj_idx(h);
+	obj_location(class, idx, &page_idx, &offset);
+
+	area = &__get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+	if (offset + class->size <= PAGE_SIZE) {
+		area->vm_addr = kmap_atomic(h->zspage->pages[page_idx],
+					    KM_USER1);
+		return area->vm_addr + offset + ZS_HANDLE_SIZE;
+	}
+
+	area->vm_addr = NULL;
+	if (mm != ZS_MM_WO)
+		copy_object(class, h->zspage, idx, area->vm_buf, false);
+	return area->vm_buf + ZS_HANDLE_SIZE;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct mapping_area *area;
+
+	BUG_ON(!handle);
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vm_addr)
+		kunmap_atomic(area->vm_addr, KM_USER1);
+	else if (area->vm_mm != ZS_MM_RO)
+		copy_object(h->zspage->class, h->zspage, handle_obj_idx(h),
+			    area->vm_buf, true);
+	unpin_handle(h);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		unsigned long allocated, used;
+
+		spin_lock(&class->lock);
+		allocated = class->objs_allocated;
+		used = class->objs_used;
+		spin_unlock(&class->lock);
+
+		stats->objs_allocated += allocated;
+		stats->objs_used += used;
+		stats->bytes_unused += (u64)(allocated - used) * class->size;
+	}
+	stats->pages_used = atomic_long_read(&pool->pages_allocated);
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_pool_stats);
+
+static void zs_free_map_areas(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zs_map_area, cpu).vm_buf);
+		per_cpu(zs_map_area, cpu).vm_buf = NULL;
+	}
+}
+
+static int __init zs_init(void)
+{
+	int cpu;
+
+	zs_handle_cache = kmem_cache_create("zs_handle",
+					    sizeof(struct zs_handle), 0, 0,
+					    NULL);
+	if (!zs_handle_cache)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		char *buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+
+		if (!buf) {
+			zs_free_map_areas();
+			kmem_cache_destroy(zs_handle_cache);
+			return -ENOMEM;
+		}
+		per_cpu(zs_map_area, cpu).vm_buf = buf;
+	}
+
+	return 0;
+}
+
+static void __exit zs_exit(void)
+{
+	zs_free_map_areas();
+	kmem_cache_destroy(zs_handle_cache);
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("Memory allocator for compressed pages");
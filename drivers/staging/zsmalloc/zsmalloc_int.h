@@ -0,0 +1,105 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/atomic.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/shrinker.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/*
+ * A zspage is a group of up to ZS_MAX_PAGES_PER_ZSPAGE 0-order pages
+ * holding objects of one size class back to back, so that objects may
+ * straddle a page boundary. The group size is chosen per class to waste
+ * as little as possible at the end of the last page.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/*
+ * Every object starts with one word. While the object is allocated it
+ * holds the address of its handle, which lets compaction find and update
+ * the handle of an object it moves. While the slot is free it holds the
+ * index of the next free slot, tagged with OBJ_FREE_TAG. Class sizes are
+ * multiples of 16 bytes, so this word never straddles a page.
+ */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+#define OBJ_FREE_TAG		1UL
+
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Size classes are ZS_SIZE_CLASS_DELTA bytes apart, so at most that much
+ * is lost to rounding per object.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+
+/*
+ * Allocation prefers the fullest zspages so that the emptier ones drain
+ * and can be freed, or get picked as compaction sources.
+ */
+enum fullness_group {
+	ZS_ALMOST_FULL,		/* at least 3/4 of the slots in use */
+	ZS_ALMOST_EMPTY,	/* some slots in use */
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,		/* freed as soon as it gets there */
+};
+
+struct zspage {
+	struct list_head list;		/* in class->fullness_list */
+	struct size_class *class;
+	unsigned int inuse;		/* number of allocated slots */
+	unsigned int freeobj;		/* first free slot */
+	enum fullness_group fullness;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+/*
+ * What a handle points to. The pin bit is held while the object is
+ * mapped or being freed, and compaction leaves pinned objects alone.
+ */
+struct zs_handle {
+	struct zspage *zspage;
+	unsigned long obj;		/* slot index << 1 | pin bit */
+};
+
+#define HANDLE_PIN_BIT		0
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	int size;			/* object size, including the header */
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+
+	/* Protected by lock */
+	unsigned long objs_allocated;
+	unsigned long objs_used;
+};
+
+struct zs_pool {
+	const char *name;
+	struct size_class size_class[ZS_SIZE_CLASSES];
+
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+
+	struct shrinker shrinker;
+};
+
+#endif
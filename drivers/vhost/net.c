@@ -18,6 +18,7 @@
 #include <linux/rcupdate.h>
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 
 #include <linux/net.h>
 #include <linux/if_packet.h>
@@ -41,10 +42,20 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Experimental Zero Copy TX");
 #define VHOST_MAX_PEND 128
 #define VHOST_GOODCOPY_LEN 256
 
+/* Max number of used buffers added to the ring at once. The guest is
+ * signalled once per batch instead of once per buffer. */
+#define VHOST_NET_BATCH 64
+
+/* Max number of queue pairs of a multiqueue device */
+#define VHOST_NET_MAX_PAIRS 8
+
+/* Virtqueue 2n is the RX and 2n + 1 the TX queue of pair n. Each pair
+ * runs on a worker of its own. */
 enum {
 	VHOST_NET_VQ_RX = 0,
 	VHOST_NET_VQ_TX = 1,
-	VHOST_NET_VQ_MAX = 2,
+	VHOST_NET_VQ_PAIR = 2,
+	VHOST_NET_VQ_MAX = VHOST_NET_VQ_PAIR * VHOST_NET_MAX_PAIRS,
 };
 
 enum vhost_net_poll_state {
@@ -57,12 +68,17 @@ struct vhost_net {
 	struct vhost_dev dev;
 	struct vhost_virtqueue vqs[VHOST_NET_VQ_MAX];
 	struct vhost_poll poll[VHOST_NET_VQ_MAX];
-	/* Tells us whether we are polling a socket for TX.
+	/* Tells us whether we are polling a socket for TX, per TX vq.
 	 * We only do this when socket buffer fills up.
 	 * Protected by tx vq lock. */
-	enum vhost_net_poll_state tx_poll_state;
+	enum vhost_net_poll_state tx_poll_state[VHOST_NET_VQ_MAX];
 };
 
+static inline bool vhost_net_vq_is_tx(unsigned index)
+{
+	return index % VHOST_NET_VQ_PAIR == VHOST_NET_VQ_TX;
+}
+
 static bool vhost_sock_zcopy(struct socket *sock)
 {
 	return unlikely(experimental_zcopytx) &&
@@ -108,30 +124,34 @@ static void copy_iovec_hdr(const struct iovec *from, struct iovec *to,
 }
 
 /* Caller must have TX VQ lock */
-static void tx_poll_stop(struct vhost_net *net)
+static void tx_poll_stop(struct vhost_net *net, struct vhost_virtqueue *vq)
 {
-	if (likely(net->tx_poll_state != VHOST_NET_POLL_STARTED))
+	int index = vq - net->vqs;
+
+	if (likely(net->tx_poll_state[index] != VHOST_NET_POLL_STARTED))
 		return;
-	vhost_poll_stop(net->poll + VHOST_NET_VQ_TX);
-	net->tx_poll_state = VHOST_NET_POLL_STOPPED;
+	vhost_poll_stop(net->poll + index);
+	net->tx_poll_state[index] = VHOST_NET_POLL_STOPPED;
 }
 
 /* Caller must have TX VQ lock */
-static void tx_poll_start(struct vhost_net *net, struct socket *sock)
+static void tx_poll_start(struct vhost_net *net, struct vhost_virtqueue *vq,
+			  struct socket *sock)
 {
-	if (unlikely(net->tx_poll_state != VHOST_NET_POLL_STOPPED))
+	int index = vq - net->vqs;
+
+	if (unlikely(net->tx_poll_state[index] != VHOST_NET_POLL_STOPPED))
 		return;
-	vhost_poll_start(net->poll + VHOST_NET_VQ_TX, sock->file);
-	net->tx_poll_state = VHOST_NET_POLL_STARTED;
+	vhost_poll_start(net->poll + index, sock->file);
+	net->tx_poll_state[index] = VHOST_NET_POLL_STARTED;
 }
 
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
-static void handle_tx(struct vhost_net *net)
+static void handle_tx(struct vhost_net *net, struct vhost_virtqueue *vq)
 {
-	struct vhost_virtqueue *vq = &net->dev.vqs[VHOST_NET_VQ_TX];
 	unsigned out, in, s;
-	int head;
+	int head, batched = 0;
 	struct msghdr msg = {
 		.msg_name = NULL,
 		.msg_namelen = 0,
@@ -155,7 +175,7 @@ static void handle_tx(struct vhost_net *net)
 	wmem = atomic_read(&sock->sk->sk_wmem_alloc);
 	if (wmem >= sock->sk->sk_sndbuf) {
 		mutex_lock(&vq->mutex);
-		tx_poll_start(net, sock);
+		tx_poll_start(net, vq, sock);
 		mutex_unlock(&vq->mutex);
 		return;
 	}
@@ -164,7 +184,7 @@ static void handle_tx(struct vhost_net *net)
 	vhost_disable_notify(&net->dev, vq);
 
 	if (wmem < sock->sk->sk_sndbuf / 2)
-		tx_poll_stop(net);
+		tx_poll_stop(net, vq);
 	hdr_size = vq->vhost_hlen;
 	zcopy = vhost_sock_zcopy(sock);
 
@@ -186,7 +206,7 @@ static void handle_tx(struct vhost_net *net)
 
 			wmem = atomic_read(&sock->sk->sk_wmem_alloc);
 			if (wmem >= sock->sk->sk_sndbuf * 3 / 4) {
-				tx_poll_start(net, sock);
+				tx_poll_start(net, vq, sock);
 				set_bit(SOCK_ASYNC_NOSPACE, &sock->flags);
 				break;
 			}
@@ -197,7 +217,7 @@ static void handle_tx(struct vhost_net *net)
 				    (vq->upend_idx - vq->done_idx) :
 				    (vq->upend_idx + UIO_MAXIOV - vq->done_idx);
 			if (unlikely(num_pends > VHOST_MAX_PEND)) {
-				tx_poll_start(net, sock);
+				tx_poll_start(net, vq, sock);
 				set_bit(SOCK_ASYNC_NOSPACE, &sock->flags);
 				break;
 			}
@@ -257,20 +277,31 @@ static void handle_tx(struct vhost_net *net)
 					UIO_MAXIOV;
 			}
 			vhost_discard_vq_desc(vq, 1);
-			tx_poll_start(net, sock);
+			tx_poll_start(net, vq, sock);
 			break;
 		}
 		if (err != len)
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		if (!zcopy)
-			vhost_add_used_and_signal(&net->dev, vq, head, 0);
+		/* Without zerocopy the heads are free to batch used
+		 * buffers in: they are all flushed before we return. */
+		if (!zcopy) {
+			vq->heads[batched].id = head;
+			vq->heads[batched].len = 0;
+			if (++batched == VHOST_NET_BATCH) {
+				vhost_add_used_and_signal_n(&net->dev, vq,
+							    vq->heads, batched);
+				batched = 0;
+			}
+		}
 		total_len += len;
 		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
 			vhost_poll_queue(&vq->poll);
 			break;
 		}
 	}
+	if (batched)
+		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads, batched);
 
 	mutex_unlock(&vq->mutex);
 }
@@ -353,9 +384,8 @@ err:
 
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
-static void handle_rx(struct vhost_net *net)
+static void handle_rx(struct vhost_net *net, struct vhost_virtqueue *vq)
 {
-	struct vhost_virtqueue *vq = &net->dev.vqs[VHOST_NET_VQ_RX];
 	unsigned uninitialized_var(in), log;
 	struct vhost_log *vq_log;
 	struct msghdr msg = {
@@ -371,7 +401,7 @@ static void handle_rx(struct vhost_net *net)
 		.hdr.gso_type = VIRTIO_NET_HDR_GSO_NONE
 	};
 	size_t total_len = 0;
-	int err, headcount, mergeable;
+	int err, headcount, mergeable, batched = 0;
 	size_t vhost_hlen, sock_hlen;
 	size_t vhost_len, sock_len;
 	/* TODO: check that we are running from vhost_worker? */
@@ -392,9 +422,11 @@ static void handle_rx(struct vhost_net *net)
 	while ((sock_len = peek_head_len(sock->sk))) {
 		sock_len += sock_hlen;
 		vhost_len = sock_len + vhost_hlen;
-		headcount = get_rx_bufs(vq, vq->heads, vhost_len,
+		/* Heads of the packets received so far precede ours. */
+		headcount = get_rx_bufs(vq, vq->heads + batched, vhost_len,
 					&in, vq_log, &log,
-					likely(mergeable) ? UIO_MAXIOV : 1);
+					likely(mergeable) ?
+					UIO_MAXIOV - batched : 1);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(headcount < 0))
 			break;
@@ -446,8 +478,12 @@ static void handle_rx(struct vhost_net *net)
 			vhost_discard_vq_desc(vq, headcount);
 			break;
 		}
-		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads,
-					    headcount);
+		batched += headcount;
+		if (batched >= VHOST_NET_BATCH) {
+			vhost_add_used_and_signal_n(&net->dev, vq, vq->heads,
+						    batched);
+			batched = 0;
+		}
 		if (unlikely(vq_log))
 			vhost_log_write(vq, vq_log, log, vhost_len);
 		total_len += vhost_len;
@@ -456,6 +492,8 @@ static void handle_rx(struct vhost_net *net)
 			break;
 		}
 	}
+	if (batched)
+		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads, batched);
 
 	mutex_unlock(&vq->mutex);
 }
@@ -466,7 +504,7 @@ static void handle_tx_kick(struct vhost_work *work)
 						  poll.work);
 	struct vhost_net *net = container_of(vq->dev, struct vhost_net, dev);
 
-	handle_tx(net);
+	handle_tx(net, vq);
 }
 
 static void handle_rx_kick(struct vhost_work *work)
@@ -475,44 +513,73 @@ static void handle_rx_kick(struct vhost_work *work)
 						  poll.work);
 	struct vhost_net *net = container_of(vq->dev, struct vhost_net, dev);
 
-	handle_rx(net);
+	handle_rx(net, vq);
 }
 
 static void handle_tx_net(struct vhost_work *work)
 {
-	struct vhost_net *net = container_of(work, struct vhost_net,
-					     poll[VHOST_NET_VQ_TX].work);
-	handle_tx(net);
+	struct vhost_poll *poll = container_of(work, struct vhost_poll, work);
+	struct vhost_net *net = container_of(poll->dev, struct vhost_net, dev);
+
+	handle_tx(net, net->vqs + (poll - net->poll));
 }
 
 static void handle_rx_net(struct vhost_work *work)
 {
-	struct vhost_net *net = container_of(work, struct vhost_net,
-					     poll[VHOST_NET_VQ_RX].work);
-	handle_rx(net);
+	struct vhost_poll *poll = container_of(work, struct vhost_poll, work);
+	struct vhost_net *net = container_of(poll->dev, struct vhost_net, dev);
+
+	handle_rx(net, net->vqs + (poll - net->poll));
+}
+
+/* With all its queue pairs the device is too large for kmalloc to be
+ * relied upon. */
+static struct vhost_net *vhost_net_alloc(void)
+{
+	struct vhost_net *n;
+
+	n = kmalloc(sizeof *n, GFP_KERNEL | __GFP_NOWARN | __GFP_REPEAT);
+	if (!n)
+		n = vmalloc(sizeof *n);
+	return n;
+}
+
+static void vhost_net_free(struct vhost_net *n)
+{
+	if (is_vmalloc_addr(n))
+		vfree(n);
+	else
+		kfree(n);
 }
 
 static int vhost_net_open(struct inode *inode, struct file *f)
 {
-	struct vhost_net *n = kmalloc(sizeof *n, GFP_KERNEL);
+	struct vhost_net *n = vhost_net_alloc();
 	struct vhost_dev *dev;
-	int r;
+	int i, r;
 
 	if (!n)
 		return -ENOMEM;
 
 	dev = &n->dev;
-	n->vqs[VHOST_NET_VQ_TX].handle_kick = handle_tx_kick;
-	n->vqs[VHOST_NET_VQ_RX].handle_kick = handle_rx_kick;
-	r = vhost_dev_init(dev, n->vqs, VHOST_NET_VQ_MAX);
+	for (i = 0; i < VHOST_NET_VQ_MAX; ++i)
+		n->vqs[i].handle_kick = vhost_net_vq_is_tx(i) ?
+					handle_tx_kick : handle_rx_kick;
+	r = vhost_dev_init(dev, n->vqs, VHOST_NET_VQ_MAX, VHOST_NET_MAX_PAIRS);
 	if (r < 0) {
-		kfree(n);
+		vhost_net_free(n);
 		return r;
 	}
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev);
-	n->tx_poll_state = VHOST_NET_POLL_DISABLED;
+	for (i = 0; i < VHOST_NET_VQ_MAX; ++i) {
+		if (vhost_net_vq_is_tx(i))
+			vhost_poll_init(n->poll + i, handle_tx_net, POLLOUT,
+					n->vqs + i);
+		else
+			vhost_poll_init(n->poll + i, handle_rx_net, POLLIN,
+					n->vqs + i);
+		n->tx_poll_state[i] = VHOST_NET_POLL_DISABLED;
+	}
 
 	f->private_data = n;
 
@@ -522,29 +589,32 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 static void vhost_net_disable_vq(struct vhost_net *n,
 				 struct vhost_virtqueue *vq)
 {
+	int index = vq - n->vqs;
+
 	if (!vq->private_data)
 		return;
-	if (vq == n->vqs + VHOST_NET_VQ_TX) {
-		tx_poll_stop(n);
-		n->tx_poll_state = VHOST_NET_POLL_DISABLED;
+	if (vhost_net_vq_is_tx(index)) {
+		tx_poll_stop(n, vq);
+		n->tx_poll_state[index] = VHOST_NET_POLL_DISABLED;
 	} else
-		vhost_poll_stop(n->poll + VHOST_NET_VQ_RX);
+		vhost_poll_stop(n->poll + index);
 }
 
 static void vhost_net_enable_vq(struct vhost_net *n,
 				struct vhost_virtqueue *vq)
 {
+	int index = vq - n->vqs;
 	struct socket *sock;
 
 	sock = rcu_dereference_protected(vq->private_data,
 					 lockdep_is_held(&vq->mutex));
 	if (!sock)
 		return;
-	if (vq == n->vqs + VHOST_NET_VQ_TX) {
-		n->tx_poll_state = VHOST_NET_POLL_STOPPED;
-		tx_poll_start(n, sock);
+	if (vhost_net_vq_is_tx(index)) {
+		n->tx_poll_state[index] = VHOST_NET_POLL_STOPPED;
+		tx_poll_start(n, vq, sock);
 	} else
-		vhost_poll_start(n->poll + VHOST_NET_VQ_RX, sock->file);
+		vhost_poll_start(n->poll + index, sock->file);
 }
 
 static struct socket *vhost_net_stop_vq(struct vhost_net *n,
@@ -561,11 +631,21 @@ static struct socket *vhost_net_stop_vq(struct vhost_net *n,
 	return sock;
 }
 
-static void vhost_net_stop(struct vhost_net *n, struct socket **tx_sock,
-			   struct socket **rx_sock)
+static void vhost_net_stop(struct vhost_net *n, struct socket **socks)
 {
-	*tx_sock = vhost_net_stop_vq(n, n->vqs + VHOST_NET_VQ_TX);
-	*rx_sock = vhost_net_stop_vq(n, n->vqs + VHOST_NET_VQ_RX);
+	int i;
+
+	for (i = 0; i < VHOST_NET_VQ_MAX; ++i)
+		socks[i] = vhost_net_stop_vq(n, n->vqs + i);
+}
+
+static void vhost_net_put_socks(struct socket **socks)
+{
+	int i;
+
+	for (i = 0; i < VHOST_NET_VQ_MAX; ++i)
+		if (socks[i])
+			fput(socks[i]->file);
 }
 
 static void vhost_net_flush_vq(struct vhost_net *n, int index)
@@ -576,27 +656,25 @@ static void vhost_net_flush_vq(struct vhost_net *n, int index)
 
 static void vhost_net_flush(struct vhost_net *n)
 {
-	vhost_net_flush_vq(n, VHOST_NET_VQ_TX);
-	vhost_net_flush_vq(n, VHOST_NET_VQ_RX);
+	int i;
+
+	for (i = 0; i < VHOST_NET_VQ_MAX; ++i)
+		vhost_net_flush_vq(n, i);
 }
 
 static int vhost_net_release(struct inode *inode, struct file *f)
 {
 	struct vhost_net *n = f->private_data;
-	struct socket *tx_sock;
-	struct socket *rx_sock;
+	struct socket *socks[VHOST_NET_VQ_MAX];
 
-	vhost_net_stop(n, &tx_sock, &rx_sock);
+	vhost_net_stop(n, socks);
 	vhost_net_flush(n);
 	vhost_dev_cleanup(&n->dev);
-	if (tx_sock)
-		fput(tx_sock->file);
-	if (rx_sock)
-		fput(rx_sock->file);
+	vhost_net_put_socks(socks);
 	/* We do an extra flush before freeing memory,
 	 * since jobs can re-queue themselves. */
 	vhost_net_flush(n);
-	kfree(n);
+	vhost_net_free(n);
 	return 0;
 }
 
@@ -682,6 +760,12 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 		goto err;
 	}
 	vq = n->vqs + index;
+
+	/* The pair may have had no ring ioctl that would start its worker */
+	r = vhost_vq_worker_start(&n->dev, vq);
+	if (r)
+		goto err;
+
 	mutex_lock(&vq->mutex);
 
 	/* Verify that ring has been setup correctly. */
@@ -743,23 +827,19 @@ err:
 
 static long vhost_net_reset_owner(struct vhost_net *n)
 {
-	struct socket *tx_sock = NULL;
-	struct socket *rx_sock = NULL;
+	struct socket *socks[VHOST_NET_VQ_MAX] = { NULL };
 	long err;
 
 	mutex_lock(&n->dev.mutex);
 	err = vhost_dev_check_owner(&n->dev);
 	if (err)
 		goto done;
-	vhost_net_stop(n, &tx_sock, &rx_sock);
+	vhost_net_stop(n, socks);
 	vhost_net_flush(n);
 	err = vhost_dev_reset_owner(&n->dev);
 done:
 	mutex_unlock(&n->dev.mutex);
-	if (tx_sock)
-		fput(tx_sock->file);
-	if (rx_sock)
-		fput(rx_sock->file);
+	vhost_net_put_socks(socks);
 	return err;
 }
 
@@ -863,8 +943,12 @@ static struct miscdevice vhost_net_misc = {
 
 static int vhost_net_init(void)
 {
+	int i;
+
 	if (experimental_zcopytx)
-		vhost_enable_zcopy(VHOST_NET_VQ_TX);
+		for (i = VHOST_NET_VQ_TX; i < VHOST_NET_VQ_MAX;
+		     i += VHOST_NET_VQ_PAIR)
+			vhost_enable_zcopy(i);
 	return misc_register(&vhost_net_misc);
 }
 module_init(vhost_net_init);
@@ -73,14 +73,15 @@ static void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn)
 	work->queue_seq = work->done_seq = 0;
 }
 
-/* Init poll structure */
+/* Init poll structure. The work runs on the worker of virtqueue vq. */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev)
+		     unsigned long mask, struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
-	poll->dev = dev;
+	poll->dev = vq->dev;
+	poll->worker = vq->worker;
 
 	vhost_work_init(&poll->work, fn);
 }
@@ -103,30 +104,36 @@ void vhost_poll_stop(struct vhost_poll *poll)
 	remove_wait_queue(poll->wqh, &poll->wait);
 }
 
-static bool vhost_work_seq_done(struct vhost_dev *dev, struct vhost_work *work,
-				unsigned seq)
+static bool vhost_work_seq_done(struct vhost_worker *worker,
+				struct vhost_work *work, unsigned seq)
 {
 	int left;
 
-	spin_lock_irq(&dev->work_lock);
+	spin_lock_irq(&worker->work_lock);
 	left = seq - work->done_seq;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	return left <= 0;
 }
 
-static void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+static void vhost_work_flush(struct vhost_worker *worker,
+			     struct vhost_work *work)
 {
 	unsigned seq;
 	int flushing;
 
-	spin_lock_irq(&dev->work_lock);
+	spin_lock_irq(&worker->work_lock);
+	/* Nothing runs on a worker that was never started */
+	if (!worker->task) {
+		spin_unlock_irq(&worker->work_lock);
+		return;
+	}
 	seq = work->queue_seq;
 	work->flushing++;
-	spin_unlock_irq(&dev->work_lock);
-	wait_event(work->done, vhost_work_seq_done(dev, work, seq));
-	spin_lock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
+	wait_event(work->done, vhost_work_seq_done(worker, work, seq));
+	spin_lock_irq(&worker->work_lock);
 	flushing = --work->flushing;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	BUG_ON(flushing < 0);
 }
 
@@ -134,26 +141,28 @@ static void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
  * locks that are also used by the callback. */
 void vhost_poll_flush(struct vhost_poll *poll)
 {
-	vhost_work_flush(poll->dev, &poll->work);
+	vhost_work_flush(poll->worker, &poll->work);
 }
 
-static inline void vhost_work_queue(struct vhost_dev *dev,
+static inline void vhost_work_queue(struct vhost_worker *worker,
 				    struct vhost_work *work)
 {
 	unsigned long flags;
 
-	spin_lock_irqsave(&dev->work_lock, flags);
+	spin_lock_irqsave(&worker->work_lock, flags);
 	if (list_empty(&work->node)) {
-		list_add_tail(&work->node, &dev->work_list);
+		list_add_tail(&work->node, &worker->work_list);
 		work->queue_seq++;
-		wake_up_process(dev->worker);
+		/* Not started yet: the work runs once it is. */
+		if (worker->task)
+			wake_up_process(worker->task);
 	}
-	spin_unlock_irqrestore(&dev->work_lock, flags);
+	spin_unlock_irqrestore(&worker->work_lock, flags);
 }
 
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	vhost_work_queue(poll->worker, &poll->work);
 }
 
 static void vhost_vq_reset(struct vhost_dev *dev,
@@ -188,7 +197,8 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work = NULL;
 	unsigned uninitialized_var(seq);
 
@@ -198,7 +208,7 @@ static int vhost_worker(void *data)
 		/* mb paired w/ kthread_stop */
 		set_current_state(TASK_INTERRUPTIBLE);
 
-		spin_lock_irq(&dev->work_lock);
+		spin_lock_irq(&worker->work_lock);
 		if (work) {
 			work->done_seq = seq;
 			if (work->flushing)
@@ -206,18 +216,18 @@ static int vhost_worker(void *data)
 		}
 
 		if (kthread_should_stop()) {
-			spin_unlock_irq(&dev->work_lock);
+			spin_unlock_irq(&worker->work_lock);
 			__set_current_state(TASK_RUNNING);
 			break;
 		}
-		if (!list_empty(&dev->work_list)) {
-			work = list_first_entry(&dev->work_list,
+		if (!list_empty(&worker->work_list)) {
+			work = list_first_entry(&worker->work_list,
 						struct vhost_work, node);
 			list_del_init(&work->node);
 			seq = work->queue_seq;
 		} else
 			work = NULL;
-		spin_unlock_irq(&dev->work_lock);
+		spin_unlock_irq(&worker->work_lock);
 
 		if (work) {
 			__set_current_state(TASK_RUNNING);
@@ -249,13 +259,16 @@ void vhost_enable_zcopy(int vq)
 	vhost_zcopy_mask |= 0x1 << vq;
 }
 
-/* Helper to allocate iovec buffers for all vqs. */
-static long vhost_dev_alloc_iovecs(struct vhost_dev *dev)
+/* Helper to allocate iovec buffers for all vqs served by a worker. */
+static long vhost_worker_alloc_iovecs(struct vhost_dev *dev,
+				      struct vhost_worker *worker)
 {
 	int i;
 	bool zcopy;
 
 	for (i = 0; i < dev->nvqs; ++i) {
+		if (dev->vqs[i].worker != worker)
+			continue;
 		dev->vqs[i].indirect = kmalloc(sizeof *dev->vqs[i].indirect *
 					       UIO_MAXIOV, GFP_KERNEL);
 		dev->vqs[i].log = kmalloc(sizeof *dev->vqs[i].log * UIO_MAXIOV,
@@ -276,7 +289,8 @@ static long vhost_dev_alloc_iovecs(struct vhost_dev *dev)
 
 err_nomem:
 	for (; i >= 0; --i)
-		vhost_vq_free_iovecs(&dev->vqs[i]);
+		if (dev->vqs[i].worker == worker)
+			vhost_vq_free_iovecs(&dev->vqs[i]);
 	return -ENOMEM;
 }
 
@@ -288,11 +302,16 @@ static void vhost_dev_free_iovecs(struct vhost_dev *dev)
 		vhost_vq_free_iovecs(&dev->vqs[i]);
 }
 
+/* The virtqueues are spread in order over nworkers workers: with two
+ * workers, the first half of the vqs runs on one and the rest on the other. */
 long vhost_dev_init(struct vhost_dev *dev,
-		    struct vhost_virtqueue *vqs, int nvqs)
+		    struct vhost_virtqueue *vqs, int nvqs, int nworkers)
 {
 	int i;
 
+	if (nworkers < 1 || nworkers > VHOST_MAX_WORKERS || nworkers > nvqs)
+		return -EINVAL;
+
 	dev->vqs = vqs;
 	dev->nvqs = nvqs;
 	mutex_init(&dev->mutex);
@@ -300,9 +319,14 @@ long vhost_dev_init(struct vhost_dev *dev,
 	dev->log_file = NULL;
 	dev->memory = NULL;
 	dev->mm = NULL;
-	spin_lock_init(&dev->work_lock);
-	INIT_LIST_HEAD(&dev->work_list);
-	dev->worker = NULL;
+	dev->nworkers = nworkers;
+
+	for (i = 0; i < nworkers; ++i) {
+		spin_lock_init(&dev->workers[i].work_lock);
+		INIT_LIST_HEAD(&dev->workers[i].work_list);
+		dev->workers[i].task = NULL;
+		dev->workers[i].dev = dev;
+	}
 
 	for (i = 0; i < dev->nvqs; ++i) {
 		dev->vqs[i].log = NULL;
@@ -310,11 +334,13 @@ long vhost_dev_init(struct vhost_dev *dev,
 		dev->vqs[i].heads = NULL;
 		dev->vqs[i].ubuf_info = NULL;
 		dev->vqs[i].dev = dev;
+		dev->vqs[i].worker = dev->workers + i * nworkers / nvqs;
 		mutex_init(&dev->vqs[i].mutex);
 		vhost_vq_reset(dev, dev->vqs + i);
 		if (dev->vqs[i].handle_kick)
 			vhost_poll_init(&dev->vqs[i].poll,
-					dev->vqs[i].handle_kick, POLLIN, dev);
+					dev->vqs[i].handle_kick, POLLIN,
+					dev->vqs + i);
 	}
 
 	return 0;
@@ -341,21 +367,67 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 	s->ret = cgroup_attach_task_all(s->owner, current);
 }
 
-static int vhost_attach_cgroups(struct vhost_dev *dev)
+static int vhost_attach_cgroups(struct vhost_worker *worker)
 {
 	struct vhost_attach_cgroups_struct attach;
 
 	attach.owner = current;
 	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
+	vhost_work_queue(worker, &attach.work);
+	vhost_work_flush(worker, &attach.work);
 	return attach.ret;
 }
 
+/* Start the thread of a worker, unless it is running already, and set up
+ * the virtqueues it serves. The first worker is named after the owner like
+ * a single threaded device, the others get their index appended.
+ * Caller should have device mutex and be the owner. */
+static long vhost_worker_start(struct vhost_dev *dev,
+			       struct vhost_worker *worker)
+{
+	int id = worker - dev->workers;
+	struct task_struct *task;
+	int err;
+
+	if (worker->task)
+		return 0;
+
+	if (id)
+		task = kthread_create(vhost_worker, worker, "vhost-%d-%d",
+				      current->pid, id);
+	else
+		task = kthread_create(vhost_worker, worker, "vhost-%d",
+				      current->pid);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	worker->task = task;
+	wake_up_process(task);	/* avoid contributing to loadavg */
+
+	err = vhost_attach_cgroups(worker);
+	if (err)
+		goto err_cgroup;
+
+	err = vhost_worker_alloc_iovecs(dev, worker);
+	if (err)
+		goto err_cgroup;
+
+	return 0;
+err_cgroup:
+	kthread_stop(task);
+	worker->task = NULL;
+	return err;
+}
+
+/* Start the worker serving vq, see vhost_worker_start(). */
+long vhost_vq_worker_start(struct vhost_dev *dev, struct vhost_virtqueue *vq)
+{
+	return vhost_worker_start(dev, vq->worker);
+}
+
 /* Caller should have device mutex */
 static long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
 	int err;
 
 	/* Is there an owner already? */
@@ -364,29 +436,14 @@ static long vhost_dev_set_owner(struct vhost_dev *dev)
 		goto err_mm;
 	}
 
-	/* No owner, become one */
+	/* No owner, become one. Further workers start as their
+	 * virtqueues are set up. */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
-	if (IS_ERR(worker)) {
-		err = PTR_ERR(worker);
-		goto err_worker;
-	}
-
-	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
-
-	err = vhost_attach_cgroups(dev);
-	if (err)
-		goto err_cgroup;
-
-	err = vhost_dev_alloc_iovecs(dev);
+	err = vhost_worker_start(dev, dev->workers);
 	if (err)
-		goto err_cgroup;
+		goto err_worker;
 
 	return 0;
-err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -476,10 +533,14 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 	kfree(rcu_dereference_protected(dev->memory,
 					lockdep_is_held(&dev->mutex)));
 	RCU_INIT_POINTER(dev->memory, NULL);
-	WARN_ON(!list_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
+	for (i = 0; i < dev->nworkers; ++i) {
+		struct vhost_worker *worker = dev->workers + i;
+
+		WARN_ON(!list_empty(&worker->work_list));
+		if (worker->task) {
+			kthread_stop(worker->task);
+			worker->task = NULL;
+		}
 	}
 	if (dev->mm)
 		mmput(dev->mm);
@@ -652,6 +713,10 @@ static long vhost_set_vring(struct vhost_dev *d, int ioctl, void __user *argp)
 
 	vq = d->vqs + idx;
 
+	r = vhost_worker_start(d, vq->worker);
+	if (r)
+		return r;
+
 	mutex_lock(&vq->mutex);
 
 	switch (ioctl) {
@@ -697,6 +762,22 @@ static long vhost_set_vring(struct vhost_dev *d, int ioctl, void __user *argp)
 		if (copy_to_user(argp, &s, sizeof s))
 			r = -EFAULT;
 		break;
+	case VHOST_SET_VRING_CPU:
+		if (copy_from_user(&s, argp, sizeof s)) {
+			r = -EFAULT;
+			break;
+		}
+		if (s.num == ~0U) {
+			r = set_cpus_allowed_ptr(vq->worker->task,
+						 cpu_all_mask);
+			break;
+		}
+		if (s.num >= nr_cpu_ids || !cpu_online(s.num)) {
+			r = -EINVAL;
+			break;
+		}
+		r = set_cpus_allowed_ptr(vq->worker->task, cpumask_of(s.num));
+		break;
 	case VHOST_SET_VRING_ADDR:
 		if (copy_from_user(&a, argp, sizeof a)) {
 			r = -EFAULT;
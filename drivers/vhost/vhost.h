@@ -19,6 +19,7 @@
 #define VHOST_DMA_CLEAR_LEN	0
 
 struct vhost_device;
+struct vhost_virtqueue;
 
 struct vhost_work;
 typedef void (*vhost_work_fn_t)(struct vhost_work *work);
@@ -32,6 +33,17 @@ struct vhost_work {
 	unsigned		  done_seq;
 };
 
+/* A thread running the work of a group of virtqueues. The thread is
+ * created on first use of one of them, in the context of the owner. */
+struct vhost_worker {
+	spinlock_t		  work_lock;
+	struct list_head	  work_list;
+	struct task_struct	 *task;
+	struct vhost_dev	 *dev;
+};
+
+#define VHOST_MAX_WORKERS	8
+
 /* Poll a file (eventfd or socket) */
 /* Note: there's nothing vhost specific about this structure. */
 struct vhost_poll {
@@ -41,10 +53,11 @@ struct vhost_poll {
 	struct vhost_work	  work;
 	unsigned long		  mask;
 	struct vhost_dev	 *dev;
+	struct vhost_worker	 *worker;
 };
 
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     unsigned long mask, struct vhost_dev *dev);
+		     unsigned long mask, struct vhost_virtqueue *vq);
 void vhost_poll_start(struct vhost_poll *poll, struct file *file);
 void vhost_poll_stop(struct vhost_poll *poll);
 void vhost_poll_flush(struct vhost_poll *poll);
@@ -55,8 +68,6 @@ struct vhost_log {
 	u64 len;
 };
 
-struct vhost_virtqueue;
-
 struct vhost_ubuf_ref {
 	struct kref kref;
 	wait_queue_head_t wait;
@@ -70,6 +81,7 @@ void vhost_ubuf_put_and_wait(struct vhost_ubuf_ref *);
 /* The virtqueue structure describes a queue attached to a device. */
 struct vhost_virtqueue {
 	struct vhost_dev *dev;
+	struct vhost_worker *worker;
 
 	/* The actual ring of buffers. */
 	struct mutex mutex;
@@ -155,13 +167,14 @@ struct vhost_dev {
 	int nvqs;
 	struct file *log_file;
 	struct eventfd_ctx *log_ctx;
-	spinlock_t work_lock;
-	struct list_head work_list;
-	struct task_struct *worker;
+	struct vhost_worker workers[VHOST_MAX_WORKERS];
+	int nworkers;
 };
 
-long vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue *vqs, int nvqs);
+long vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue *vqs, int nvqs,
+		    int nworkers);
 long vhost_dev_check_owner(struct vhost_dev *);
+long vhost_vq_worker_start(struct vhost_dev *, struct vhost_virtqueue *);
 long vhost_dev_reset_owner(struct vhost_dev *);
 void vhost_dev_cleanup(struct vhost_dev *);
 long vhost_dev_ioctl(struct vhost_dev *, unsigned int ioctl, unsigned long arg);
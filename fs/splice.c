@@ -712,6 +712,58 @@ static int pipe_to_sendpage(struct pipe_inode_info *pipe,
 	return ret;
 }
 
+/*
+ * Try to insert the page of @buf into @mapping at @index instead of
+ * copying it. Only private pages qualify: not in any page cache, not on
+ * the LRU and not shared, which is what socket pages are once their skb
+ * has been consumed. Page cache and user pages are never stolen here, so
+ * a failed attempt costs their owner nothing.
+ *
+ * Swap backed mappings keep their own accounting and swap entries in the
+ * tree, so their pages are always copied.
+ */
+static int splice_move_page(struct pipe_inode_info *pipe,
+			    struct pipe_buffer *buf,
+			    struct address_space *mapping, pgoff_t index)
+{
+	struct page *page = buf->page;
+	void *entry;
+
+	if (page->mapping || PageLRU(page) || PageCompound(page) ||
+	    PageSlab(page))
+		return 1;
+
+	if (mapping_cap_swap_backed(mapping))
+		return 1;
+
+	/* Only move into an empty slot, not over some exceptional entry */
+	rcu_read_lock();
+	entry = radix_tree_lookup(&mapping->page_tree, index);
+	rcu_read_unlock();
+	if (entry)
+		return 1;
+
+	/* returns with the page locked */
+	if (buf->ops->steal(pipe, buf))
+		return 1;
+
+	if (add_to_page_cache_locked(page, mapping, index,
+				     mapping_gfp_mask(mapping) & GFP_KERNEL)) {
+		unlock_page(page);
+		return 1;
+	}
+	lru_cache_add_file(page);
+
+	/*
+	 * The page holds all of the new data, so ->write_begin() must not
+	 * read it back from disk when it finds it in the cache.
+	 */
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+	unlock_page(page);
+	return 0;
+}
+
 /*
  * This is a little more tricky than the file -> pipe splicing. There are
  * basically three cases:
@@ -740,6 +792,7 @@ int pipe_to_file(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 	unsigned int offset, this_len;
 	struct page *page;
 	void *fsdata;
+	bool moved = false;
 	int ret;
 
 	offset = sd->pos & ~PAGE_CACHE_MASK;
@@ -748,18 +801,35 @@ int pipe_to_file(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 	if (this_len + offset > PAGE_CACHE_SIZE)
 		this_len = PAGE_CACHE_SIZE - offset;
 
+	/* a whole, aligned page may go to the page cache as it is */
+	if ((sd->flags & SPLICE_F_MOVE) && !offset && !buf->offset &&
+	    this_len == PAGE_CACHE_SIZE)
+		moved = !splice_move_page(pipe, buf, mapping,
+					  sd->pos >> PAGE_CACHE_SHIFT);
+
 	ret = pagecache_write_begin(file, mapping, sd->pos, this_len,
 				AOP_FLAG_UNINTERRUPTIBLE, &page, &fsdata);
-	if (unlikely(ret))
+	if (unlikely(ret)) {
+		if (moved) {
+			/* don't leave data that never reached the fs cached */
+			lock_page(buf->page);
+			if (buf->page->mapping == mapping)
+				delete_from_page_cache(buf->page);
+			unlock_page(buf->page);
+		}
 		goto out;
+	}
 
-	if (buf->page != page) {
+	if (buf->page == page) {
+		count_vm_event(SPLICE_PGMOVED);
+	} else {
 		/*
 		 * Careful, ->map() uses KM_USER0!
 		 */
 		char *src = buf->ops->map(pipe, buf, 1);
 		char *dst = kmap_atomic(page, KM_USER1);
 
+		count_vm_event(SPLICE_PGCOPIED);
 		memcpy(dst + offset, src + buf->offset, this_len);
 		flush_dcache_page(page);
 		kunmap_atomic(dst, KM_USER1);
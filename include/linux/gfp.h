@@ -300,6 +300,20 @@ __alloc_pages(gfp_t gfp_mask, unsigned int order,
 	return __alloc_pages_nodemask(gfp_mask, order, zonelist, NULL);
 }
 
+unsigned long
+__alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+		   nodemask_t *nodemask, unsigned long nr_pages,
+		   struct page **pages);
+
+/* Order-0 pages from the local node, see __alloc_pages_bulk() */
+static inline unsigned long
+alloc_pages_bulk(gfp_t gfp_mask, unsigned long nr_pages, struct page **pages)
+{
+	return __alloc_pages_bulk(gfp_mask,
+			node_zonelist(numa_node_id(), gfp_mask), NULL,
+			nr_pages, pages);
+}
+
 static inline struct page *alloc_pages_node(int nid, gfp_t gfp_mask,
 						unsigned int order)
 {
@@ -0,0 +1,52 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ * LZ4 Kernel Interface
+ *
+ * Raw LZ4 blocks, as produced by LZ4_compress() and LZ4_compressHC() of
+ * the reference implementation at http://code.google.com/p/lz4/, without
+ * any frame or size header.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/types.h>
+
+#define LZ4_MEM_COMPRESS	(4096 * sizeof(u32))
+#define LZ4HC_MEM_COMPRESS	((1 << 15) * sizeof(u32) + (1 << 16) * sizeof(u16))
+
+/* Largest input accepted by the compressors */
+#define LZ4_MAX_INPUT_SIZE	0x7E000000
+
+/* Worst case output size, for data that does not compress at all */
+static inline size_t lz4_compressbound(size_t isize)
+{
+	return isize + (isize / 255) + 16;
+}
+
+/*
+ * Both compressors take the room available at dst in *dst_len and return
+ * the compressed size in it. They return 0 on success, -E2BIG if the
+ * output would not fit and -EINVAL if src_len is too large. Output that
+ * may need up to lz4_compressbound(src_len) bytes always fits.
+ */
+
+/* Fast compressor, requires 'wrkmem' of size LZ4_MEM_COMPRESS */
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/* Slower, better compressor, requires 'wrkmem' of size LZ4HC_MEM_COMPRESS */
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem);
+
+/*
+ * Safe decompression: never reads past src + src_len nor writes past
+ * dst + *dst_len, which returns the decompressed size. Returns 0 on
+ * success and -EINVAL for corrupt input or too small an output buffer.
+ */
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len);
+
+#endif
@@ -983,6 +983,48 @@ static inline int fixup_user_fault(struct task_struct *tsk,
 }
 #endif
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags,
+			unsigned long vm_flags);
+extern struct vm_area_struct *get_vma(struct mm_struct *mm,
+				      unsigned long addr);
+extern void put_vma(struct vm_area_struct *vma);
+
+/*
+ * Changes to a vma that speculative faults must not miss.  The count
+ * goes odd under page_table_lock, which the faults check it under.
+ */
+static inline void vma_write_begin(struct vm_area_struct *vma)
+{
+	spin_lock(&vma->vm_mm->page_table_lock);
+	write_seqcount_begin(&vma->vm_sequence);
+	spin_unlock(&vma->vm_mm->page_table_lock);
+}
+
+static inline void vma_write_end(struct vm_area_struct *vma)
+{
+	write_seqcount_end(&vma->vm_sequence);
+}
+
+/* For a vma copied from another one */
+static inline void vma_spf_init(struct vm_area_struct *vma)
+{
+	seqcount_init(&vma->vm_sequence);
+	atomic_set(&vma->vm_ref_count, 0);
+}
+#else
+static inline int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags,
+			unsigned long vm_flags)
+{
+	return VM_FAULT_RETRY;
+}
+static inline void vma_write_begin(struct vm_area_struct *vma) {}
+static inline void vma_write_end(struct vm_area_struct *vma) {}
+static inline void vma_spf_init(struct vm_area_struct *vma) {}
+#endif
+
 extern int make_pages_present(unsigned long addr, unsigned long end);
 extern int access_process_vm(struct task_struct *tsk, unsigned long addr, void *buf, int len, int write);
 extern int access_remote_vm(struct mm_struct *mm, unsigned long addr,
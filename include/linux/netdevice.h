@@ -1045,12 +1045,13 @@ struct net_device {
 #define NETIF_F_TSO_ECN		(SKB_GSO_TCP_ECN << NETIF_F_GSO_SHIFT)
 #define NETIF_F_TSO6		(SKB_GSO_TCPV6 << NETIF_F_GSO_SHIFT)
 #define NETIF_F_FSO		(SKB_GSO_FCOE << NETIF_F_GSO_SHIFT)
+#define NETIF_F_GSO_UDP_L4	(SKB_GSO_UDP_L4 << NETIF_F_GSO_SHIFT)
 
 	/* Features valid for ethtool to change */
 	/* = all defined minus driver/device-class-related */
 #define NETIF_F_NEVER_CHANGE	(NETIF_F_VLAN_CHALLENGED | \
 				  NETIF_F_LLTX | NETIF_F_NETNS_LOCAL)
-#define NETIF_F_ETHTOOL_BITS	(0xff3fffff & ~NETIF_F_NEVER_CHANGE)
+#define NETIF_F_ETHTOOL_BITS	(0xff7fffff & ~NETIF_F_NEVER_CHANGE)
 
 	/* List of features with software fallbacks. */
 #define NETIF_F_GSO_SOFTWARE	(NETIF_F_TSO | NETIF_F_TSO_ECN | \
@@ -1741,6 +1742,14 @@ struct softnet_data {
 	unsigned int		time_squeeze;
 	unsigned int		cpu_collision;
 	unsigned int		received_rps;
+	unsigned int		recycle_hit;
+	unsigned int		recycle_miss;
+	unsigned int		recycle_put;
+	unsigned int		recycle_full;
+
+	/* Clean receive buffers by size class, linked through skb->next */
+	struct sk_buff		*recycle_list[SKB_RECYCLE_CLASSES];
+	unsigned int		recycle_count[SKB_RECYCLE_CLASSES];
 
 #ifdef CONFIG_RPS
 	struct softnet_data	*rps_ipi_list;
@@ -1757,6 +1766,8 @@ struct softnet_data {
 	struct napi_struct	backlog;
 };
 
+extern void skb_recycle_flush(struct softnet_data *sd);
+
 static inline void input_queue_head_incr(struct softnet_data *sd)
 {
 #ifdef CONFIG_RPS
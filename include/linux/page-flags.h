@@ -123,6 +123,9 @@ enum pageflags {
 	PG_pinned = PG_owner_priv_1,
 	PG_savepinned = PG_dirty,
 
+	/* Anonymous memory given up with MADV_FREE, droppable while clean */
+	PG_lazyfree = PG_owner_priv_1,
+
 	/* SLOB */
 	PG_slob_free = PG_private,
 };
@@ -205,6 +208,7 @@ __PAGEFLAG(Slab, slab)
 PAGEFLAG(Checked, checked)		/* Used by some filesystems */
 PAGEFLAG(Pinned, pinned) TESTSCFLAG(Pinned, pinned)	/* Xen */
 PAGEFLAG(SavePinned, savepinned);			/* Xen */
+PAGEFLAG(LazyFree, lazyfree) TESTCLEARFLAG(LazyFree, lazyfree)
 PAGEFLAG(Reserved, reserved) __CLEARPAGEFLAG(Reserved, reserved)
 PAGEFLAG(SwapBacked, swapbacked) __CLEARPAGEFLAG(SwapBacked, swapbacked)
 
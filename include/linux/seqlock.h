@@ -149,6 +149,22 @@ repeat:
 	return ret;
 }
 
+/**
+ * raw_read_seqcount - read the seqcount without waiting for writers
+ * @s: pointer to seqcount_t
+ * Returns: count to be passed to read_seqcount_retry
+ *
+ * Unlike read_seqcount_begin, this does not spin while a write is in
+ * progress but returns the odd count, for readers that would rather
+ * give up than wait.
+ */
+static inline unsigned raw_read_seqcount(const seqcount_t *s)
+{
+	unsigned ret = ACCESS_ONCE(s->sequence);
+	smp_rmb();
+	return ret;
+}
+
 /**
  * read_seqcount_begin - begin a seq-read critical section
  * @s: pointer to seqcount_t
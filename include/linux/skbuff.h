@@ -293,6 +293,9 @@ enum {
 	SKB_GSO_TCPV6 = 1 << 4,
 
 	SKB_GSO_FCOE = 1 << 5,
+
+	/* UDP datagrams of gso_size payload each, not IP fragments. */
+	SKB_GSO_UDP_L4 = 1 << 6,
 };
 
 #if BITS_PER_LONG > 32
@@ -353,6 +356,8 @@ typedef unsigned char *sk_buff_data_t;
  *	@ooo_okay: allow the mapping of a socket to a queue to be changed
  *	@l4_rxhash: indicate rxhash is a canonical 4-tuple hash over transport
  *		ports.
+ *	@recycle_class: size class of the per-cpu recycle cache the buffer
+ *		goes back to when freed, 0 for none
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
  *	@secmark: security marking
@@ -450,9 +455,10 @@ struct sk_buff {
 #endif
 	__u8			ooo_okay:1;
 	__u8			l4_rxhash:1;
+	__u8			recycle_class:2;
 	kmemcheck_bitfield_end(flags2);
 
-	/* 0/13 bit hole */
+	/* 0/11 bit hole */
 
 #ifdef CONFIG_NET_DMA
 	dma_cookie_t		dma_cookie;
@@ -561,6 +567,10 @@ static inline struct sk_buff *alloc_skb_fclone(unsigned int size,
 extern void skb_recycle(struct sk_buff *skb);
 extern bool skb_recycle_check(struct sk_buff *skb, int skb_size);
 
+/* Size classes of the per-cpu recycle cache, see __netdev_alloc_skb() */
+#define SKB_RECYCLE_CLASSES	3
+extern int sysctl_skb_recycle_max;
+
 extern struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src);
 extern int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask);
 extern struct sk_buff *skb_clone(struct sk_buff *skb,
@@ -268,6 +268,7 @@ struct ucred {
 #define MSG_SENDPAGE_NOTLAST 0x20000 /* sendpage() internal : not the last page */
 #define MSG_KERNSPACE   0x80000
 #define MSG_NOCATCHSIG	0x40000
+#define MSG_FASTOPEN	0x20000000	/* Send data in TCP SYN */
 
 #define MSG_EOF         MSG_FIN
 
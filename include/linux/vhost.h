@@ -102,6 +102,9 @@ struct vhost_memory {
 #define VHOST_SET_VRING_BASE _IOW(VHOST_VIRTIO, 0x12, struct vhost_vring_state)
 /* Get accessor: reads index, writes value in num */
 #define VHOST_GET_VRING_BASE _IOWR(VHOST_VIRTIO, 0x12, struct vhost_vring_state)
+/* Bind the thread serving the ring to cpu num, or let it run anywhere if num
+ * is ~0U. Rings served by the same thread share its binding. */
+#define VHOST_SET_VRING_CPU _IOW(VHOST_VIRTIO, 0x18, struct vhost_vring_state)
 
 /* The following ioctls use eventfd file descriptors to signal and poll
  * for events. */
@@ -118,7 +121,10 @@ struct vhost_memory {
 /* Attach virtio net ring to a raw socket, or tap device.
  * The socket must be already bound to an ethernet device, this device will be
  * used for transmit.  Pass fd -1 to unbind from the socket and the transmit
- * device.  This can be used to stop the ring (e.g. for migration). */
+ * device.  This can be used to stop the ring (e.g. for migration).
+ * Rings come in pairs, one per queue of a multiqueue device: ring 2n
+ * receives and ring 2n + 1 transmits for queue n, and each pair is served by
+ * a thread of its own. */
 #define VHOST_NET_SET_BACKEND _IOW(VHOST_VIRTIO, 0x30, struct vhost_vring_file)
 
 /* Feature bits */
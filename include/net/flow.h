@@ -218,6 +218,8 @@ extern struct flow_cache_object *flow_cache_lookup(
 
 extern void flow_cache_flush(void);
 extern void flow_cache_flush_deferred(void);
+extern unsigned int flow_cache_hash_shift(void);
+extern int flow_cache_resize(unsigned int shift);
 extern atomic_t flow_cache_genid;
 
 #endif
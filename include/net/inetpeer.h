@@ -41,6 +41,12 @@ struct inet_peer {
 	u32			pmtu_orig;
 	u32			pmtu_learned;
 	struct inetpeer_addr_base redirect_learned;
+	/* TCP Fast Open client state, see net/ipv4/tcp_fastopen.c */
+	u16			tcp_fastopen_mss;
+	u16			tcp_fastopen_syn_loss;
+	unsigned long		tcp_fastopen_last_syn_loss;
+	s8			tcp_fastopen_cookie_len;
+	u8			tcp_fastopen_cookie[16];
 	/*
 	 * Once inet_peer is queued for deletion (refcnt == -1), following fields
 	 * are not available: rid, ip_id_count, tcp_ts, tcp_ts_stamp
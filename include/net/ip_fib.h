@@ -44,6 +44,7 @@ struct fib_config {
  };
 
 struct fib_info;
+struct rtable;
 
 struct fib_nh {
 	struct net_device	*nh_dev;
@@ -62,6 +63,8 @@ struct fib_nh {
 	__be32			nh_gw;
 	__be32			nh_saddr;
 	int			nh_saddr_genid;
+	/* Forwarding routes, see net.ipv4.route.forward_nocache */
+	struct rtable __rcu * __percpu *nh_pcpu_rth_input;
 };
 
 /*
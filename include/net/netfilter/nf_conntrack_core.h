@@ -76,4 +76,13 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
 
 extern spinlock_t nf_conntrack_lock ;
 
+/* Stripes of locks protecting the conntrack hash chains; bucket b is
+ * guarded by nf_conntrack_locks[b % CONNTRACK_LOCKS]. When both are needed,
+ * nf_conntrack_lock is taken first. Callers not holding nf_conntrack_lock
+ * must use nf_conntrack_bucket_lock(), which waits out a table resize.
+ */
+#define CONNTRACK_LOCKS 1024
+extern spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
+extern void nf_conntrack_bucket_lock(spinlock_t *lock);
+
 #endif /* _NF_CONNTRACK_CORE_H */
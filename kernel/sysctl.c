@@ -263,6 +263,7 @@ static int max_sched_tunable_scaling = SCHED_TUNABLESCALING_END-1;
 #ifdef CONFIG_COMPACTION
 static int min_extfrag_threshold;
 static int max_extfrag_threshold = 1000;
+static int max_kcompactd_order = MAX_ORDER - 1;
 #endif
 
 static struct ctl_table kern_table[] = {
@@ -1189,6 +1190,23 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &min_extfrag_threshold,
 		.extra2		= &max_extfrag_threshold,
 	},
+	{
+		.procname	= "kcompactd_order",
+		.data		= &sysctl_kcompactd_order,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_kcompactd_handler,
+		.extra1		= &zero,
+		.extra2		= &max_kcompactd_order,
+	},
+	{
+		.procname	= "kcompactd_interval",
+		.data		= &sysctl_kcompactd_interval,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_kcompactd_handler,
+		.extra1		= &zero,
+	},
 
 #endif /* CONFIG_COMPACTION */
 	{
@@ -0,0 +1,116 @@
+/*
+ * LZ4 - Fast LZ compression algorithm
+ *
+ * Compatible with the block format of the reference implementation by
+ * Yann Collet, http://code.google.com/p/lz4/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+#define HASH_LOG	12
+/*
+ * Where nothing matches, the search steps over more and more bytes, one
+ * more every 1 << SKIP_STRENGTH attempts, to go through incompressible
+ * data quickly.
+ */
+#define SKIP_STRENGTH	6
+
+/*
+ * Hashing 5 bytes instead of 4 keeps sequences that would only give the
+ * shortest matches out of the way of better ones, where it is cheap.
+ */
+static inline u32 lz4_hash(const u8 *p)
+{
+#if BITS_PER_LONG == 64
+	u64 seq = get_unaligned((const u64 *)p);
+
+#ifdef __LITTLE_ENDIAN
+	return ((seq << 24) * 889523592379ULL) >> (64 - HASH_LOG);
+#else
+	return ((seq >> 24) * 11400714785074694791ULL) >> (64 - HASH_LOG);
+#endif
+#else
+	return (lz4_read32(p) * 2654435761U) >> (32 - HASH_LOG);
+#endif
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	const u8 *ip = src, *anchor = src, *ref;
+	u8 *op = dst, * const oend = dst + *dst_len;
+	/* Positions relative to src of the last sequence seen per hash */
+	u32 *table = wrkmem;
+	unsigned int attempts;
+	size_t len;
+	u32 seq, h;
+
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return -EINVAL;
+	if (src_len < MIN_LENGTH)
+		goto last_literals;
+
+	/* Stale entries would still be correct, but not reproducible */
+	memset(table, 0, LZ4_MEM_COMPRESS);
+	ip++;
+
+	for (;;) {
+		/* Find a match */
+		attempts = 1 << SKIP_STRENGTH;
+		for (;;) {
+			seq = lz4_read32(ip);
+			h = lz4_hash(ip);
+			ref = src + table[h];
+			table[h] = ip - src;
+			if (ip - ref <= MAX_DISTANCE && lz4_read32(ref) == seq)
+				break;
+
+			ip += attempts++ >> SKIP_STRENGTH;
+			if (unlikely(ip > mflimit))
+				goto last_literals;
+		}
+
+		/* Extend it backwards over the pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		len = MINMATCH + lz4_count(ip + MINMATCH, ref + MINMATCH,
+					   matchlimit);
+		op = lz4_encode_sequence(op, oend, anchor, ip, ip - ref, len);
+		if (!op)
+			return -E2BIG;
+
+		ip += len;
+		anchor = ip;
+		if (ip > mflimit)
+			break;
+
+		/* Index a position inside the match, it is cheap */
+		table[lz4_hash(ip - 2)] = ip - 2 - src;
+	}
+
+last_literals:
+	op = lz4_encode_sequence(op, oend, anchor, iend, 0, 0);
+	if (!op)
+		return -E2BIG;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 compressor");
@@ -0,0 +1,165 @@
+/*
+ * LZ4 Decompressor
+ *
+ * Compatible with the block format of the reference implementation by
+ * Yann Collet, http://code.google.com/p/lz4/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+/*
+ * Reads the extension bytes of a saturated length. Returns false if the
+ * input ends first or the length gets absurd.
+ */
+static inline bool lz4_read_length(const u8 **ipp, const u8 *iend,
+				size_t *length)
+{
+	const u8 *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return false;
+		s = *ip++;
+		*length += s;
+	} while (s == 255);
+
+	*ipp = ip;
+	return *length <= LZ4_MAX_INPUT_SIZE;
+}
+
+static inline void lz4_copy8(u8 *dst, const u8 *src)
+{
+	put_unaligned(get_unaligned((const u64 *)src), (u64 *)dst);
+}
+
+/*
+ * Copies a match of length bytes from offset bytes back. When source and
+ * destination are a word or more apart, whole words can be copied as
+ * each one only reads bytes written before. Closer matches repeat with
+ * a period of offset, so once a few bytes are done one by one they are
+ * copied from a multiple of offset back that is a word or more.
+ */
+static inline void lz4_copy_match(u8 *op, size_t offset, size_t length)
+{
+	const u8 *ref = op - offset;
+
+	if (offset < sizeof(u64)) {
+		size_t dist = offset * DIV_ROUND_UP(sizeof(u64), offset);
+		size_t n = min(length, dist);
+
+		length -= n;
+		while (n--)
+			*op++ = *ref++;
+		ref = op - dist;
+	}
+	for (; length >= sizeof(u64); length -= sizeof(u64)) {
+		lz4_copy8(op, ref);
+		op += sizeof(u64);
+		ref += sizeof(u64);
+	}
+	while (length--)
+		*op++ = *ref++;
+}
+
+/* Room needed around op and ip for the fast path below */
+#define FASTLOOP_IN	16
+#define FASTLOOP_OUT	(16 + 24)
+
+int lz4_decompress_safe(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len)
+{
+	const u8 *ip = src;
+	const u8 * const iend = src + src_len;
+	u8 *op = dst;
+	u8 * const oend = dst + *dst_len;
+	size_t length, offset;
+	unsigned int token;
+
+	if (unlikely(!src_len))
+		return -EINVAL;
+
+	for (;;) {
+		token = *ip++;
+		length = token >> ML_BITS;
+
+		/*
+		 * Most sequences have at most 14 literals and a match of at
+		 * most 18 bytes: away from the buffer ends, copy those with
+		 * a few fixed size word copies and skip the bound checks a
+		 * long sequence needs.
+		 */
+		if (length != RUN_MASK &&
+		    likely((size_t)(iend - ip) >= FASTLOOP_IN &&
+			   (size_t)(oend - op) >= FASTLOOP_OUT)) {
+			lz4_copy8(op, ip);
+			lz4_copy8(op + 8, ip + 8);
+			op += length;
+			ip += length;
+
+			offset = get_unaligned_le16(ip);
+			ip += 2;
+			length = token & ML_MASK;
+			if (length != ML_MASK && offset >= sizeof(u64) &&
+			    offset <= (size_t)(op - dst)) {
+				lz4_copy8(op, op - offset);
+				lz4_copy8(op + 8, op + 8 - offset);
+				lz4_copy8(op + 16, op + 16 - offset);
+				op += length + MINMATCH;
+				if (unlikely(ip >= iend))
+					return -EINVAL;
+				continue;
+			}
+			goto match;
+		}
+
+		/* Literals */
+		if (length == RUN_MASK && !lz4_read_length(&ip, iend, &length))
+			return -EINVAL;
+		if (unlikely(length > (size_t)(iend - ip) ||
+			     length > (size_t)(oend - op)))
+			return -EINVAL;
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+
+		/* Only the last sequence ends with its literals */
+		if (ip == iend)
+			break;
+
+		if (unlikely(iend - ip < 2))
+			return -EINVAL;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		length = token & ML_MASK;
+
+match:
+		if (unlikely(!offset || offset > (size_t)(op - dst)))
+			return -EINVAL;
+		if (length == ML_MASK && !lz4_read_length(&ip, iend, &length))
+			return -EINVAL;
+		length += MINMATCH;
+		if (unlikely(length > (size_t)(oend - op)))
+			return -EINVAL;
+		lz4_copy_match(op, offset, length);
+		op += length;
+
+		if (unlikely(ip >= iend))
+			return -EINVAL;
+	}
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
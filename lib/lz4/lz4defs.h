@@ -0,0 +1,130 @@
+/*
+ * lz4defs.h -- definitions shared by the LZ4 compressors and decompressor
+ *
+ * LZ4 block format: a block is a series of sequences, each made of a
+ * token byte, literal length extension bytes, the literals, a 2 byte
+ * little endian match offset and match length extension bytes. The high
+ * nibble of the token is the literal length, the low nibble the match
+ * length minus MINMATCH; a nibble of 15 is followed by bytes to add to
+ * it, up to and including the first byte that is not 255. The last
+ * sequence has literals only and no offset.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/bitops.h>
+#include <asm/unaligned.h>
+
+#define MINMATCH	4
+#define COPYLENGTH	8
+/* The last LASTLITERALS bytes of a block are always literals */
+#define LASTLITERALS	5
+/* and the last match starts at least MFLIMIT bytes before the end */
+#define MFLIMIT		(COPYLENGTH + MINMATCH)
+#define MIN_LENGTH	(MFLIMIT + 1)
+
+#define MAX_DISTANCE	65535
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+static inline u32 lz4_read32(const u8 *p)
+{
+	return get_unaligned((const u32 *)p);
+}
+
+/* Number of leading bytes that are equal, given a non zero XOR of words */
+static inline unsigned int lz4_nbcommonbytes(unsigned long diff)
+{
+#ifdef __LITTLE_ENDIAN
+	return __ffs(diff) >> 3;
+#else
+	return (BITS_PER_LONG - 1 - __fls(diff)) >> 3;
+#endif
+}
+
+/* Length of the common run at p and m, not reading at or past limit */
+static inline unsigned int lz4_count(const u8 *p, const u8 *m,
+				const u8 *limit)
+{
+	const u8 *start = p;
+
+	while (p + sizeof(unsigned long) <= limit) {
+		unsigned long diff = get_unaligned((const unsigned long *)p) ^
+				     get_unaligned((const unsigned long *)m);
+
+		if (diff)
+			return p - start + lz4_nbcommonbytes(diff);
+		p += sizeof(unsigned long);
+		m += sizeof(unsigned long);
+	}
+	while (p < limit && *p == *m) {
+		p++;
+		m++;
+	}
+
+	return p - start;
+}
+
+/* Extension bytes of a length whose nibble is saturated */
+static inline u8 *lz4_write_length(u8 *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+/* Room taken in the output by a sequence with length literals */
+static inline size_t lz4_seq_room(size_t length)
+{
+	return 1 + length + length / 255 + 1;
+}
+
+/*
+ * Emits the literals from anchor to ip and a match of match_len at
+ * offset. Returns the new output position or NULL if oend would be
+ * passed; match_len 0 emits the last, literals only, sequence.
+ */
+static inline u8 *lz4_encode_sequence(u8 *op, u8 *oend, const u8 *anchor,
+				const u8 *ip, unsigned int offset,
+				size_t match_len)
+{
+	size_t length = ip - anchor;
+	u8 *token;
+
+	if (lz4_seq_room(length) > (size_t)(oend - op))
+		return NULL;
+
+	token = op++;
+	if (length >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, length - RUN_MASK);
+	} else {
+		*token = length << ML_BITS;
+	}
+	memcpy(op, anchor, length);
+	op += length;
+
+	if (!match_len)
+		return op;
+
+	match_len -= MINMATCH;
+	if (2 + match_len / 255 + 1 > (size_t)(oend - op))
+		return NULL;
+	put_unaligned_le16(offset, op);
+	op += 2;
+	if (match_len >= ML_MASK) {
+		*token |= ML_MASK;
+		op = lz4_write_length(op, match_len - ML_MASK);
+	} else {
+		*token |= match_len;
+	}
+
+	return op;
+}
@@ -0,0 +1,163 @@
+/*
+ * LZ4 HC - High Compression Mode of LZ4
+ *
+ * Produces the same block format as lz4_compress(), decompressed just as
+ * fast, but searches harder: every position is indexed in hash chains
+ * covering the whole 64KB window, the longest of several candidates is
+ * taken, and a match is deferred by one byte when that finds a longer
+ * one.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+#define HC_HASH_LOG	15
+#define HC_MIN_HASH_LOG	10
+/* Candidates examined per position */
+#define MAX_ATTEMPTS	64
+
+/*
+ * The hash table holds 1 + the position of the latest sequence per hash,
+ * 0 if none. The chain table, indexed by position modulo 64K, holds the
+ * distance to the previous position with the same hash, 0 if none within
+ * the window. Entries of the window are never overwritten, so stale
+ * chain entries need no clearing.
+ */
+struct lz4hc_data {
+	const u8 *base;
+	u32 next_to_update;
+	unsigned int hash_log;
+	u32 *hash_table;
+	u16 *chain_table;
+};
+
+static inline u32 lz4hc_hash(const struct lz4hc_data *hc, const u8 *p)
+{
+	return (lz4_read32(p) * 2654435761U) >> (32 - hc->hash_log);
+}
+
+/* Indexes all positions up to, not including, ip */
+static inline void lz4hc_insert(struct lz4hc_data *hc, const u8 *ip)
+{
+	u32 target = ip - hc->base;
+	u32 pos, prev, delta;
+	u32 h;
+
+	for (pos = hc->next_to_update; pos < target; pos++) {
+		h = lz4hc_hash(hc, hc->base + pos);
+		prev = hc->hash_table[h];
+		delta = prev ? pos + 1 - prev : 0;
+		hc->chain_table[pos & MAX_DISTANCE] =
+			delta > MAX_DISTANCE ? 0 : delta;
+		hc->hash_table[h] = pos + 1;
+	}
+	hc->next_to_update = target;
+}
+
+/* Longest match for ip within the window, 0 if none of MINMATCH */
+static size_t lz4hc_find_match(struct lz4hc_data *hc, const u8 *ip,
+			const u8 *matchlimit, const u8 **match)
+{
+	u32 pos = ip - hc->base;
+	int attempts = MAX_ATTEMPTS;
+	u32 seq = lz4_read32(ip);
+	size_t best = 0, len;
+	const u8 *ref;
+	u16 delta;
+	u32 cand;
+
+	lz4hc_insert(hc, ip);
+	cand = hc->hash_table[lz4hc_hash(hc, ip)];
+
+	while (cand && attempts--) {
+		ref = hc->base + cand - 1;
+		if (pos - (cand - 1) > MAX_DISTANCE)
+			break;
+
+		/* A longer match must also differ from best at its end */
+		if ((!best || ref[best] == ip[best]) && lz4_read32(ref) == seq) {
+			len = MINMATCH + lz4_count(ip + MINMATCH,
+						   ref + MINMATCH, matchlimit);
+			if (len > best) {
+				best = len;
+				*match = ref;
+			}
+		}
+
+		delta = hc->chain_table[(cand - 1) & MAX_DISTANCE];
+		if (!delta)
+			break;
+		cand -= delta;
+	}
+
+	return best;
+}
+
+int lz4hc_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	const u8 * const iend = src + src_len;
+	const u8 * const mflimit = iend - MFLIMIT;
+	const u8 * const matchlimit = iend - LASTLITERALS;
+	const u8 *ip = src, *anchor = src, *ref = NULL, *ref2 = NULL;
+	u8 *op = dst, * const oend = dst + *dst_len;
+	struct lz4hc_data hc;
+	size_t len, len2;
+
+	if (src_len > LZ4_MAX_INPUT_SIZE)
+		return -EINVAL;
+	if (src_len < MIN_LENGTH)
+		goto last_literals;
+
+	/* Small inputs need fewer hash buckets, which are cleared per call */
+	hc.hash_log = clamp_t(unsigned int, fls(src_len) - 1,
+			      HC_MIN_HASH_LOG, HC_HASH_LOG);
+	hc.base = src;
+	hc.next_to_update = 0;
+	hc.hash_table = wrkmem;
+	hc.chain_table = wrkmem + (1 << HC_HASH_LOG) * sizeof(u32);
+	memset(hc.hash_table, 0, (1 << hc.hash_log) * sizeof(u32));
+
+	while (ip <= mflimit) {
+		len = lz4hc_find_match(&hc, ip, matchlimit, &ref);
+		if (!len) {
+			ip++;
+			continue;
+		}
+
+		/* Lazy evaluation: is the match one byte later longer? */
+		while (ip + 1 <= mflimit) {
+			len2 = lz4hc_find_match(&hc, ip + 1, matchlimit, &ref2);
+			if (len2 <= len + 1)
+				break;
+			ip++;
+			len = len2;
+			ref = ref2;
+		}
+
+		op = lz4_encode_sequence(op, oend, anchor, ip, ip - ref, len);
+		if (!op)
+			return -E2BIG;
+		ip += len;
+		anchor = ip;
+	}
+
+last_literals:
+	op = lz4_encode_sequence(op, oend, anchor, iend, 0, 0);
+	if (!op)
+		return -E2BIG;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(lz4hc_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 HC compressor");
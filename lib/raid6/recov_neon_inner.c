@@ -0,0 +1,102 @@
+/*
+ * linux/lib/raid6/recov_neon_inner.c - NEON loops of recov_neon.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <arm_neon.h>
+
+/*
+ * Multiply every byte of x by the constant whose raid6_vgfmul row is
+ * split into lo (low nibble products) and hi (high nibble products).
+ * ARMv7 only has 8 byte table lookups, so each half of x takes one
+ * vtbl2 over the 16 entry table.
+ */
+static inline uint8x16_t gfmul(uint8x8x2_t lo, uint8x8x2_t hi, uint8x16_t x)
+{
+	const uint8x16_t x0f = vdupq_n_u8(0x0f);
+	uint8x16_t l = vandq_u8(x, x0f);
+	uint8x16_t h = vshrq_n_u8(x, 4);
+
+	l = vcombine_u8(vtbl2_u8(lo, vget_low_u8(l)),
+			vtbl2_u8(lo, vget_high_u8(l)));
+	h = vcombine_u8(vtbl2_u8(hi, vget_low_u8(h)),
+			vtbl2_u8(hi, vget_high_u8(h)));
+	return veorq_u8(l, h);
+}
+
+static inline uint8x8x2_t load_table(const uint8_t *t)
+{
+	uint8x8x2_t r = { { vld1_u8(t), vld1_u8(t + 8) } };
+
+	return r;
+}
+
+void __raid6_2data_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dp,
+			      uint8_t *dq, const uint8_t *pbmul,
+			      const uint8_t *qmul)
+{
+	uint8x8x2_t pm0 = load_table(pbmul);
+	uint8x8x2_t pm1 = load_table(pbmul + 16);
+	uint8x8x2_t qm0 = load_table(qmul);
+	uint8x8x2_t qm1 = load_table(qmul + 16);
+
+	/*
+	 * while ( bytes-- ) {
+	 *	uint8_t px, qx, db;
+	 *
+	 *	px    = *p ^ *dp;
+	 *	qx    = qmul[*q ^ *dq];
+	 *	*dq++ = db = pbmul[px] ^ qx;
+	 *	*dp++ = db ^ px;
+	 *	p++; q++;
+	 * }
+	 */
+
+	while (bytes) {
+		uint8x16_t px, qx, db;
+
+		px = veorq_u8(vld1q_u8(p), vld1q_u8(dp));
+		qx = gfmul(qm0, qm1, veorq_u8(vld1q_u8(q), vld1q_u8(dq)));
+		db = veorq_u8(gfmul(pm0, pm1, px), qx);
+
+		vst1q_u8(dq, db);
+		vst1q_u8(dp, veorq_u8(db, px));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dp += 16;
+		dq += 16;
+	}
+}
+
+void __raid6_datap_recov_neon(int bytes, uint8_t *p, uint8_t *q, uint8_t *dq,
+			      const uint8_t *qmul)
+{
+	uint8x8x2_t qm0 = load_table(qmul);
+	uint8x8x2_t qm1 = load_table(qmul + 16);
+
+	/*
+	 * while (bytes--) {
+	 *	*p++ ^= *dq = qmul[*q ^ *dq];
+	 *	q++; dq++;
+	 * }
+	 */
+
+	while (bytes) {
+		uint8x16_t vx;
+
+		vx = gfmul(qm0, qm1, veorq_u8(vld1q_u8(q), vld1q_u8(dq)));
+
+		vst1q_u8(dq, vx);
+		vst1q_u8(p, veorq_u8(vx, vld1q_u8(p)));
+
+		bytes -= 16;
+		p += 16;
+		q += 16;
+		dq += 16;
+	}
+}
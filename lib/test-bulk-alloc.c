@@ -0,0 +1,160 @@
+/*
+ * Bulk page and slab allocation benchmark
+ *
+ * Times allocating and freeing batches of 1 to 256 objects, one at a
+ * time and through the bulk calls, for order-0 pages and for objects of
+ * a slab cache of obj_size bytes, and reports the nanoseconds an object
+ * costs for the round trip:
+ *
+ *	modprobe test-bulk-alloc obj_size=256 objects=1048576
+ *
+ * Each batch size handles about objects objects in total. The module
+ * never stays loaded: init reports -EAGAIN once done.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/gfp.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/pagemap.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#define MAX_BATCH	256
+
+static uint obj_size = 256;
+module_param(obj_size, uint, 0);
+MODULE_PARM_DESC(obj_size, "Object size of the slab cache");
+
+static uint objects = 1 << 20;
+module_param(objects, uint, 0);
+MODULE_PARM_DESC(objects, "Objects allocated and freed per batch size");
+
+static struct kmem_cache *bench_cache;
+static void *objs[MAX_BATCH];
+static struct page *pages[MAX_BATCH];
+
+static u64 __init ns_per_object(ktime_t start, unsigned long done)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return done ? div64_u64(ns, done) : 0;
+}
+
+static int __init bench_slab(unsigned int batch)
+{
+	unsigned long done;
+	unsigned int i, nr;
+	u64 single, bulk;
+	ktime_t start;
+
+	start = ktime_get();
+	for (done = 0; done < objects; done += batch) {
+		for (i = 0; i < batch; i++) {
+			objs[i] = kmem_cache_alloc(bench_cache, GFP_KERNEL);
+			if (!objs[i])
+				break;
+		}
+		nr = i;
+		while (i--)
+			kmem_cache_free(bench_cache, objs[i]);
+		/* A partial batch would skew the baseline */
+		if (nr < batch)
+			return -ENOMEM;
+	}
+	single = ns_per_object(start, done);
+	cond_resched();
+
+	start = ktime_get();
+	for (done = 0; done < objects; done += batch) {
+		if (!kmem_cache_alloc_bulk(bench_cache, GFP_KERNEL, batch,
+					   objs))
+			return -ENOMEM;
+		kmem_cache_free_bulk(bench_cache, batch, objs);
+	}
+	bulk = ns_per_object(start, done);
+	cond_resched();
+
+	pr_info("test-bulk-alloc: slab   batch %3u: %4llu ns single, "
+		"%4llu ns bulk\n", batch, single, bulk);
+	return 0;
+}
+
+static int __init bench_pages(unsigned int batch)
+{
+	unsigned long done, nr;
+	unsigned int i;
+	u64 single, bulk;
+	ktime_t start;
+
+	start = ktime_get();
+	for (done = 0; done < objects; done += batch) {
+		for (i = 0; i < batch; i++) {
+			pages[i] = alloc_page(GFP_KERNEL);
+			if (!pages[i])
+				break;
+		}
+		nr = i;
+		while (i--)
+			__free_page(pages[i]);
+		if (nr < batch)
+			return -ENOMEM;
+	}
+	single = ns_per_object(start, done);
+	cond_resched();
+
+	start = ktime_get();
+	for (done = 0; done < objects; done += nr) {
+		nr = alloc_pages_bulk(GFP_KERNEL, batch, pages);
+		if (!nr)
+			return -ENOMEM;
+		release_pages(pages, nr, 0);
+	}
+	bulk = ns_per_object(start, done);
+	cond_resched();
+
+	pr_info("test-bulk-alloc: pages  batch %3u: %4llu ns single, "
+		"%4llu ns bulk\n", batch, single, bulk);
+	return 0;
+}
+
+static int __init test_bulk_alloc_init(void)
+{
+	unsigned int batch;
+	int ret = 0;
+
+	if (!obj_size || !objects)
+		return -EINVAL;
+
+	bench_cache = kmem_cache_create("test-bulk-alloc", obj_size, 0, 0,
+					NULL);
+	if (!bench_cache)
+		return -ENOMEM;
+
+	for (batch = 1; batch <= MAX_BATCH && !ret; batch <<= 1)
+		ret = bench_slab(batch);
+	for (batch = 1; batch <= MAX_BATCH && !ret; batch <<= 1)
+		ret = bench_pages(batch);
+
+	kmem_cache_destroy(bench_cache);
+
+	/* Nothing to keep around after the run */
+	return ret ? ret : -EAGAIN;
+}
+
+static void __exit test_bulk_alloc_exit(void)
+{
+}
+
+module_init(test_bulk_alloc_init);
+module_exit(test_bulk_alloc_exit);
+
+MODULE_DESCRIPTION("Bulk page and slab allocation benchmark");
+MODULE_LICENSE("GPL");
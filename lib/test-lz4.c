@@ -0,0 +1,227 @@
+/*
+ * LZ4 self test and decompression throughput
+ *
+ * Compresses a generated text-like corpus in blocks of block_size with
+ * LZ4, LZ4 HC and, for reference, LZO, checks that every block comes
+ * back intact and that truncated LZ4 input is refused, then times
+ * decompressing the whole corpus loops times:
+ *
+ *	modprobe test-lz4 block_size=4096 size=1048576 loops=20
+ *
+ * 4096 is what zram works with, 131072 the default squashfs block. The
+ * module never stays loaded: init reports -EAGAIN once done, -EINVAL if
+ * a check failed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/lzo.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+
+static uint block_size = 4096;
+module_param(block_size, uint, 0);
+MODULE_PARM_DESC(block_size, "Size of the independently compressed blocks");
+
+static uint size = 1 << 20;
+module_param(size, uint, 0);
+MODULE_PARM_DESC(size, "Size of the corpus");
+
+static uint loops = 20;
+module_param(loops, uint, 0);
+MODULE_PARM_DESC(loops, "Times the corpus is decompressed");
+
+struct lz4_test_alg {
+	const char *name;
+	size_t wrkmem_size;
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
+};
+
+static const struct lz4_test_alg algs[] = {
+	{ "lz4", LZ4_MEM_COMPRESS, lz4_compress, lz4_decompress_safe },
+	{ "lz4hc", LZ4HC_MEM_COMPRESS, lz4hc_compress, lz4_decompress_safe },
+	{ "lzo", LZO1X_MEM_COMPRESS, lzo1x_1_compress, lzo1x_decompress_safe },
+};
+
+static const char * const words[] = {
+	"the", "of", "page", "kernel", "buffer", "0x", "error", "read",
+	"write", "device", "memory", "cpu", "return", "struct", "int",
+	"if", "for", "while", "static", "void", "unsigned", "long", "=",
+	"{", "}", ";", "(", ")", "->", "NULL", "=="
+};
+
+/* Lines of words and numbers, about as compressible as logs or sources */
+static void __init fill_corpus(u8 *buf, size_t len)
+{
+	struct rnd_state rnd;
+	size_t i = 0;
+
+	prandom32_seed(&rnd, 42);
+	while (i < len) {
+		u32 r = prandom32(&rnd);
+		char tmp[16];
+		const char *w;
+		int n;
+
+		if (r % 16 == 0) {
+			n = snprintf(tmp, sizeof(tmp), "%u", r >> 12);
+			w = tmp;
+		} else if (r % 16 == 1) {
+			w = "\n\t";
+			n = 2;
+		} else {
+			w = words[(r >> 4) % ARRAY_SIZE(words)];
+			n = strlen(w);
+		}
+		while (n-- && i < len)
+			buf[i++] = *w++;
+		if (i < len)
+			buf[i++] = ' ';
+	}
+}
+
+static int __init test_alg(const struct lz4_test_alg *alg, const u8 *corpus,
+			u8 *cbuf, size_t *clens, size_t cstride, u8 *out)
+{
+	unsigned int nblocks = DIV_ROUND_UP(size, block_size);
+	size_t len, clen, total = 0;
+	unsigned int b, i;
+	void *wrkmem;
+	ktime_t start;
+	u64 ns;
+	int ret;
+
+	wrkmem = vmalloc(alg->wrkmem_size);
+	if (!wrkmem)
+		return -ENOMEM;
+
+	start = ktime_get();
+	for (b = 0; b < nblocks; b++) {
+		len = min_t(size_t, block_size, size - b * block_size);
+		clens[b] = cstride;
+		ret = alg->compress(corpus + b * block_size, len,
+				    cbuf + b * cstride, &clens[b], wrkmem);
+		if (ret) {
+			pr_err("test-lz4: %s: compressing block %u: %d\n",
+			       alg->name, b, ret);
+			goto out;
+		}
+		total += clens[b];
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	pr_info("test-lz4: %s: %u bytes to %zu, compressed at %llu MB/s\n",
+		alg->name, size, total,
+		div64_u64((u64)size * 1000, ns ? ns : 1));
+
+	for (b = 0; b < nblocks; b++) {
+		len = min_t(size_t, block_size, size - b * block_size);
+		clen = block_size;
+		ret = alg->decompress(cbuf + b * cstride, clens[b], out, &clen);
+		if (ret || clen != len ||
+		    memcmp(out, corpus + b * block_size, len)) {
+			pr_err("test-lz4: %s: block %u does not round trip: "
+			       "%d\n", alg->name, b, ret);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		/* Corrupt input must be refused, not overrun anything */
+		if (alg->decompress == lz4_decompress_safe && clens[b] > 1) {
+			clen = block_size;
+			if (!alg->decompress(cbuf + b * cstride, clens[b] - 1,
+					     out, &clen) && clen == len) {
+				pr_err("test-lz4: %s: truncated block %u "
+				       "accepted\n", alg->name, b);
+				ret = -EINVAL;
+				goto out;
+			}
+			clen = len - 1;
+			if (!alg->decompress(cbuf + b * cstride, clens[b],
+					     out, &clen)) {
+				pr_err("test-lz4: %s: block %u overflows "
+				       "output\n", alg->name, b);
+				ret = -EINVAL;
+				goto out;
+			}
+		}
+	}
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		for (b = 0; b < nblocks; b++) {
+			clen = block_size;
+			alg->decompress(cbuf + b * cstride, clens[b], out,
+					&clen);
+		}
+		cond_resched();
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	pr_info("test-lz4: %s: decompressed at %llu MB/s\n", alg->name,
+		div64_u64((u64)size * loops * 1000, ns ? ns : 1));
+	ret = 0;
+out:
+	vfree(wrkmem);
+	return ret;
+}
+
+static int __init test_lz4_init(void)
+{
+	unsigned int nblocks;
+	size_t cstride, *clens = NULL;
+	u8 *corpus = NULL, *cbuf = NULL, *out = NULL;
+	int i, ret = -ENOMEM;
+
+	if (!size || !block_size || block_size > size ||
+	    block_size > LZ4_MAX_INPUT_SIZE)
+		return -EINVAL;
+
+	nblocks = DIV_ROUND_UP(size, block_size);
+	cstride = max_t(size_t, lz4_compressbound(block_size),
+			lzo1x_worst_compress(block_size));
+
+	corpus = vmalloc(size);
+	cbuf = vmalloc(nblocks * cstride);
+	out = vmalloc(block_size);
+	clens = vmalloc(nblocks * sizeof(*clens));
+	if (!corpus || !cbuf || !out || !clens)
+		goto out;
+
+	fill_corpus(corpus, size);
+	pr_info("test-lz4: %u byte blocks, %u blocks\n", block_size, nblocks);
+
+	for (i = 0; i < ARRAY_SIZE(algs); i++) {
+		ret = test_alg(&algs[i], corpus, cbuf, clens, cstride, out);
+		if (ret)
+			break;
+	}
+out:
+	vfree(clens);
+	vfree(out);
+	vfree(cbuf);
+	vfree(corpus);
+
+	/* Nothing to keep around after the run */
+	return ret ? ret : -EAGAIN;
+}
+
+static void __exit test_lz4_exit(void)
+{
+}
+
+module_init(test_lz4_init);
+module_exit(test_lz4_exit);
+
+MODULE_DESCRIPTION("LZ4 self test and decompression throughput");
+MODULE_LICENSE("GPL");
@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/cpu.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -38,6 +41,7 @@ struct compact_control {
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
+	bool background;		/* Compacting on behalf of kcompactd */
 };
 
 static unsigned long release_freepages(struct list_head *freelist)
@@ -474,6 +478,10 @@ static int compact_finished(struct zone *zone,
 	if (!zone_watermark_ok(zone, cc->order, watermark, 0, 0))
 		return COMPACT_CONTINUE;
 
+	/* kcompactd: the zone is back at its target, leave the rest */
+	if (cc->background)
+		return COMPACT_PARTIAL;
+
 	/* Direct compactor: Is a suitable page free? */
 	for (order = cc->order; order < MAX_ORDER; order++) {
 		/* Job done if page is free of the right migratetype */
@@ -585,6 +593,9 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
 		if (nr_remaining)
 			count_vm_events(COMPACTPAGEFAILED, nr_remaining);
+		if (cc->background)
+			count_vm_events(KCOMPACTD_MIGRATED,
+					nr_migrate - nr_remaining);
 		trace_mm_compaction_migratepages(nr_migrate - nr_remaining,
 						nr_remaining);
 
@@ -745,6 +756,246 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * kcompactd compacts the zones of its node in the background, so that
+ * high-order allocations find free blocks instead of stalling in direct
+ * compaction.  kswapd wakes it with the order it has just reclaimed for
+ * before going back to sleep, and every kcompactd_interval milliseconds
+ * it checks by itself whether fragmentation keeps any zone from having
+ * free blocks of kcompactd_order.  Either way a zone is only compacted
+ * when compaction_suitable() says the failure would be due to
+ * fragmentation, and only until its watermark for the order is met.
+ */
+int sysctl_kcompactd_order = PAGE_ALLOC_COSTLY_ORDER;
+int sysctl_kcompactd_interval = 500;
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	int classzone_idx = pgdat->kcompactd_classzone_idx;
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+			.zone = zone,
+			.sync = true,
+			.background = true,
+		};
+		int status;
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_deferred(zone) ||
+		    compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		if (kthread_should_stop())
+			return;
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		status = compact_zone(zone, &cc);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+			count_vm_event(KCOMPACTD_SUCCESS);
+		} else if (status == COMPACT_COMPLETE) {
+			/* The whole zone was scanned, give it a rest */
+			defer_compaction(zone);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+
+	/*
+	 * Leave requests that came in while we were busy for the next
+	 * round, unless this one covered them.
+	 */
+	if (pgdat->kcompactd_max_order <= order)
+		pgdat->kcompactd_max_order = 0;
+	if (pgdat->kcompactd_classzone_idx >= classzone_idx)
+		pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+}
+
+/**
+ * wakeup_kcompactd - ask kcompactd to compact for a high-order allocation
+ * @pgdat: node to compact
+ * @order: order of the allocation
+ * @classzone_idx: highest zone the allocation may use
+ *
+ * Called by kswapd when it is done reclaiming for @order.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	DEFINE_WAIT(wait);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		bool proactive = sysctl_kcompactd_order && sysctl_kcompactd_interval;
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+
+		if (proactive)
+			timeout = msecs_to_jiffies(sysctl_kcompactd_interval);
+
+		prepare_to_wait(&pgdat->kcompactd_wait, &wait, TASK_INTERRUPTIBLE);
+		if (!pgdat->kcompactd_max_order && !kthread_should_stop())
+			schedule_timeout(timeout);
+		finish_wait(&pgdat->kcompactd_wait, &wait);
+
+		if (try_to_freeze() || kthread_should_stop())
+			continue;
+
+		if (!pgdat->kcompactd_max_order) {
+			if (!proactive || !kcompactd_node_suitable(pgdat,
+					sysctl_kcompactd_order,
+					pgdat->nr_zones - 1))
+				continue;
+			pgdat->kcompactd_max_order = sysctl_kcompactd_order;
+		}
+
+		count_vm_event(KCOMPACTD_WAKE);
+		kcompactd_do_work(pgdat);
+	}
+
+	return 0;
+}
+
+/*
+ * Called at boot and on memory hot-add, like kswapd_run().
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.  Caller
+ * must hold lock_memory_hotplug().
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+int sysctl_kcompactd_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	/* Let the daemons pick up the new settings right away */
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		wake_up_interruptible(&NODE_DATA(nid)->kcompactd_wait);
+
+	return 0;
+}
+
+/* Keep kcompactd on the cpus of its node, as cpu_callback does for kswapd */
+static int __devinit kcompactd_cpu_callback(struct notifier_block *nfb,
+					unsigned long action, void *hcpu)
+{
+	int nid;
+
+	if (action == CPU_ONLINE || action == CPU_ONLINE_FROZEN) {
+		for_each_node_state(nid, N_HIGH_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+			const struct cpumask *mask;
+
+			mask = cpumask_of_node(pgdat->node_id);
+
+			if (pgdat->kcompactd &&
+			    cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+				set_cpus_allowed_ptr(pgdat->kcompactd, mask);
+		}
+	}
+	return NOTIFY_OK;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	hotcpu_notifier(kcompactd_cpu_callback, 0);
+	return 0;
+}
+subsys_initcall(kcompactd_init);
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
@@ -21,6 +21,15 @@
 #include <asm/pgalloc.h>
 #include "internal.h"
 
+/*
+ * Point a pmd on the stack at a deposited page table, to fill in its
+ * ptes before the table is installed.  Architectures whose pmd_populate()
+ * writes more than the one entry provide their own.
+ */
+#ifndef pmd_populate_temp
+#define pmd_populate_temp(mm, pmdp, pgtable) pmd_populate(mm, pmdp, pgtable)
+#endif
+
 /*
  * By default transparent hugepage support is enabled for all mappings
  * and khugepaged scans all mappings. Defrag is only invoked by
@@ -846,7 +855,7 @@ static int do_huge_pmd_wp_page_fallback(struct mm_struct *mm,
 	/* leave pmd empty until pte is filled */
 
 	pgtable = get_pmd_huge_pte(mm);
-	pmd_populate(mm, &_pmd, pgtable);
+	pmd_populate_temp(mm, &_pmd, pgtable);
 
 	for (i = 0; i < HPAGE_PMD_NR; i++, haddr += PAGE_SIZE) {
 		pte_t *pte, entry;
@@ -883,6 +892,28 @@ out_free_pages:
 	goto out;
 }
 
+/*
+ * Faults on a huge pmd that is already mapped, without a copy on write
+ * to do: on architectures that clear the young state by unmapping the
+ * pmd, this is what maps it back.
+ */
+void huge_pmd_set_accessed(struct mm_struct *mm, struct vm_area_struct *vma,
+			   unsigned long address, pmd_t *pmd, pmd_t orig_pmd,
+			   int dirty)
+{
+	pmd_t entry;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_same(*pmd, orig_pmd))) {
+		entry = pmd_mkyoung(orig_pmd);
+		if (dirty)
+			entry = pmd_mkdirty(entry);
+		pmdp_set_access_flags(vma, address & HPAGE_PMD_MASK, pmd,
+				      entry, dirty);
+	}
+	spin_unlock(&mm->page_table_lock);
+}
+
 int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			unsigned long address, pmd_t *pmd, pmd_t orig_pmd)
 {
@@ -903,7 +934,7 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		entry = pmd_mkyoung(orig_pmd);
 		entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
 		if (pmdp_set_access_flags(vma, haddr, pmd, entry,  1))
-			update_mmu_cache(vma, address, entry);
+			update_mmu_cache_pmd(vma, address, pmd);
 		ret |= VM_FAULT_WRITE;
 		goto out_unlock;
 	}
@@ -950,7 +981,7 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		pmdp_clear_flush_notify(vma, haddr, pmd);
 		page_add_new_anon_rmap(new_page, vma, haddr);
 		set_pmd_at(mm, haddr, pmd, entry);
-		update_mmu_cache(vma, address, entry);
+		update_mmu_cache_pmd(vma, address, pmd);
 		page_remove_rmap(page);
 		put_page(page);
 		ret |= VM_FAULT_WRITE;
@@ -998,7 +1029,7 @@ out:
 }
 
 int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
-		 pmd_t *pmd)
+		 pmd_t *pmd, unsigned long addr)
 {
 	int ret = 0;
 
@@ -1014,6 +1045,7 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 			pgtable = get_pmd_huge_pte(tlb->mm);
 			page = pmd_page(*pmd);
 			pmd_clear(pmd);
+			tlb_remove_pmd_tlb_entry(tlb, pmd, addr);
 			page_remove_rmap(page);
 			VM_BUG_ON(page_mapcount(page) < 0);
 			add_mm_counter(tlb->mm, MM_ANONPAGES, -HPAGE_PMD_NR);
@@ -1338,7 +1370,7 @@ static int __split_huge_page_map(struct page *page,
 				     PAGE_CHECK_ADDRESS_PMD_SPLITTING_FLAG);
 	if (pmd) {
 		pgtable = get_pmd_huge_pte(mm);
-		pmd_populate(mm, &_pmd, pgtable);
+		pmd_populate_temp(mm, &_pmd, pgtable);
 
 		for (i = 0, haddr = address; i < HPAGE_PMD_NR;
 		     i++, haddr += PAGE_SIZE) {
@@ -1916,6 +1948,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 	pte = pte_offset_map(pmd, address);
 	ptl = pte_lockptr(mm, pmd);
 
+	/* Keep speculative faults from filling the pmd while it is clear */
+	vma_write_begin(vma);
 	spin_lock(&mm->page_table_lock); /* probably unnecessary */
 	/*
 	 * After this gup_fast can't run anymore. This also removes
@@ -1936,6 +1970,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 		BUG_ON(!pmd_none(*pmd));
 		set_pmd_at(mm, address, pmd, _pmd);
 		spin_unlock(&mm->page_table_lock);
+		vma_write_end(vma);
 		anon_vma_unlock(vma->anon_vma);
 		goto out;
 	}
@@ -1968,9 +2003,10 @@ static void collapse_huge_page(struct mm_struct *mm,
 	BUG_ON(!pmd_none(*pmd));
 	page_add_new_anon_rmap(new_page, vma, address);
 	set_pmd_at(mm, address, pmd, _pmd);
-	update_mmu_cache(vma, address, _pmd);
+	update_mmu_cache_pmd(vma, address, pmd);
 	prepare_pmd_huge_pte(pgtable, mm);
 	spin_unlock(&mm->page_table_lock);
+	vma_write_end(vma);
 
 #ifndef CONFIG_NUMA
 	*hpage = NULL;
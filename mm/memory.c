@@ -1231,7 +1231,7 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 			if (next - addr != HPAGE_PMD_SIZE) {
 				VM_BUG_ON(!rwsem_is_locked(&tlb->mm->mmap_sem));
 				split_huge_page_pmd(vma->vm_mm, pmd);
-			} else if (zap_huge_pmd(tlb, vma, pmd))
+			} else if (zap_huge_pmd(tlb, vma, pmd, addr))
 				goto next;
 			/* fall through */
 		}
@@ -3494,6 +3494,10 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			    !pmd_trans_splitting(orig_pmd))
 				return do_huge_pmd_wp_page(mm, vma, address,
 							   pmd, orig_pmd);
+			if (!pmd_trans_splitting(orig_pmd))
+				huge_pmd_set_accessed(mm, vma, address, pmd,
+						      orig_pmd,
+						      flags & FAULT_FLAG_WRITE);
 			return 0;
 		}
 	}
@@ -3519,6 +3523,220 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults
+ *
+ * A fault normally holds mmap_sem for reading throughout, so the faults
+ * of a multithreaded process all wait whenever one of its threads maps,
+ * unmaps or mprotects memory.  The common faults can do without it:
+ * they look the vma up under mm_rb_lock, pin it with vm_ref_count and
+ * remember its vm_sequence, do whatever might sleep (allocating the
+ * page, reading it from the file) without any lock, then validate the
+ * sequence again and install the pte under page_table_lock.  Every
+ * change to a vma bumps its vm_sequence to odd under page_table_lock
+ * first, and mremap does the same with mm->move_seq, so if the sequence
+ * is unchanged with page_table_lock held, the vma still describes the
+ * address and neither it nor its page tables can go away until the lock
+ * is dropped.
+ *
+ * Anything out of the ordinary returns VM_FAULT_RETRY, after which the
+ * caller handles the fault the classic way under mmap_sem.
+ */
+#define SPF_BAD_VM_FLAGS	(VM_HUGETLB | VM_GROWSDOWN | VM_GROWSUP | \
+				 VM_NONLINEAR | VM_PFNMAP | VM_MIXEDMAP | \
+				 VM_IO | VM_LOCKED)
+
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags, unsigned long vm_flags)
+{
+	int write = flags & FAULT_FLAG_WRITE;
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+	pgtable_t new_pte = NULL;
+	unsigned int seq, move;
+	int ret = VM_FAULT_RETRY;
+	int fault_ret = 0;
+	struct vm_fault vmf;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte, entry;
+	spinlock_t *ptl;
+
+	move = raw_read_seqcount(&mm->move_seq);
+	if (move & 1)
+		return VM_FAULT_RETRY;
+
+	vma = get_vma(mm, address);
+	if (!vma)
+		return VM_FAULT_RETRY;
+
+	seq = raw_read_seqcount(&vma->vm_sequence);
+	if (seq & 1)
+		goto out_put;
+	if (address < vma->vm_start || address >= vma->vm_end)
+		goto out_put;
+	if (!(vma->vm_flags & vm_flags) || (vma->vm_flags & SPF_BAD_VM_FLAGS))
+		goto out_put;
+	if (vma_policy(vma))
+		goto out_put;
+	if (vma->vm_ops) {
+		/* Only read faults of plain page cache backed files */
+		if (vma->vm_ops->fault != filemap_fault || write)
+			goto out_put;
+	} else if (!vma->anon_vma)
+		goto out_put;
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+again:
+	spin_lock(&mm->page_table_lock);
+	if (read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    read_seqcount_retry(&mm->move_seq, move))
+		goto out_unlock;
+
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || pgd_bad(*pgd))
+		goto out_unlock;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || pud_bad(*pud))
+		goto out_unlock;
+	pmd = pmd_offset(pud, address);
+	if (pmd_none(*pmd)) {
+		/* Huge pmds are left to the classic path */
+		if (!vma->vm_ops && transparent_hugepage_enabled(vma))
+			goto out_unlock;
+		if (!new_pte) {
+			spin_unlock(&mm->page_table_lock);
+			new_pte = pte_alloc_one(mm, address);
+			if (!new_pte)
+				goto out_put;
+			smp_wmb(); /* See comment in __pte_alloc */
+			goto again;
+		}
+		mm->nr_ptes++;
+		pmd_populate(mm, pmd, new_pte);
+		new_pte = NULL;
+	}
+	if (pmd_trans_huge(*pmd) || pmd_bad(*pmd))
+		goto out_unlock;
+
+	pte = pte_offset_map(pmd, address);
+	ptl = pte_lockptr(mm, pmd);
+	if (ptl != &mm->page_table_lock)
+		spin_lock(ptl);
+
+	entry = *pte;
+	if (pte_present(entry)) {
+		if (write && !pte_write(entry))
+			goto out_unmap;
+		if (write)
+			entry = pte_mkdirty(entry);
+		entry = pte_mkyoung(entry);
+		if (ptep_set_access_flags(vma, address, pte, entry, write))
+			update_mmu_cache(vma, address, pte);
+		else if (write)
+			flush_tlb_fix_spurious_fault(vma, address);
+		ret = 0;
+		goto out_unmap;
+	}
+	if (!pte_none(entry))
+		goto out_unmap;
+
+	if (!vma->vm_ops && !write) {
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+					      vma->vm_page_prot));
+		goto setpte;
+	}
+
+	if (!page) {
+		/* Get the page without locks held and come back */
+		if (ptl != &mm->page_table_lock)
+			spin_unlock(ptl);
+		pte_unmap(pte);
+		spin_unlock(&mm->page_table_lock);
+
+		if (!vma->vm_ops) {
+			page = alloc_zeroed_user_highpage_movable(vma, address);
+			if (!page)
+				goto out_put;
+			__SetPageUptodate(page);
+			if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+				page_cache_release(page);
+				page = NULL;
+				goto out_put;
+			}
+			goto again;
+		}
+
+		vmf.virtual_address = (void __user *)(address & PAGE_MASK);
+		vmf.pgoff = linear_page_index(vma, address);
+		vmf.flags = flags & ~FAULT_FLAG_ALLOW_RETRY;
+		vmf.page = NULL;
+
+		fault_ret = vma->vm_ops->fault(vma, &vmf);
+		if (unlikely(fault_ret & (VM_FAULT_ERROR | VM_FAULT_NOPAGE |
+					  VM_FAULT_RETRY)))
+			goto out_put;
+		if (!(fault_ret & VM_FAULT_LOCKED))
+			lock_page(vmf.page);
+		page = vmf.page;
+		if (unlikely(PageHWPoison(page)))
+			goto out_put;
+		if (PageReadaheadUnused(page))
+			ClearPageReadaheadUnused(page);
+		goto again;
+	}
+
+	if (!vma->vm_ops) {
+		entry = mk_pte(page, vma->vm_page_prot);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	} else {
+		flush_icache_page(vma, page);
+		entry = mk_pte(page, vma->vm_page_prot);
+		inc_mm_counter_fast(mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+		unlock_page(page);
+	}
+	/* The page table holds the reference now */
+	page = NULL;
+setpte:
+	set_pte_at(mm, address, pte, entry);
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, pte);
+	ret = fault_ret & VM_FAULT_MAJOR;
+out_unmap:
+	if (ptl != &mm->page_table_lock)
+		spin_unlock(ptl);
+	pte_unmap(pte);
+out_unlock:
+	spin_unlock(&mm->page_table_lock);
+out_put:
+	if (page) {
+		if (vma->vm_ops)
+			unlock_page(page);
+		else
+			mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+	if (new_pte)
+		pte_free(mm, new_pte);
+	put_vma(vma);
+
+	if (ret != VM_FAULT_RETRY) {
+		count_vm_event(PGFAULT);
+		count_vm_event(SPECULATIVE_PGFAULT);
+		mem_cgroup_count_vm_event(mm, PGFAULT);
+	}
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -233,6 +233,71 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+static void __free_vma(struct vm_area_struct *vma)
+{
+	if (vma->vm_file)
+		fput(vma->vm_file);
+	kmem_cache_free(vm_area_cachep, vma);
+}
+
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults look vmas up without mmap_sem, under
+ * mm_rb_lock, and keep them from being freed with vm_ref_count: the
+ * mm's own reference is implied, so the last put takes the count
+ * below zero.
+ */
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+	write_lock(&mm->mm_rb_lock);
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+	write_unlock(&mm->mm_rb_lock);
+}
+
+struct vm_area_struct *get_vma(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+
+	read_lock(&mm->mm_rb_lock);
+	rb_node = mm->mm_rb.rb_node;
+	while (rb_node) {
+		struct vm_area_struct *vma_tmp;
+
+		vma_tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (addr >= vma_tmp->vm_end) {
+			rb_node = rb_node->rb_right;
+		} else if (addr < vma_tmp->vm_start) {
+			rb_node = rb_node->rb_left;
+		} else {
+			vma = vma_tmp;
+			atomic_inc(&vma->vm_ref_count);
+			break;
+		}
+	}
+	read_unlock(&mm->mm_rb_lock);
+
+	return vma;
+}
+
+void put_vma(struct vm_area_struct *vma)
+{
+	if (atomic_dec_return(&vma->vm_ref_count) < 0)
+		__free_vma(vma);
+}
+#else
+static inline void mm_rb_write_lock(struct mm_struct *mm) {}
+static inline void mm_rb_write_unlock(struct mm_struct *mm) {}
+
+static inline void put_vma(struct vm_area_struct *vma)
+{
+	__free_vma(vma);
+}
+#endif
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -243,13 +308,10 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	might_sleep();
 	if (vma->vm_ops && vma->vm_ops->close)
 		vma->vm_ops->close(vma);
-	if (vma->vm_file) {
-		fput(vma->vm_file);
-		if (vma->vm_flags & VM_EXECUTABLE)
-			removed_exe_file_vma(vma->vm_mm);
-	}
+	if (vma->vm_file && (vma->vm_flags & VM_EXECUTABLE))
+		removed_exe_file_vma(vma->vm_mm);
 	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	put_vma(vma);
 	return next;
 }
 
@@ -406,8 +468,10 @@ find_vma_prepare(struct mm_struct *mm, unsigned long addr,
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+	mm_rb_write_lock(mm);
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	rb_insert_color(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 }
 
 static void __vma_link_file(struct vm_area_struct *vma)
@@ -488,7 +552,9 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
 	prev->vm_next = next;
 	if (next)
 		next->vm_prev = prev;
+	mm_rb_write_lock(mm);
 	rb_erase(&vma->vm_rb, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 	if (mm->mmap_cache == vma)
 		mm->mmap_cache = prev;
 	if (vma->vm_flags & VM_EXEC)
@@ -515,6 +581,7 @@ int vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	long adjust_next = 0;
 	int remove_next = 0;
 
+	vma_write_begin(vma);
 	if (next && !insert) {
 		struct vm_area_struct *exporter = NULL;
 
@@ -552,10 +619,16 @@ again:			remove_next = 1 + (end > next->vm_end);
 		 * shrinking vma had, to cover any anon pages imported.
 		 */
 		if (exporter && exporter->anon_vma && !importer->anon_vma) {
-			if (anon_vma_clone(importer, exporter))
+			if (anon_vma_clone(importer, exporter)) {
+				vma_write_end(vma);
 				return -ENOMEM;
+			}
 			importer->anon_vma = exporter->anon_vma;
 		}
+
+		/* A removed next stays marked until it is freed */
+		if (remove_next || adjust_next)
+			vma_write_begin(next);
 	}
 
 	if (file) {
@@ -632,16 +705,13 @@ again:			remove_next = 1 + (end > next->vm_end);
 		mutex_unlock(&mapping->i_mmap_mutex);
 
 	if (remove_next) {
-		if (file) {
-			fput(file);
-			if (next->vm_flags & VM_EXECUTABLE)
-				removed_exe_file_vma(mm);
-		}
+		if (file && (next->vm_flags & VM_EXECUTABLE))
+			removed_exe_file_vma(mm);
 		if (next->anon_vma)
 			anon_vma_merge(vma, next);
 		mm->map_count--;
 		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -653,6 +723,9 @@ again:			remove_next = 1 + (end > next->vm_end);
 		}
 	}
 
+	if (adjust_next)
+		vma_write_end(next);
+	vma_write_end(vma);
 	validate_mm(mm);
 
 	return 0;
@@ -2002,7 +2075,11 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
+		/* Stays marked: speculative faults must not use it again */
+		vma_write_begin(vma);
+		mm_rb_write_lock(mm);
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
+		mm_rb_write_unlock(mm);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
@@ -2040,6 +2117,7 @@ static int __split_vma(struct mm_struct * mm, struct vm_area_struct * vma,
 
 	/* most fields are the same, copy all, and then fixup */
 	*new = *vma;
+	vma_spf_init(new);
 
 	INIT_LIST_HEAD(&new->anon_vma_chain);
 
@@ -2446,6 +2524,7 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 		new_vma = kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 		if (new_vma) {
 			*new_vma = *vma;
+			vma_spf_init(new_vma);
 			pol = mpol_dup(vma_policy(vma));
 			if (IS_ERR(pol))
 				goto out_free_vma;
@@ -180,6 +180,27 @@ unsigned long move_page_tables(struct vm_area_struct *vma,
 	return len + old_addr - old_end;	/* how much done */
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative faults must not populate either end of a move while the
+ * page tables are in flight: they check move_seq under page_table_lock.
+ */
+static void move_seq_begin(struct mm_struct *mm)
+{
+	spin_lock(&mm->page_table_lock);
+	write_seqcount_begin(&mm->move_seq);
+	spin_unlock(&mm->page_table_lock);
+}
+
+static void move_seq_end(struct mm_struct *mm)
+{
+	write_seqcount_end(&mm->move_seq);
+}
+#else
+static inline void move_seq_begin(struct mm_struct *mm) {}
+static inline void move_seq_end(struct mm_struct *mm) {}
+#endif
+
 static unsigned long move_vma(struct vm_area_struct *vma,
 		unsigned long old_addr, unsigned long old_len,
 		unsigned long new_len, unsigned long new_addr)
@@ -214,9 +235,12 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		return err;
 
 	new_pgoff = vma->vm_pgoff + ((old_addr - vma->vm_start) >> PAGE_SHIFT);
+	move_seq_begin(mm);
 	new_vma = copy_vma(&vma, new_addr, new_len, new_pgoff);
-	if (!new_vma)
+	if (!new_vma) {
+		move_seq_end(mm);
 		return -ENOMEM;
+	}
 
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len);
 	if (moved_len < old_len) {
@@ -231,6 +255,7 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		old_addr = new_addr;
 		new_addr = -ENOMEM;
 	}
+	move_seq_end(mm);
 
 	/* Conceal VM_ACCOUNT so old reservation is not undone */
 	if (vm_flags & VM_ACCOUNT) {
@@ -2338,6 +2338,122 @@ out:
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/**
+ * __alloc_pages_bulk - allocate a batch of order-0 pages
+ * @gfp_mask: GFP flags for the allocation
+ * @zonelist: zonelist to allocate from
+ * @nodemask: nodes allowed, or %NULL for the cpuset's
+ * @nr_pages: number of pages wanted
+ * @pages: array receiving the pages
+ *
+ * Takes the pages off the per-cpu list of the first zone that stays above
+ * its low watermark with the whole batch gone, refilling the list from
+ * the buddy lists as it goes, with interrupts disabled once for the
+ * batch.  Only if that finds nothing does it fall back to a single page
+ * from __alloc_pages_nodemask(), with reclaim and all.
+ *
+ * Returns the number of pages placed in @pages, which may be less than
+ * @nr_pages but is zero only if the allocation failed altogether.  The
+ * pages can be given back with release_pages() or one by one.
+ */
+unsigned long
+__alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+		   nodemask_t *nodemask, unsigned long nr_pages,
+		   struct page **pages)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	struct zone *preferred_zone, *zone;
+	unsigned int cpuset_mems_cookie;
+	unsigned long flags, nr, got, i;
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	struct page *page;
+	struct zoneref *z;
+
+	if (unlikely(!nr_pages))
+		return 0;
+
+	gfp_mask &= gfp_allowed_mask;
+
+	if (nr_pages == 1 || should_fail_alloc_page(gfp_mask, 0) ||
+	    unlikely(!zonelist->_zonerefs->zone))
+		goto single;
+
+retry_cpuset:
+	nr = 0;
+	cpuset_mems_cookie = get_mems_allowed();
+
+	first_zones_zonelist(zonelist, high_zoneidx,
+				nodemask ? : &cpuset_current_mems_allowed,
+				&preferred_zone);
+	if (!preferred_zone)
+		goto out;
+
+	for_each_zone_zonelist_nodemask(zone, z, zonelist,
+						high_zoneidx, nodemask) {
+		if (!cpuset_zone_allowed_softwall(zone,
+						gfp_mask | __GFP_HARDWALL))
+			continue;
+		if (zone_watermark_ok(zone, 0, low_wmark_pages(zone) + nr_pages,
+				      zone_idx(preferred_zone), 0))
+			break;
+	}
+	if (!zone)
+		goto out;
+
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = &pcp->lists[migratetype];
+	while (nr < nr_pages) {
+		if (list_empty(list)) {
+			/* Refill for the rest of the batch in one go */
+			pcp->count += rmqueue_bulk(zone, 0,
+					max_t(unsigned long, pcp->batch,
+					      nr_pages - nr),
+					list, migratetype, cold);
+			if (unlikely(list_empty(list)))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+
+		list_del(&page->lru);
+		pcp->count--;
+		pages[nr++] = page;
+		zone_statistics(preferred_zone, zone, gfp_mask);
+	}
+	__count_zone_vm_events(PGALLOC, zone, nr);
+	local_irq_restore(flags);
+
+	/* Pages that fail the checks are left alone, as in buffered_rmqueue */
+	for (i = 0, got = nr, nr = 0; i < got; i++) {
+		VM_BUG_ON(bad_range(zone, pages[i]));
+		if (prep_new_page(pages[i], 0, gfp_mask))
+			continue;
+		trace_mm_page_alloc(pages[i], 0, gfp_mask, migratetype);
+		pages[nr++] = pages[i];
+	}
+
+out:
+	if (unlikely(!put_mems_allowed(cpuset_mems_cookie) && !nr))
+		goto retry_cpuset;
+	if (nr)
+		return nr;
+
+single:
+	page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+	if (!page)
+		return 0;
+	pages[0] = page;
+	return 1;
+}
+EXPORT_SYMBOL(__alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -4334,6 +4450,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -116,6 +116,7 @@ pmd_t pmdp_splitting_flush(struct vm_area_struct *vma, unsigned long address,
 	set_pmd_at(vma->vm_mm, address, pmdp, pmd);
 	/* tlb flush only to serialize against gup-fast */
 	flush_tlb_range(vma, address, address + HPAGE_PMD_SIZE);
+	return pmd;
 }
 #endif /* CONFIG_TRANSPARENT_HUGEPAGE */
 #endif
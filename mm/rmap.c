@@ -1216,6 +1216,20 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 			dec_mm_counter(mm, MM_FILEPAGES);
 		set_pte_at(mm, address, pte,
 				swp_entry_to_pte(make_hwpoison_entry(page)));
+	} else if (flags & TTU_LAZYFREE) {
+		/*
+		 * A page without swap space that nobody wrote to since
+		 * MADV_FREE: drop it, a later fault finds a fresh one.
+		 * Dirty, pinned by get_user_pages or merged by KSM, it has
+		 * to be kept.
+		 */
+		if (PageDirty(page) || PageKsm(page) ||
+		    page_count(page) > page_mapcount(page) + 1) {
+			set_pte_at(mm, address, pte, pteval);
+			ret = SWAP_FAIL;
+			goto out_unmap;
+		}
+		dec_mm_counter(mm, MM_ANONPAGES);
 	} else if (PageAnon(page)) {
 		swp_entry_t entry = { .val = page_private(page) };
 
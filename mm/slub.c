@@ -2351,6 +2351,72 @@ void *kmem_cache_alloc(struct kmem_cache *s, gfp_t gfpflags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - allocate an array of objects
+ * @s: the cache to allocate from
+ * @flags: GFP flags
+ * @size: number of objects to allocate
+ * @p: array receiving the objects
+ *
+ * The objects are taken off the cpu slab's freelist with interrupts
+ * disabled once for the whole batch, instead of one cmpxchg per object.
+ *
+ * Returns @size on success, or 0 if the batch could not be allocated as
+ * a whole, in which case no objects are handed out.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	size_t i;
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	local_irq_disable();
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * Fail the cmpxchg of fastpath users we interrupted,
+			 * as the freelist has changed under them.  The slow
+			 * path may enable interrupts to get a new slab, and
+			 * we may come back on another cpu.
+			 */
+			c->tid = next_tid(c->tid);
+			p[i] = __slab_alloc(s, flags, NUMA_NO_NODE, _RET_IP_, c);
+			if (unlikely(!p[i]))
+				goto error;
+			c = this_cpu_ptr(s->cpu_slab);
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+		stat(s, ALLOC_FASTPATH);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_enable();
+
+	for (i = 0; i < size; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->objsize);
+		slab_post_alloc_hook(s, flags, p[i]);
+	}
+	return size;
+
+error:
+	local_irq_enable();
+	size = i;
+	for (i = 0; i < size; i++)
+		slab_post_alloc_hook(s, flags, p[i]);
+	kmem_cache_free_bulk(s, size, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 #ifdef CONFIG_TRACING
 void *kmem_cache_alloc_trace(struct kmem_cache *s, gfp_t gfpflags, size_t size)
 {
@@ -2405,10 +2471,10 @@ EXPORT_SYMBOL(kmem_cache_alloc_node_trace);
  * handling required then we can return immediately.
  */
 static void __slab_free(struct kmem_cache *s, struct page *page,
-			void *x, unsigned long addr)
+			void *head, void *tail, int cnt, unsigned long addr)
 {
 	void *prior;
-	void **object = (void *)x;
+	void **object = (void *)head;
 	int was_frozen;
 	int inuse;
 	struct page new;
@@ -2418,16 +2484,16 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	stat(s, FREE_SLOWPATH);
 
-	if (kmem_cache_debug(s) && !free_debug_processing(s, page, x, addr))
+	if (kmem_cache_debug(s) && !free_debug_processing(s, page, head, addr))
 		return;
 
 	do {
 		prior = page->freelist;
 		counters = page->counters;
-		set_freepointer(s, object, prior);
+		set_freepointer(s, tail, prior);
 		new.counters = counters;
 		was_frozen = new.frozen;
-		new.inuse--;
+		new.inuse -= cnt;
 		if ((!new.inuse || !prior) && !was_frozen && !n) {
 
 			if (!kmem_cache_debug(s) && !prior)
@@ -2527,16 +2593,20 @@ slab_empty:
  *
  * If fastpath is not possible then fall back to __slab_free where we deal
  * with all sorts of special processing.
+ *
+ * @head to @tail is a freelist of @cnt objects of @page, linked through
+ * their free pointers, which is spliced onto the slab as a whole.  Single
+ * objects are passed with @tail equal to @head.  The free hooks must have
+ * been run on all of them.
  */
 static __always_inline void slab_free(struct kmem_cache *s,
-			struct page *page, void *x, unsigned long addr)
+			struct page *page, void *head, void *tail, int cnt,
+			unsigned long addr)
 {
-	void **object = (void *)x;
+	void **object = (void *)head;
 	struct kmem_cache_cpu *c;
 	unsigned long tid;
 
-	slab_free_hook(s, x);
-
 redo:
 	/*
 	 * Determine the currently cpus per cpu slab.
@@ -2550,7 +2620,7 @@ redo:
 	barrier();
 
 	if (likely(page == c->page)) {
-		set_freepointer(s, object, c->freelist);
+		set_freepointer(s, tail, c->freelist);
 
 		if (unlikely(!irqsafe_cpu_cmpxchg_double(
 				s->cpu_slab->freelist, s->cpu_slab->tid,
@@ -2562,7 +2632,7 @@ redo:
 		}
 		stat(s, FREE_FASTPATH);
 	} else
-		__slab_free(s, page, x, addr);
+		__slab_free(s, page, head, tail, cnt, addr);
 
 }
 
@@ -2572,12 +2642,112 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 
 	page = virt_to_head_page(x);
 
-	slab_free(s, page, x, _RET_IP_);
+	slab_free_hook(s, x);
+	slab_free(s, page, x, x, 1, _RET_IP_);
 
 	trace_kmem_cache_free(_RET_IP_, x);
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * A freelist of objects of one slab page, detached from the array passed
+ * to kmem_cache_free_bulk().
+ */
+struct detached_freelist {
+	struct page *page;
+	void *freelist;
+	void *tail;
+	int cnt;
+};
+
+/*
+ * Take the last object of @p and link up the other objects of its slab
+ * page into @df, clearing their slots.  Objects of other pages are left
+ * in place; the search gives up on the page after a few of them, as
+ * arrays of objects from many slabs are not worth sorting.
+ *
+ * Returns the size of the array that is left to process.
+ */
+static size_t build_detached_freelist(struct kmem_cache *s, size_t size,
+				      void **p, struct detached_freelist *df)
+{
+	size_t first_skipped = 0;
+	int lookahead = 3;
+	void *object;
+
+	df->page = NULL;
+
+	do {
+		object = p[--size];
+	} while (!object && size);
+
+	if (!object)
+		return 0;
+
+	slab_free_hook(s, object);
+	set_freepointer(s, object, NULL);
+	df->page = virt_to_head_page(object);
+	df->freelist = object;
+	df->tail = object;
+	df->cnt = 1;
+	p[size] = NULL;
+
+	while (size) {
+		object = p[--size];
+		if (!object)
+			continue;
+
+		if (virt_to_head_page(object) == df->page) {
+			slab_free_hook(s, object);
+			set_freepointer(s, object, df->freelist);
+			df->freelist = object;
+			df->cnt++;
+			p[size] = NULL;
+			continue;
+		}
+
+		if (!--lookahead)
+			break;
+
+		if (!first_skipped)
+			first_skipped = size + 1;
+	}
+
+	return first_skipped;
+}
+
+/**
+ * kmem_cache_free_bulk - free an array of objects
+ * @s: the cache the objects belong to
+ * @size: number of objects in @p
+ * @p: the objects; the array is clobbered
+ *
+ * Objects that share a slab page are linked into one freelist and given
+ * back with a single cmpxchg, instead of one per object.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct detached_freelist df;
+
+	if (unlikely(!size))
+		return;
+
+	/* free_debug_processing() checks one object at a time */
+	if (kmem_cache_debug(s)) {
+		while (size--)
+			kmem_cache_free(s, p[size]);
+		return;
+	}
+
+	do {
+		size = build_detached_freelist(s, size, p, &df);
+		if (likely(df.page))
+			slab_free(s, df.page, df.freelist, df.tail, df.cnt,
+				  _RET_IP_);
+	} while (size);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
@@ -3442,7 +3612,8 @@ void kfree(const void *x)
 		put_page(page);
 		return;
 	}
-	slab_free(page->slab, page, object, _RET_IP_);
+	slab_free_hook(page->slab, object);
+	slab_free(page->slab, page, object, object, 1, _RET_IP_);
 }
 EXPORT_SYMBOL(kfree);
 
@@ -29,6 +29,7 @@
 #include <linux/pagevec.h>
 #include <linux/backing-dev.h>
 #include <linux/rmap.h>
+#include <linux/ksm.h>
 #include <linux/topology.h>
 #include <linux/cpu.h>
 #include <linux/cpuset.h>
@@ -510,9 +511,11 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  Pages evicted by reclaim leave a
+ * shadow entry behind for refault detection.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -558,10 +561,13 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__delete_from_page_cache(page);
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -584,7 +590,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -832,6 +838,40 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * Anonymous memory given up with MADV_FREE and not written
+		 * to since can simply be dropped.  If a mapping has dirtied
+		 * it since, unmapping fails with the page dirty and it goes
+		 * to swap as usual.  Only pages still marked by MADV_FREE
+		 * pay for the extra rmap walk; a dirty one loses the mark.
+		 */
+		if (PageAnon(page) && !PageSwapCache(page) &&
+		    TestClearPageLazyFree(page) && !PageKsm(page) &&
+		    !PageDirty(page) && !PageTransHuge(page) &&
+		    page_mapped(page)) {
+			switch (try_to_unmap(page, TTU_UNMAP | TTU_LAZYFREE)) {
+			case SWAP_AGAIN:
+				SetPageLazyFree(page);
+				goto keep_locked;
+			case SWAP_MLOCK:
+				goto cull_mlocked;
+			case SWAP_SUCCESS:
+				/* Unmapped and in no cache: ours is the last ref */
+				if (!page_freeze_refs(page, 1))
+					goto keep_locked;
+				count_vm_event(PGLAZYFREED);
+				__clear_page_locked(page);
+				goto free_it;
+			case SWAP_FAIL:
+				/* Referenced or pinned, unless just dirty */
+				if (!PageDirty(page)) {
+					SetPageLazyFree(page);
+					goto activate_locked;
+				}
+				break; /* swap it out below */
+			}
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -961,7 +1001,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -2867,7 +2907,8 @@ out:
 	return order;
 }
 
-static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
+static void kswapd_try_to_sleep(pg_data_t *pgdat, int alloc_order, int order,
+				int classzone_idx)
 {
 	long remaining = 0;
 	DEFINE_WAIT(wait);
@@ -2901,6 +2942,13 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 		 */
 		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
 
+		/*
+		 * Reclaim for a high-order request is done, or has given up
+		 * on the order as fragmentation stood in the way.  Leave the
+		 * rest to kcompactd rather than to the next allocation.
+		 */
+		wakeup_kcompactd(pgdat, alloc_order, classzone_idx);
+
 		if (!kthread_should_stop())
 			schedule();
 
@@ -2990,7 +3038,7 @@ static int kswapd(void *p)
 			order = new_order;
 			classzone_idx = new_classzone_idx;
 		} else {
-			kswapd_try_to_sleep(pgdat, balanced_order,
+			kswapd_try_to_sleep(pgdat, order, balanced_order,
 						balanced_classzone_idx);
 			order = pgdat->kswapd_max_order;
 			classzone_idx = pgdat->classzone_idx;
@@ -0,0 +1,148 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Workingset detection for the page cache
+ *
+ * Reclaim sizes the active and inactive file lists with heuristics that
+ * cannot tell a page that keeps coming back from streaming I/O that is
+ * only ever used once.  Both enter the inactive list on fault, and a
+ * large enough stream of use-once pages pushes the working set out
+ * before it gets the second access that would have activated it.
+ *
+ * To see the difference, every zone keeps a clock of its inactive file
+ * list, zone->inactive_age, which advances whenever a page leaves the
+ * inactive list: when it is evicted, and when it is activated.  On
+ * eviction the current clock value is stored in the page cache slot the
+ * page occupied, as a shadow entry.  When the page is faulted back in,
+ * the difference between the clock then and the stored value is the
+ * refault distance: how many pages left the inactive list while this one
+ * was out.
+ *
+ * Had the inactive list been that many pages longer, the page would
+ * still have been in memory.  The only place such space could come from
+ * is the active list, so if the refault distance is no larger than the
+ * active file list the page is activated right away, to compete with
+ * the current active pages for the memory.  If it really is part of the
+ * working set it will stay, otherwise it gets deactivated again in the
+ * normal way and the active list shrinks in favour of the inactive one.
+ *
+ * Refaults of pages whose distance is larger than the active list are
+ * streaming I/O as far as reclaim is concerned and go to the inactive
+ * list as before.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/atomic.h>
+#include <linux/radix-tree.h>
+
+/*
+ * A shadow entry is an exceptional radix tree entry holding the node,
+ * the zone and the inactive_age of the zone at the time of eviction.
+ * Whatever bits are left over keep the clock, which is compared modulo
+ * their range.
+ */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static struct zone *unpack_shadow(void *shadow, unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction, refault;
+	struct zone *zone;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&zone->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+
+	return zone;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.  Called
+ * with the mapping's tree_lock held.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates the refault distance of the page and counts the refault.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	zone = unpack_shadow(shadow, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_shadow_stale - check whether a shadow entry is still useful
+ * @shadow: shadow entry of an evicted page
+ *
+ * A shadow whose refault distance has grown past the whole file LRU of
+ * its zone can no longer lead to an activation, and may be dropped when
+ * room is needed for newer ones.
+ */
+bool workingset_shadow_stale(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	zone = unpack_shadow(shadow, &refault_distance);
+	return refault_distance > zone_page_state(zone, NR_ACTIVE_FILE) +
+				  zone_page_state(zone, NR_INACTIVE_FILE);
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
@@ -84,6 +84,11 @@ static int br_dev_init(struct net_device *dev)
 	if (!br->stats)
 		return -ENOMEM;
 
+	if (br_fdb_hash_init(br)) {
+		free_percpu(br->stats);
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
@@ -318,6 +323,7 @@ static void br_dev_free(struct net_device *dev)
 {
 	struct net_bridge *br = netdev_priv(dev);
 
+	br_fdb_hash_fini(br);
 	free_percpu(br->stats);
 	free_netdev(dev);
 }
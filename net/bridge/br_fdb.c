@@ -21,7 +21,10 @@
 #include <linux/jhash.h>
 #include <linux/random.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <linux/atomic.h>
+#include <linux/math64.h>
 #include <asm/unaligned.h>
 #include "br_private.h"
 
@@ -56,6 +59,75 @@ void br_fdb_fini(void)
 	kmem_cache_destroy(br_fdb_cache);
 }
 
+static struct hlist_head *fdb_hash_alloc(u32 size)
+{
+	size_t sz = size * sizeof(struct hlist_head);
+
+	if (sz <= PAGE_SIZE)
+		return kzalloc(sz, GFP_KERNEL);
+	return vzalloc(sz);
+}
+
+static void fdb_hash_free(struct hlist_head *hash)
+{
+	if (is_vmalloc_addr(hash))
+		vfree(hash);
+	else
+		kfree(hash);
+}
+
+static void fdb_htable_free(struct net_bridge_fdb_htable *tbl)
+{
+	fdb_hash_free(tbl->hash);
+	kfree(tbl);
+}
+
+static struct net_bridge_fdb_htable *fdb_htable_alloc(u32 size, u32 ver)
+{
+	struct net_bridge_fdb_htable *tbl;
+
+	tbl = kmalloc(sizeof(*tbl), GFP_KERNEL);
+	if (!tbl)
+		return NULL;
+
+	tbl->hash = fdb_hash_alloc(size);
+	if (!tbl->hash) {
+		kfree(tbl);
+		return NULL;
+	}
+	tbl->size = size;
+	tbl->ver = ver;
+	tbl->old = NULL;
+	return tbl;
+}
+
+static void br_fdb_resize_work(struct work_struct *work);
+
+int br_fdb_hash_init(struct net_bridge *br)
+{
+	struct net_bridge_fdb_htable *tbl;
+
+	tbl = fdb_htable_alloc(BR_HASH_SIZE, 0);
+	if (!tbl)
+		return -ENOMEM;
+
+	RCU_INIT_POINTER(br->fdb, tbl);
+	INIT_WORK(&br->fdb_resize_work, br_fdb_resize_work);
+	br->gc_sweep_start = jiffies;
+	return 0;
+}
+
+/* All entries are gone and no resize can be pending */
+void br_fdb_hash_fini(struct net_bridge *br)
+{
+	struct net_bridge_fdb_htable *tbl = rcu_dereference_protected(br->fdb, 1);
+
+	/* wait for the previous table, freed through this one */
+	if (tbl->old)
+		rcu_barrier();
+	fdb_htable_free(tbl);
+}
+
 
 /* if topology_changing then use forward_delay (default 15 sec)
  * otherwise keep longer (default 5 minutes)
@@ -82,11 +154,89 @@ static inline int has_expired(const struct net_bridge *br,
 	return time_before_eq(fdb->updated + hold_time(br), jiffies);
 }
 
-static inline int br_mac_hash(const unsigned char *mac)
+static inline int br_mac_hash(const struct net_bridge_fdb_htable *tbl,
+			      const unsigned char *mac)
 {
 	/* use 1 byte of OUI cnd 3 bytes of NIC */
 	u32 key = get_unaligned((u32 *)(mac + 2));
-	return jhash_1word(key, fdb_salt) & (BR_HASH_SIZE - 1);
+	return jhash_1word(key, fdb_salt) & (tbl->size - 1);
+}
+
+static inline struct net_bridge_fdb_htable *
+fdb_htable(struct net_bridge *br)
+{
+	return rcu_dereference_protected(br->fdb,
+					 lockdep_is_held(&br->hash_lock));
+}
+
+static void fdb_htable_rcu_free(struct rcu_head *head)
+{
+	struct net_bridge_fdb_htable *tbl =
+		container_of(head, struct net_bridge_fdb_htable, rcu);
+	struct net_bridge_fdb_htable *old = tbl->old;
+
+	tbl->old = NULL;
+	fdb_htable_free(old);
+}
+
+/* Rehash into a table of @size buckets. Entries are linked into the
+ * other hlist of the pair, so lookups can go on in the old table until
+ * the new one is published. Takes hash_lock.
+ */
+static int fdb_htable_resize(struct net_bridge *br, u32 size)
+{
+	struct net_bridge_fdb_htable *old, *tbl;
+	struct net_bridge_fdb_entry *f;
+	struct hlist_node *h;
+	u32 i;
+
+	/* the table before the current one must be gone, its chains are
+	 * the ones about to be reused */
+	rcu_barrier();
+
+	tbl = fdb_htable_alloc(size, 0);
+	if (!tbl)
+		return -ENOMEM;
+
+	spin_lock_bh(&br->hash_lock);
+	old = fdb_htable(br);
+	if (old->old || old->size == size) {
+		spin_unlock_bh(&br->hash_lock);
+		fdb_htable_free(tbl);
+		return -EBUSY;
+	}
+
+	tbl->ver = old->ver ^ 1;
+	tbl->old = old;
+	for (i = 0; i < old->size; i++)
+		hlist_for_each_entry(f, h, &old->hash[i], hlist[old->ver])
+			hlist_add_head(&f->hlist[tbl->ver],
+				       &tbl->hash[br_mac_hash(tbl, f->addr.addr)]);
+
+	rcu_assign_pointer(br->fdb, tbl);
+	call_rcu(&tbl->rcu, fdb_htable_rcu_free);
+	br->gc_next_bucket = 0;
+	spin_unlock_bh(&br->hash_lock);
+
+	br_info(br, "fdb hash resized to %u buckets for %u entries\n",
+		size, br->fdb_count);
+	return 0;
+}
+
+static void br_fdb_resize_work(struct work_struct *work)
+{
+	struct net_bridge *br = container_of(work, struct net_bridge,
+					     fdb_resize_work);
+	u32 size;
+
+	spin_lock_bh(&br->hash_lock);
+	size = fdb_htable(br)->size;
+	while (size < BR_FDB_HASH_MAX &&
+	       br->fdb_count > size * BR_FDB_HASH_LOAD)
+		size <<= 1;
+	spin_unlock_bh(&br->hash_lock);
+
+	fdb_htable_resize(br, size);
 }
 
 static void fdb_rcu_free(struct rcu_head *head)
@@ -96,7 +246,8 @@ static void fdb_rcu_free(struct rcu_head *head)
 	kmem_cache_free(br_fdb_cache, ent);
 }
 
-static inline void fdb_delete(struct net_bridge_fdb_entry *f)
+static inline void fdb_delete(struct net_bridge *br,
+			      struct net_bridge_fdb_entry *f)
 {
 #if defined(CONFIG_MV_ETH_NFP_FDB_LEARN)
 	if (f->nfp) {
@@ -106,24 +257,28 @@ static inline void fdb_delete(struct net_bridge_fdb_entry *f)
 #endif /* CONFIG_MV_ETH_NFP_FDB_LEARN */
 
 	fdb_notify(f, RTM_DELNEIGH);
-	hlist_del_rcu(&f->hlist);
+	hlist_del_rcu(&f->hlist[fdb_htable(br)->ver]);
+	br->fdb_count--;
 	call_rcu(&f->rcu, fdb_rcu_free);
 }
 
 void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr)
 {
 	struct net_bridge *br = p->br;
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 
 	spin_lock_bh(&br->hash_lock);
+	tbl = fdb_htable(br);
 
 	/* Search all chains since old address/hash is unknown */
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	for (i = 0; i < tbl->size; i++) {
 		struct hlist_node *h;
-		hlist_for_each(h, &br->hash[i]) {
+		hlist_for_each(h, &tbl->hash[i]) {
 			struct net_bridge_fdb_entry *f;
 
-			f = hlist_entry(h, struct net_bridge_fdb_entry, hlist);
+			f = hlist_entry(h, struct net_bridge_fdb_entry,
+					hlist[tbl->ver]);
 			if (f->dst == p && f->is_local) {
 				/* maybe another port has same hw addr? */
 				struct net_bridge_port *op;
@@ -137,7 +292,7 @@ void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr)
 				}
 
 				/* delete old one */
-				fdb_delete(f);
+				fdb_delete(br, f);
 				goto insert;
 			}
 		}
@@ -149,20 +304,37 @@ void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr)
 	spin_unlock_bh(&br->hash_lock);
 }
 
+/* Ages one slice of the buckets per run rather than the whole table, so
+ * that a large fdb never holds hash_lock for long. A full sweep takes
+ * BR_FDB_GC_SLICES runs spread over a quarter of the hold time; expired
+ * entries are already ignored by lookups until the sweep reaches them.
+ */
 void br_fdb_cleanup(unsigned long _data)
 {
 	struct net_bridge *br = (struct net_bridge *)_data;
 	unsigned long delay = hold_time(br);
-	unsigned long next_timer = jiffies + br->ageing_time;
-	int i;
+	unsigned long interval;
+	struct net_bridge_fdb_htable *tbl;
+	u32 i, end;
 
 	spin_lock_bh(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	tbl = fdb_htable(br);
+	if (br->gc_next_bucket >= tbl->size)
+		br->gc_next_bucket = 0;
+	end = min_t(u32, tbl->size,
+		    br->gc_next_bucket +
+		    DIV_ROUND_UP(tbl->size, BR_FDB_GC_SLICES));
+
+	for (i = br->gc_next_bucket; i < end; i++) {
 		struct net_bridge_fdb_entry *f;
 		struct hlist_node *h, *n;
+		u32 chain = 0;
 
-		hlist_for_each_entry_safe(f, h, n, &br->hash[i], hlist) {
+		hlist_for_each_entry_safe(f, h, n, &tbl->hash[i],
+					  hlist[tbl->ver]) {
 			unsigned long this_timer;
+
+			chain++;
 			if (f->is_static)
 				continue;
 
@@ -176,28 +348,46 @@ void br_fdb_cleanup(unsigned long _data)
 
 			this_timer = f->updated + delay;
 			if (time_before_eq(this_timer, jiffies))
-				fdb_delete(f);
-			else if (time_before(this_timer, next_timer))
-				next_timer = this_timer;
+				fdb_delete(br, f);
 		}
+		if (chain > br->gc_max_chain)
+			br->gc_max_chain = chain;
+	}
+	br->gc_next_bucket = end;
+
+	if (end == tbl->size) {
+		unsigned long elapsed = jiffies - br->gc_sweep_start;
+
+		/* a full sweep is done, publish its statistics */
+		br->fdb_max_chain = br->gc_max_chain;
+		br->fdb_learn_rate = elapsed ?
+			div64_u64((u64)br->fdb_learned * HZ, elapsed) : 0;
+		br->gc_max_chain = 0;
+		br->fdb_learned = 0;
+		br->gc_sweep_start = jiffies;
+		br->gc_next_bucket = 0;
 	}
 	spin_unlock_bh(&br->hash_lock);
 
-	mod_timer(&br->gc_timer, round_jiffies_up(next_timer));
+	interval = max_t(unsigned long, delay / (4 * BR_FDB_GC_SLICES), HZ / 10);
+	mod_timer(&br->gc_timer, jiffies + interval);
 }
 
 /* Completely flush all dynamic entries in forwarding database.*/
 void br_fdb_flush(struct net_bridge *br)
 {
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 
 	spin_lock_bh(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	tbl = fdb_htable(br);
+	for (i = 0; i < tbl->size; i++) {
 		struct net_bridge_fdb_entry *f;
 		struct hlist_node *h, *n;
-		hlist_for_each_entry_safe(f, h, n, &br->hash[i], hlist) {
+		hlist_for_each_entry_safe(f, h, n, &tbl->hash[i],
+					  hlist[tbl->ver]) {
 			if (!f->is_static)
-				fdb_delete(f);
+				fdb_delete(br, f);
 		}
 	}
 	spin_unlock_bh(&br->hash_lock);
@@ -210,15 +400,18 @@ void br_fdb_delete_by_port(struct net_bridge *br,
 			   const struct net_bridge_port *p,
 			   int do_all)
 {
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 
 	spin_lock_bh(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	tbl = fdb_htable(br);
+	for (i = 0; i < tbl->size; i++) {
 		struct hlist_node *h, *g;
 
-		hlist_for_each_safe(h, g, &br->hash[i]) {
+		hlist_for_each_safe(h, g, &tbl->hash[i]) {
 			struct net_bridge_fdb_entry *f
-				= hlist_entry(h, struct net_bridge_fdb_entry, hlist);
+				= hlist_entry(h, struct net_bridge_fdb_entry,
+					      hlist[tbl->ver]);
 			if (f->dst != p)
 				continue;
 
@@ -241,7 +434,7 @@ void br_fdb_delete_by_port(struct net_bridge *br,
 				}
 			}
 
-			fdb_delete(f);
+			fdb_delete(br, f);
 		skip_delete: ;
 		}
 	}
@@ -252,10 +445,12 @@ void br_fdb_delete_by_port(struct net_bridge *br,
 struct net_bridge_fdb_entry *__br_fdb_get(struct net_bridge *br,
 					  const unsigned char *addr)
 {
+	struct net_bridge_fdb_htable *tbl = rcu_dereference(br->fdb);
 	struct hlist_node *h;
 	struct net_bridge_fdb_entry *fdb;
 
-	hlist_for_each_entry_rcu(fdb, h, &br->hash[br_mac_hash(addr)], hlist) {
+	hlist_for_each_entry_rcu(fdb, h, &tbl->hash[br_mac_hash(tbl, addr)],
+				 hlist[tbl->ver]) {
 		if (!compare_ether_addr(fdb->addr.addr, addr)) {
 			if (unlikely(has_expired(br, fdb)))
 				break;
@@ -299,14 +494,16 @@ int br_fdb_fillbuf(struct net_bridge *br, void *buf,
 {
 	struct __fdb_entry *fe = buf;
 	int i, num = 0;
+	struct net_bridge_fdb_htable *tbl;
 	struct hlist_node *h;
 	struct net_bridge_fdb_entry *f;
 
 	memset(buf, 0, maxnum*sizeof(struct __fdb_entry));
 
 	rcu_read_lock();
-	for (i = 0; i < BR_HASH_SIZE; i++) {
-		hlist_for_each_entry_rcu(f, h, &br->hash[i], hlist) {
+	tbl = rcu_dereference(br->fdb);
+	for (i = 0; i < tbl->size; i++) {
+		hlist_for_each_entry_rcu(f, h, &tbl->hash[i], hlist[tbl->ver]) {
 			if (num >= maxnum)
 				goto out;
 
@@ -339,36 +536,43 @@ int br_fdb_fillbuf(struct net_bridge *br, void *buf,
 	return num;
 }
 
-static struct net_bridge_fdb_entry *fdb_find(struct hlist_head *head,
+/* Must be called with hash_lock held */
+static struct net_bridge_fdb_entry *fdb_find(struct net_bridge *br,
 					     const unsigned char *addr)
 {
+	struct net_bridge_fdb_htable *tbl = fdb_htable(br);
 	struct hlist_node *h;
 	struct net_bridge_fdb_entry *fdb;
 
-	hlist_for_each_entry(fdb, h, head, hlist) {
+	hlist_for_each_entry(fdb, h, &tbl->hash[br_mac_hash(tbl, addr)],
+			     hlist[tbl->ver]) {
 		if (!compare_ether_addr(fdb->addr.addr, addr))
 			return fdb;
 	}
 	return NULL;
 }
 
-static struct net_bridge_fdb_entry *fdb_find_rcu(struct hlist_head *head,
+static struct net_bridge_fdb_entry *fdb_find_rcu(struct net_bridge *br,
 						 const unsigned char *addr)
 {
+	struct net_bridge_fdb_htable *tbl = rcu_dereference(br->fdb);
 	struct hlist_node *h;
 	struct net_bridge_fdb_entry *fdb;
 
-	hlist_for_each_entry_rcu(fdb, h, head, hlist) {
+	hlist_for_each_entry_rcu(fdb, h, &tbl->hash[br_mac_hash(tbl, addr)],
+				 hlist[tbl->ver]) {
 		if (!compare_ether_addr(fdb->addr.addr, addr))
 			return fdb;
 	}
 	return NULL;
 }
 
-static struct net_bridge_fdb_entry *fdb_create(struct hlist_head *head,
+/* Must be called with hash_lock held */
+static struct net_bridge_fdb_entry *fdb_create(struct net_bridge *br,
 					       struct net_bridge_port *source,
 					       const unsigned char *addr, int is_local)
 {
+	struct net_bridge_fdb_htable *tbl = fdb_htable(br);
 	struct net_bridge_fdb_entry *fdb;
 
 	fdb = kmem_cache_alloc(br_fdb_cache, GFP_ATOMIC);
@@ -378,7 +582,14 @@ static struct net_bridge_fdb_entry *fdb_create(struct hlist_head *head,
 		fdb->is_local = is_local;
 		fdb->is_static = is_local;
 		fdb->updated = fdb->used = jiffies;
-		hlist_add_head_rcu(&fdb->hlist, head);
+		hlist_add_head_rcu(&fdb->hlist[tbl->ver],
+				   &tbl->hash[br_mac_hash(tbl, addr)]);
+
+		if (!is_local)
+			br->fdb_learned++;
+		if (++br->fdb_count > tbl->size * BR_FDB_HASH_LOAD &&
+		    tbl->size < BR_FDB_HASH_MAX)
+			schedule_work(&br->fdb_resize_work);
 
 #if defined(CONFIG_MV_ETH_NFP_FDB_LEARN)
 		fdb->nfp = false;
@@ -392,13 +603,12 @@ static struct net_bridge_fdb_entry *fdb_create(struct hlist_head *head,
 static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 		  const unsigned char *addr)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
 	struct net_bridge_fdb_entry *fdb;
 
 	if (!is_valid_ether_addr(addr))
 		return -EINVAL;
 
-	fdb = fdb_find(head, addr);
+	fdb = fdb_find(br, addr);
 	if (fdb) {
 		/* it is okay to have multiple ports with same
 		 * address, just use the first one.
@@ -408,10 +618,10 @@ static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 		br_warn(br, "adding interface %s with same address "
 		       "as a received packet\n",
 		       source->dev->name);
-		fdb_delete(fdb);
+		fdb_delete(br, fdb);
 	}
 
-	fdb = fdb_create(head, source, addr, 1);
+	fdb = fdb_create(br, source, addr, 1);
 	if (!fdb)
 		return -ENOMEM;
 
@@ -434,7 +644,6 @@ int br_fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		   const unsigned char *addr)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
 	struct net_bridge_fdb_entry *fdb;
 
 	/* some users want to always flood. */
@@ -446,7 +655,7 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 	      source->state == BR_STATE_FORWARDING))
 		return;
 
-	fdb = fdb_find_rcu(head, addr);
+	fdb = fdb_find_rcu(br, addr);
 	if (likely(fdb)) {
 		/* attempt to update an entry for a local interface */
 		if (unlikely(fdb->is_local)) {
@@ -461,8 +670,8 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		}
 	} else {
 		spin_lock(&br->hash_lock);
-		if (likely(!fdb_find(head, addr)))
-			fdb_create(head, source, addr, 0);
+		if (likely(!fdb_find(br, addr)))
+			fdb_create(br, source, addr, 0);
 
 		/* else  we lose race and someone else inserts
 		 * it first, don't bother updating
@@ -562,16 +771,19 @@ int br_fdb_dump(struct sk_buff *skb, struct netlink_callback *cb)
 	rcu_read_lock();
 	for_each_netdev_rcu(net, dev) {
 		struct net_bridge *br = netdev_priv(dev);
+		struct net_bridge_fdb_htable *tbl;
 		int i;
 
 		if (!(dev->priv_flags & IFF_EBRIDGE))
 			continue;
 
-		for (i = 0; i < BR_HASH_SIZE; i++) {
+		tbl = rcu_dereference(br->fdb);
+		for (i = 0; i < tbl->size; i++) {
 			struct hlist_node *h;
 			struct net_bridge_fdb_entry *f;
 
-			hlist_for_each_entry_rcu(f, h, &br->hash[i], hlist) {
+			hlist_for_each_entry_rcu(f, h, &tbl->hash[i],
+						 hlist[tbl->ver]) {
 				if (idx < cb->args[0])
 					goto skip;
 
@@ -598,15 +810,14 @@ static int fdb_add_entry(struct net_bridge_port *source, const __u8 *addr,
 			 __u16 state, __u16 flags)
 {
 	struct net_bridge *br = source->br;
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
 	struct net_bridge_fdb_entry *fdb;
 
-	fdb = fdb_find(head, addr);
+	fdb = fdb_find(br, addr);
 	if (fdb == NULL) {
 		if (!(flags & NLM_F_CREATE))
 			return -ENOENT;
 
-		fdb = fdb_create(head, source, addr,0);
+		fdb = fdb_create(br, source, addr, 0);
 		if (!fdb)
 			return -ENOMEM;
 	} else {
@@ -681,14 +892,13 @@ int br_fdb_add(struct sk_buff *skb, struct nlmsghdr *nlh, void *arg)
 static int fdb_delete_by_addr(struct net_bridge_port *p, const u8 *addr)
 {
 	struct net_bridge *br = p->br;
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
 	struct net_bridge_fdb_entry *fdb;
 
-	fdb = fdb_find(head, addr);
+	fdb = fdb_find(br, addr);
 	if (!fdb)
 		return -ENOENT;
 
-	fdb_delete(fdb);
+	fdb_delete(br, fdb);
 	return 0;
 }
 
@@ -746,17 +956,20 @@ void fdb_sync(void)
 {
 	struct net_device *dev;
 	struct net_bridge *br;
+	struct net_bridge_fdb_htable *tbl;
 	int i;
 	rtnl_lock();
 	for_each_netdev(&init_net, dev) {
 		if (dev->priv_flags & IFF_EBRIDGE) {
 			br = netdev_priv(dev);
 			spin_lock_bh(&br->hash_lock);
-			for (i = 0; i < BR_HASH_SIZE; i++) {
+			tbl = fdb_htable(br);
+			for (i = 0; i < tbl->size; i++) {
 				struct net_bridge_fdb_entry *fdb;
 				struct hlist_node *h, *n;
 
-				hlist_for_each_entry_safe(fdb, h, n, &br->hash[i], hlist) {
+				hlist_for_each_entry_safe(fdb, h, n, &tbl->hash[i],
+							  hlist[tbl->ver]) {
 					if (!nfp_hook_fdb_rule_add(fdb->dst->br->dev->ifindex,
 							       fdb->dst->dev->ifindex,
 							       fdb->addr.addr,
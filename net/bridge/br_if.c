@@ -181,6 +181,7 @@ void br_dev_delete(struct net_device *dev, struct list_head *head)
 	}
 
 	del_timer_sync(&br->gc_timer);
+	cancel_work_sync(&br->fdb_resize_work);
 
 #if defined(CONFIG_MV_ETH_NFP_FDB_LEARN)
 	nfp_hook_del_br(br->dev->ifindex);
@@ -22,6 +22,15 @@
 #define BR_HASH_BITS 8
 #define BR_HASH_SIZE (1 << BR_HASH_BITS)
 
+/* The fdb hash starts at BR_HASH_SIZE buckets and doubles whenever it
+ * averages more than BR_FDB_HASH_LOAD entries per bucket.
+ */
+#define BR_FDB_HASH_MAX		(1 << 16)
+#define BR_FDB_HASH_LOAD	2
+
+/* Every gc_timer run ages 1/BR_FDB_GC_SLICES of the fdb buckets */
+#define BR_FDB_GC_SLICES	16
+
 #define BR_HOLD_TIME (1*HZ)
 
 #define BR_PORT_BITS	10
@@ -65,7 +74,7 @@ struct br_ip
 
 struct net_bridge_fdb_entry
 {
-	struct hlist_node		hlist;
+	struct hlist_node		hlist[2];
 	struct net_bridge_port		*dst;
 
 	struct rcu_head			rcu;
@@ -180,6 +189,18 @@ struct br_cpu_netstats {
 	struct u64_stats_sync	syncp;
 };
 
+/* Like the mdb table: entries are linked through hlist[ver], so that a
+ * resize can build the new chains while readers still walk the old ones.
+ */
+struct net_bridge_fdb_htable
+{
+	struct hlist_head		*hash;
+	struct rcu_head			rcu;
+	struct net_bridge_fdb_htable	*old;
+	u32				size;
+	u32				ver;
+};
+
 struct net_bridge
 {
 	spinlock_t			lock;
@@ -188,7 +209,17 @@ struct net_bridge
 
 	struct br_cpu_netstats __percpu *stats;
 	spinlock_t			hash_lock;
-	struct hlist_head		hash[BR_HASH_SIZE];
+	struct net_bridge_fdb_htable __rcu *fdb;
+	u32				fdb_count;
+	struct work_struct		fdb_resize_work;
+
+	/* incremental aging state and statistics, under hash_lock */
+	u32				gc_next_bucket;
+	u32				gc_max_chain;
+	u32				fdb_max_chain;
+	u32				fdb_learned;
+	u32				fdb_learn_rate;
+	unsigned long			gc_sweep_start;
 #ifdef CONFIG_BRIDGE_NETFILTER
 	struct rtable 			fake_rtable;
 	bool				nf_call_iptables;
@@ -345,6 +376,8 @@ static inline void br_netpoll_disable(struct net_bridge_port *p)
 /* br_fdb.c */
 extern int br_fdb_init(void);
 extern void br_fdb_fini(void);
+extern int br_fdb_hash_init(struct net_bridge *br);
+extern void br_fdb_hash_fini(struct net_bridge *br);
 extern void br_fdb_flush(struct net_bridge *br);
 extern void br_fdb_changeaddr(struct net_bridge_port *p,
 			      const unsigned char *newaddr);
@@ -282,6 +282,43 @@ static ssize_t show_gc_timer(struct device *d, struct device_attribute *attr,
 }
 static DEVICE_ATTR(gc_timer, S_IRUGO, show_gc_timer, NULL);
 
+static ssize_t show_fdb_count(struct device *d, struct device_attribute *attr,
+			      char *buf)
+{
+	struct net_bridge *br = to_bridge(d);
+	return sprintf(buf, "%u\n", br->fdb_count);
+}
+static DEVICE_ATTR(fdb_count, S_IRUGO, show_fdb_count, NULL);
+
+static ssize_t show_fdb_hash_size(struct device *d,
+				  struct device_attribute *attr, char *buf)
+{
+	struct net_bridge *br = to_bridge(d);
+	u32 size;
+
+	rcu_read_lock();
+	size = rcu_dereference(br->fdb)->size;
+	rcu_read_unlock();
+	return sprintf(buf, "%u\n", size);
+}
+static DEVICE_ATTR(fdb_hash_size, S_IRUGO, show_fdb_hash_size, NULL);
+
+static ssize_t show_fdb_max_chain(struct device *d,
+				  struct device_attribute *attr, char *buf)
+{
+	struct net_bridge *br = to_bridge(d);
+	return sprintf(buf, "%u\n", br->fdb_max_chain);
+}
+static DEVICE_ATTR(fdb_max_chain, S_IRUGO, show_fdb_max_chain, NULL);
+
+static ssize_t show_fdb_learn_rate(struct device *d,
+				   struct device_attribute *attr, char *buf)
+{
+	struct net_bridge *br = to_bridge(d);
+	return sprintf(buf, "%u\n", br->fdb_learn_rate);
+}
+static DEVICE_ATTR(fdb_learn_rate, S_IRUGO, show_fdb_learn_rate, NULL);
+
 static ssize_t show_group_addr(struct device *d,
 			       struct device_attribute *attr, char *buf)
 {
@@ -697,6 +734,10 @@ static struct attribute *bridge_attrs[] = {
 	&dev_attr_tcn_timer.attr,
 	&dev_attr_topology_change_timer.attr,
 	&dev_attr_gc_timer.attr,
+	&dev_attr_fdb_count.attr,
+	&dev_attr_fdb_hash_size.attr,
+	&dev_attr_fdb_max_chain.attr,
+	&dev_attr_fdb_learn_rate.attr,
 	&dev_attr_group_addr.attr,
 	&dev_attr_flush.attr,
 #ifdef CONFIG_BRIDGE_IGMP_SNOOPING
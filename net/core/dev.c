@@ -4238,10 +4238,13 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct softnet_data *sd = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x"
+		   " %08x %08x %08x %08x\n",
 		   sd->processed, sd->dropped, sd->time_squeeze, 0,
 		   0, 0, 0, 0, /* was fastroute */
-		   sd->cpu_collision, sd->received_rps);
+		   sd->cpu_collision, sd->received_rps,
+		   sd->recycle_hit, sd->recycle_miss,
+		   sd->recycle_put, sd->recycle_full);
 	return 0;
 }
 
@@ -6338,6 +6341,8 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 		input_queue_head_incr(oldsd);
 	}
 
+	skb_recycle_flush(oldsd);
+
 	return NOTIFY_OK;
 }
 
@@ -40,6 +40,7 @@ struct flow_cache_entry {
 
 struct flow_cache_percpu {
 	struct hlist_head		*hash_table;
+	u32				hash_shift;
 	int				hash_count;
 	u32				hash_rnd;
 	int				hash_rnd_recalc;
@@ -50,6 +51,9 @@ struct flow_flush_info {
 	struct flow_cache		*cache;
 	atomic_t			cpuleft;
 	struct completion		completion;
+	/* resize: new tables by cpu, swapped for the old ones */
+	struct hlist_head		**tables;
+	u32				shift;
 };
 
 struct flow_cache {
@@ -69,8 +73,14 @@ static struct kmem_cache *flow_cachep __read_mostly;
 static DEFINE_SPINLOCK(flow_cache_gc_lock);
 static LIST_HEAD(flow_cache_gc_list);
 
+/* Takes either the flow_cache, for the size new tables get, or a
+ * flow_cache_percpu, for the size of that cpu's table. They differ
+ * while a resize is in progress and on cpus that were offline during one.
+ */
 #define flow_cache_hash_size(cache)	(1 << (cache)->hash_shift)
 #define FLOW_HASH_RND_PERIOD		(10 * 60 * HZ)
+#define FLOW_HASH_SHIFT_MIN		4
+#define FLOW_HASH_SHIFT_MAX		16
 
 static void flow_cache_new_hashrnd(unsigned long arg)
 {
@@ -136,7 +146,7 @@ static void __flow_cache_shrink(struct flow_cache *fc,
 	LIST_HEAD(gc_list);
 	int i, deleted = 0;
 
-	for (i = 0; i < flow_cache_hash_size(fc); i++) {
+	for (i = 0; i < flow_cache_hash_size(fcp); i++) {
 		int saved = 0;
 
 		hlist_for_each_entry_safe(fle, entry, tmp,
@@ -158,7 +168,7 @@ static void __flow_cache_shrink(struct flow_cache *fc,
 static void flow_cache_shrink(struct flow_cache *fc,
 			      struct flow_cache_percpu *fcp)
 {
-	int shrink_to = fc->low_watermark / flow_cache_hash_size(fc);
+	int shrink_to = fc->low_watermark / flow_cache_hash_size(fcp);
 
 	__flow_cache_shrink(fc, fcp, shrink_to);
 }
@@ -180,7 +190,7 @@ static u32 flow_hash_code(struct flow_cache *fc,
 	const u32 length = keysize * sizeof(flow_compare_t) / sizeof(u32);
 
 	return jhash2(k, length, fcp->hash_rnd)
-		& (flow_cache_hash_size(fc) - 1);
+		& (flow_cache_hash_size(fcp) - 1);
 }
 
 /* I hear what you're saying, use memcmp.  But memcmp cannot make
@@ -306,10 +316,10 @@ static void flow_cache_flush_tasklet(unsigned long data)
 	int i, deleted = 0;
 
 	fcp = this_cpu_ptr(fc->percpu);
-	for (i = 0; i < flow_cache_hash_size(fc); i++) {
+	for (i = 0; i < flow_cache_hash_size(fcp); i++) {
 		hlist_for_each_entry_safe(fle, entry, tmp,
 					  &fcp->hash_table[i], u.hlist) {
-			if (flow_entry_valid(fle))
+			if (!info->tables && flow_entry_valid(fle))
 				continue;
 
 			deleted++;
@@ -320,6 +330,13 @@ static void flow_cache_flush_tasklet(unsigned long data)
 
 	flow_cache_queue_garbage(fcp, deleted, &gc_list);
 
+	if (info->tables) {
+		/* Lookups on this cpu run with BH off, so the empty old table
+		 * can be exchanged for the new one here and freed later. */
+		swap(fcp->hash_table, info->tables[smp_processor_id()]);
+		fcp->hash_shift = info->shift;
+	}
+
 	if (atomic_dec_and_test(&info->cpuleft))
 		complete(&info->completion);
 }
@@ -336,26 +353,88 @@ static void flow_cache_flush_per_cpu(void *data)
 	tasklet_schedule(tasklet);
 }
 
+static DEFINE_MUTEX(flow_flush_sem);
+
+/* Caller holds flow_flush_sem and the cpu hotplug lock */
+static void __flow_cache_flush(struct flow_flush_info *info)
+{
+	atomic_set(&info->cpuleft, num_online_cpus());
+	init_completion(&info->completion);
+
+	local_bh_disable();
+	smp_call_function(flow_cache_flush_per_cpu, info, 0);
+	flow_cache_flush_tasklet((unsigned long)info);
+	local_bh_enable();
+
+	wait_for_completion(&info->completion);
+}
+
 void flow_cache_flush(void)
 {
 	struct flow_flush_info info;
-	static DEFINE_MUTEX(flow_flush_sem);
 
 	/* Don't want cpus going down or up during this. */
 	get_online_cpus();
 	mutex_lock(&flow_flush_sem);
 	info.cache = &flow_cache_global;
-	atomic_set(&info.cpuleft, num_online_cpus());
-	init_completion(&info.completion);
+	info.tables = NULL;
+	__flow_cache_flush(&info);
+	mutex_unlock(&flow_flush_sem);
+	put_online_cpus();
+}
 
-	local_bh_disable();
-	smp_call_function(flow_cache_flush_per_cpu, &info, 0);
-	flow_cache_flush_tasklet((unsigned long)&info);
-	local_bh_enable();
+unsigned int flow_cache_hash_shift(void)
+{
+	return flow_cache_global.hash_shift;
+}
+
+/* Empties the cache and gives every online cpu a table of 2^shift
+ * buckets. Cpus that are offline keep their current table until they
+ * are brought up again after a flush.
+ */
+int flow_cache_resize(unsigned int shift)
+{
+	struct flow_cache *fc = &flow_cache_global;
+	struct flow_flush_info info;
+	int cpu, err = 0;
+
+	if (shift < FLOW_HASH_SHIFT_MIN || shift > FLOW_HASH_SHIFT_MAX)
+		return -EINVAL;
+
+	info.tables = kcalloc(nr_cpu_ids, sizeof(*info.tables), GFP_KERNEL);
+	if (!info.tables)
+		return -ENOMEM;
 
-	wait_for_completion(&info.completion);
+	get_online_cpus();
+	mutex_lock(&flow_flush_sem);
+	if (!fc->percpu || shift == fc->hash_shift)
+		goto out;
+
+	for_each_online_cpu(cpu) {
+		info.tables[cpu] = kzalloc_node(sizeof(struct hlist_head) << shift,
+						GFP_KERNEL, cpu_to_node(cpu));
+		if (!info.tables[cpu]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	info.cache = fc;
+	info.shift = shift;
+	__flow_cache_flush(&info);
+
+	fc->hash_shift = shift;
+	fc->low_watermark = 2 * flow_cache_hash_size(fc);
+	fc->high_watermark = 4 * flow_cache_hash_size(fc);
+out:
 	mutex_unlock(&flow_flush_sem);
 	put_online_cpus();
+
+	/* Now the old tables, or the new ones if we failed */
+	for_each_possible_cpu(cpu)
+		kfree(info.tables[cpu]);
+	kfree(info.tables);
+	return err;
 }
 
 static void flow_cache_flush_task(struct work_struct *work)
@@ -381,6 +460,7 @@ static int __cpuinit flow_cache_cpu_prepare(struct flow_cache *fc, int cpu)
 			pr_err("NET: failed to allocate flow cache sz %zu\n", sz);
 			return -ENOMEM;
 		}
+		fcp->hash_shift = fc->hash_shift;
 		fcp->hash_rnd_recalc = 1;
 		fcp->hash_count = 0;
 		tasklet_init(&fcp->flush_tasklet, flow_cache_flush_tasklet, 0);
@@ -305,6 +305,33 @@ static ssize_t store_group(struct device *dev, struct device_attribute *attr,
 	return netdev_store(dev, attr, buf, len, change_group);
 }
 
+static ssize_t format_skb_recycle(const struct net_device *net, char *buf)
+{
+	return sprintf(buf, fmt_dec, !!(net->priv_flags & IFF_SKB_RECYCLE));
+}
+
+static ssize_t show_skb_recycle(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	return netdev_show(dev, attr, buf, format_skb_recycle);
+}
+
+static int change_skb_recycle(struct net_device *net, unsigned long on)
+{
+	if (on)
+		net->priv_flags |= IFF_SKB_RECYCLE;
+	else
+		net->priv_flags &= ~IFF_SKB_RECYCLE;
+	return 0;
+}
+
+static ssize_t store_skb_recycle(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t len)
+{
+	return netdev_store(dev, attr, buf, len, change_skb_recycle);
+}
+
 static struct device_attribute net_class_attributes[] = {
 	__ATTR(addr_assign_type, S_IRUGO, show_addr_assign_type, NULL),
 	__ATTR(addr_len, S_IRUGO, show_addr_len, NULL),
@@ -326,6 +353,8 @@ static struct device_attribute net_class_attributes[] = {
 	__ATTR(tx_queue_len, S_IRUGO | S_IWUSR, show_tx_queue_len,
 	       store_tx_queue_len),
 	__ATTR(netdev_group, S_IRUGO | S_IWUSR, show_group, store_group),
+	__ATTR(skb_recycle, S_IRUGO | S_IWUSR, show_skb_recycle,
+	       store_skb_recycle),
 	{}
 };
 
@@ -114,6 +114,9 @@
  * Fixed src_mac command to set source mac of packet to value specified in
  * command by Adit Ranadive <adit.262@gmail.com>
  *
+ * IMIX packet sizes, transmit bursts and a receive side latency histogram
+ * for on-box tests.
+ *
  */
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
@@ -173,9 +176,11 @@
 #include <asm/dma.h>
 #include <asm/div64.h>		/* do_div */
 
-#define VERSION	"2.74"
+#define VERSION	"2.75"
 #define IP_NAME_SZ 32
 #define MAX_MPLS_LABELS 16 /* This is the max label stack depth */
+#define MAX_IMIX_ENTRIES 20
+#define IMIX_PRECISION 100 /* Precision of IMIX distribution */
 #define MPLS_STACK_BOTTOM htonl(0x00000100)
 
 #define func_enter() pr_debug("entering %s\n", __func__);
@@ -212,6 +217,7 @@
 #define PKTGEN_MAGIC 0xbe9be955
 #define PG_PROC_DIR "pktgen"
 #define PGCTRL	    "pgctrl"
+#define PGRX	    "pgrx"
 static struct proc_dir_entry *pg_proc_dir;
 
 #define MAX_CFLOWS  65536
@@ -231,6 +237,12 @@ struct flow_state {
 /* flow flag bits */
 #define F_INIT   (1<<0)		/* flow has been initialized */
 
+struct imix_pkt {
+	u64 size;
+	u64 weight;
+	u64 count_so_far;
+};
+
 struct pktgen_dev {
 	/*
 	 * Try to keep frequent/infrequent used vars. separated.
@@ -250,6 +262,14 @@ struct pktgen_dev {
 
 	int min_pkt_size;	/* = ETH_ZLEN; */
 	int max_pkt_size;	/* = ETH_ZLEN; */
+
+	/* IMIX: packet sizes drawn by weight, overriding min/max */
+	unsigned int n_imix;
+	struct imix_pkt imix_entries[MAX_IMIX_ENTRIES];
+	/* Maps 0..IMIX_PRECISION-1 to an entry according to its weight */
+	__u8 imix_distribution[IMIX_PRECISION];
+	unsigned int cur_imix_entry;
+
 	int pkt_overhead;	/* overhead for MPLS, VLANs, IPSEC etc */
 	int nfrags;
 	struct page *page;
@@ -284,6 +304,9 @@ struct pktgen_dev {
 				 * before creating a new packet,
 				 * set clone_skb to 1024.
 				 */
+	int burst;		/* Number of times the skb is handed to
+				 * the driver per lock of the tx queue.
+				 */
 
 	char dst_min[IP_NAME_SZ];	/* IP, ie 1.2.3.4 */
 	char dst_max[IP_NAME_SZ];	/* IP, ie 1.2.3.4 */
@@ -464,6 +487,199 @@ static struct notifier_block pktgen_notifier_block = {
 	.notifier_call = pktgen_device_event,
 };
 
+/*
+ * Receive side: pktgen packets arriving on one device are counted and the
+ * time since they were stamped by the sender goes into a log2 histogram
+ * of microseconds. Meant for on-box tests, where both ends read the same
+ * clock, e.g. sending on one end of a veth pair and receiving on the other.
+ */
+
+#define PKTGEN_RX_BUCKETS 24	/* up to 2^23 usec */
+
+struct pktgen_rx_stats {
+	u64 packets;
+	u64 bytes;
+	u64 lat_sum;		/* usec */
+	u32 lat_min;
+	u32 lat_max;
+	u64 hist[PKTGEN_RX_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct pktgen_rx_stats, pktgen_rx_stats);
+static DEFINE_MUTEX(pktgen_rx_lock);
+static struct net_device *pktgen_rx_dev;
+
+static int pktgen_rcv(struct sk_buff *skb, struct net_device *dev,
+		      struct packet_type *pt, struct net_device *orig_dev)
+{
+	struct pktgen_rx_stats *stats;
+	struct pktgen_hdr _pgh;
+	const struct pktgen_hdr *pgh;
+	unsigned int offset;
+	s64 lat;
+	u32 usec;
+
+	if (skb->protocol == htons(ETH_P_IP)) {
+		const struct iphdr *iph;
+		struct iphdr _iph;
+
+		iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+		if (!iph || iph->protocol != IPPROTO_UDP)
+			goto out;
+		offset = iph->ihl * 4;
+	} else {
+		const struct ipv6hdr *ip6h;
+		struct ipv6hdr _ip6h;
+
+		ip6h = skb_header_pointer(skb, 0, sizeof(_ip6h), &_ip6h);
+		if (!ip6h || ip6h->nexthdr != IPPROTO_UDP)
+			goto out;
+		offset = sizeof(*ip6h);
+	}
+
+	pgh = skb_header_pointer(skb, offset + sizeof(struct udphdr),
+				 sizeof(_pgh), &_pgh);
+	if (!pgh || pgh->pgh_magic != htonl(PKTGEN_MAGIC))
+		goto out;
+
+	lat = ktime_to_us(ktime_get_real()) -
+	      ((s64)ntohl(pgh->tv_sec) * USEC_PER_SEC + ntohl(pgh->tv_usec));
+	usec = lat < 0 ? 0 : min_t(s64, lat, UINT_MAX);
+
+	stats = &__get_cpu_var(pktgen_rx_stats);
+	stats->packets++;
+	stats->bytes += skb->len;
+	stats->lat_sum += usec;
+	if (usec < stats->lat_min)
+		stats->lat_min = usec;
+	if (usec > stats->lat_max)
+		stats->lat_max = usec;
+	stats->hist[min_t(int, fls(usec), PKTGEN_RX_BUCKETS - 1)]++;
+out:
+	kfree_skb(skb);
+	return NET_RX_SUCCESS;
+}
+
+static struct packet_type pktgen_rx_pt __read_mostly = {
+	.type = cpu_to_be16(ETH_P_IP),
+	.func = pktgen_rcv,
+};
+
+static struct packet_type pktgen_rx_pt6 __read_mostly = {
+	.type = cpu_to_be16(ETH_P_IPV6),
+	.func = pktgen_rcv,
+};
+
+/* Caller must hold pktgen_rx_lock */
+static void pktgen_rx_reset(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct pktgen_rx_stats *stats = &per_cpu(pktgen_rx_stats, cpu);
+
+		memset(stats, 0, sizeof(*stats));
+		stats->lat_min = UINT_MAX;
+	}
+}
+
+/* Caller must hold pktgen_rx_lock */
+static void pktgen_rx_stop(void)
+{
+	if (!pktgen_rx_dev)
+		return;
+	dev_remove_pack(&pktgen_rx_pt);
+	dev_remove_pack(&pktgen_rx_pt6);
+	dev_put(pktgen_rx_dev);
+	pktgen_rx_dev = NULL;
+}
+
+static int pktgen_rx_start(const char *ifname)
+{
+	struct net_device *dev = dev_get_by_name(&init_net, ifname);
+
+	if (!dev)
+		return -ENODEV;
+
+	mutex_lock(&pktgen_rx_lock);
+	/* dev_remove_pack() waits in synchronize_net() for receives still
+	 * running the old handlers, so the counters are quiet when reset. */
+	pktgen_rx_stop();
+	pktgen_rx_reset();
+	pktgen_rx_dev = dev;
+	pktgen_rx_pt.dev = dev;
+	pktgen_rx_pt6.dev = dev;
+	dev_add_pack(&pktgen_rx_pt);
+	dev_add_pack(&pktgen_rx_pt6);
+	mutex_unlock(&pktgen_rx_lock);
+	return 0;
+}
+
+static int pgrx_show(struct seq_file *seq, void *v)
+{
+	struct pktgen_rx_stats sum;
+	int cpu, i, last = -1;
+
+	memset(&sum, 0, sizeof(sum));
+	sum.lat_min = UINT_MAX;
+	for_each_possible_cpu(cpu) {
+		const struct pktgen_rx_stats *stats =
+			&per_cpu(pktgen_rx_stats, cpu);
+
+		sum.packets += stats->packets;
+		sum.bytes += stats->bytes;
+		sum.lat_sum += stats->lat_sum;
+		sum.lat_min = min(sum.lat_min, stats->lat_min);
+		sum.lat_max = max(sum.lat_max, stats->lat_max);
+		for (i = 0; i < PKTGEN_RX_BUCKETS; i++)
+			sum.hist[i] += stats->hist[i];
+	}
+
+	mutex_lock(&pktgen_rx_lock);
+	seq_printf(seq, "Device: %s\n",
+		   pktgen_rx_dev ? pktgen_rx_dev->name : "none");
+	mutex_unlock(&pktgen_rx_lock);
+
+	seq_printf(seq, "Received: %llu pkts  %llu bytes\n",
+		   (unsigned long long)sum.packets,
+		   (unsigned long long)sum.bytes);
+	if (!sum.packets)
+		return 0;
+
+	seq_printf(seq, "Latency: min %u  avg %llu  max %u usec\n",
+		   sum.lat_min,
+		   (unsigned long long)div64_u64(sum.lat_sum, sum.packets),
+		   sum.lat_max);
+
+	for (i = 0; i < PKTGEN_RX_BUCKETS; i++)
+		if (sum.hist[i])
+			last = i;
+	seq_puts(seq, "Histogram (usec):\n");
+	for (i = 0; i <= last; i++) {
+		if (!i)
+			seq_printf(seq, "     %8s", "0");
+		else if (i == PKTGEN_RX_BUCKETS - 1)
+			seq_printf(seq, "     %7u+", 1U << (i - 1));
+		else
+			seq_printf(seq, "     %8u", 1U << (i - 1));
+		seq_printf(seq, ": %llu\n", (unsigned long long)sum.hist[i]);
+	}
+	return 0;
+}
+
+static int pgrx_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pgrx_show, NULL);
+}
+
+static const struct file_operations pktgen_rx_fops = {
+	.owner   = THIS_MODULE,
+	.open    = pgrx_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
 /*
  * /proc handling functions
  *
@@ -504,6 +720,24 @@ static ssize_t pgctrl_write(struct file *file, const char __user *buf,
 	else if (!strcmp(data, "reset"))
 		pktgen_reset_all_threads();
 
+	else if (!strncmp(data, "rx ", 3)) {
+		err = pktgen_rx_start(strim(data + 3));
+		if (err)
+			goto out;
+	}
+
+	else if (!strcmp(data, "rx_reset")) {
+		mutex_lock(&pktgen_rx_lock);
+		pktgen_rx_reset();
+		mutex_unlock(&pktgen_rx_lock);
+	}
+
+	else if (!strcmp(data, "rx_stop")) {
+		mutex_lock(&pktgen_rx_lock);
+		pktgen_rx_stop();
+		mutex_unlock(&pktgen_rx_lock);
+	}
+
 	else
 		pr_warning("Unknown command: %s\n", data);
 
@@ -546,6 +780,20 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 	seq_printf(seq, "     flows: %u flowlen: %u\n", pkt_dev->cflows,
 		   pkt_dev->lflow);
 
+	if (pkt_dev->burst > 1)
+		seq_printf(seq, "     burst: %d\n", pkt_dev->burst);
+
+	if (pkt_dev->n_imix) {
+		unsigned int i;
+
+		seq_puts(seq, "     imix_weights: ");
+		for (i = 0; i < pkt_dev->n_imix; i++)
+			seq_printf(seq, "%llu,%llu ",
+				   pkt_dev->imix_entries[i].size,
+				   pkt_dev->imix_entries[i].weight);
+		seq_puts(seq, "\n");
+	}
+
 	seq_printf(seq,
 		   "     queue_map_min: %u  queue_map_max: %u\n",
 		   pkt_dev->queue_map_min,
@@ -712,6 +960,17 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 
 	seq_printf(seq, "     flows: %u\n", pkt_dev->nflows);
 
+	if (pkt_dev->n_imix) {
+		unsigned int i;
+
+		seq_puts(seq, "     imix_size_counts: ");
+		for (i = 0; i < pkt_dev->n_imix; i++)
+			seq_printf(seq, "%llu,%llu ",
+				   pkt_dev->imix_entries[i].size,
+				   pkt_dev->imix_entries[i].count_so_far);
+		seq_puts(seq, "\n");
+	}
+
 	if (pkt_dev->result[0])
 		seq_printf(seq, "Result: %s\n", pkt_dev->result);
 	else
@@ -810,6 +1069,88 @@ done_str:
 	return i;
 }
 
+/* Parses "size,weight size,weight ..." into the IMIX entries. */
+static int get_imix_entries(const char __user *buffer, size_t maxlen,
+			    struct pktgen_dev *pkt_dev)
+{
+	const int max_digits = 10;
+	unsigned long size, weight;
+	int i = 0, len;
+	char c;
+
+	pkt_dev->n_imix = 0;
+	do {
+		if (pkt_dev->n_imix == MAX_IMIX_ENTRIES)
+			return -E2BIG;
+
+		len = num_arg(&buffer[i], max_digits, &size);
+		if (len <= 0)
+			return len ? len : -EINVAL;
+		i += len;
+		/* A lone "0" turns IMIX off */
+		if (!size && !pkt_dev->n_imix &&
+		    (i >= maxlen || (!get_user(c, &buffer[i]) && c != ',')))
+			return i;
+		if (i >= maxlen || get_user(c, &buffer[i]))
+			return -EINVAL;
+		/* A comma separates size and weight */
+		if (c != ',')
+			return -EINVAL;
+		i++;
+
+		len = num_arg(&buffer[i], max_digits, &weight);
+		if (len <= 0)
+			return len ? len : -EINVAL;
+		if (!weight)
+			return -EINVAL;
+		i += len;
+
+		if (size < 14 + 20 + 8)
+			size = 14 + 20 + 8;
+		pkt_dev->imix_entries[pkt_dev->n_imix].size = size;
+		pkt_dev->imix_entries[pkt_dev->n_imix].weight = weight;
+		pkt_dev->imix_entries[pkt_dev->n_imix].count_so_far = 0;
+		pkt_dev->n_imix++;
+
+		c = 0;
+		if (i < maxlen && get_user(c, &buffer[i]))
+			return -EFAULT;
+		i++;
+	} while (c == ' ');
+
+	return i;
+}
+
+/* Spread the IMIX entries over IMIX_PRECISION slots in proportion to
+ * their weights, so that a packet size is drawn with a single random
+ * number. Light entries still get a slot while there are slots left.
+ */
+static void fill_imix_distribution(struct pktgen_dev *pkt_dev)
+{
+	unsigned int cumulative[MAX_IMIX_ENTRIES];
+	u64 total = 0, sum = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < pkt_dev->n_imix; i++)
+		total += pkt_dev->imix_entries[i].weight;
+
+	for (i = 0; i < pkt_dev->n_imix; i++) {
+		unsigned int slot;
+
+		sum += pkt_dev->imix_entries[i].weight;
+		slot = div64_u64(sum * IMIX_PRECISION, total);
+		cumulative[i] = max_t(unsigned int, slot,
+				      i ? cumulative[i - 1] + 1 : 1);
+	}
+	cumulative[pkt_dev->n_imix - 1] = IMIX_PRECISION;
+
+	for (i = 0, j = 0; i < IMIX_PRECISION; i++) {
+		while (i >= cumulative[j])
+			j++;
+		pkt_dev->imix_distribution[i] = j;
+	}
+}
+
 static ssize_t get_labels(const char __user *buffer, struct pktgen_dev *pkt_dev)
 {
 	unsigned n = 0;
@@ -1066,6 +1407,32 @@ static ssize_t pktgen_if_write(struct file *file,
 		sprintf(pg_result, "OK: udp_dst_max=%u", pkt_dev->udp_dst_max);
 		return count;
 	}
+	if (!strcmp(name, "imix_weights")) {
+		len = get_imix_entries(&user_buffer[i], count - i, pkt_dev);
+		if (len < 0) {
+			pkt_dev->n_imix = 0;
+			return len;
+		}
+		i += len;
+		if (pkt_dev->n_imix)
+			fill_imix_distribution(pkt_dev);
+		sprintf(pg_result, "OK: imix_weights=%u entries",
+			pkt_dev->n_imix);
+		return count;
+	}
+	if (!strcmp(name, "burst")) {
+		len = num_arg(&user_buffer[i], 10, &value);
+		if (len < 0)
+			return len;
+		/* The same skb goes out burst times, as with clone_skb */
+		if ((value > 1) &&
+		    (!(pkt_dev->odev->priv_flags & IFF_TX_SKB_SHARING)))
+			return -ENOTSUPP;
+		i += len;
+		pkt_dev->burst = value < 1 ? 1 : value;
+		sprintf(pg_result, "OK: burst=%d", pkt_dev->burst);
+		return count;
+	}
 	if (!strcmp(name, "clone_skb")) {
 		len = num_arg(&user_buffer[i], 10, &value);
 		if (len < 0)
@@ -1946,6 +2313,10 @@ static int pktgen_device_event(struct notifier_block *unused,
 
 	case NETDEV_UNREGISTER:
 		pktgen_mark_device(dev->name);
+		mutex_lock(&pktgen_rx_lock);
+		if (dev == pktgen_rx_dev)
+			pktgen_rx_stop();
+		mutex_unlock(&pktgen_rx_lock);
 		break;
 	}
 
@@ -2448,7 +2819,12 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 		}
 	}
 
-	if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
+	if (pkt_dev->n_imix) {
+		pkt_dev->cur_imix_entry = pkt_dev->imix_distribution[
+					random32() % IMIX_PRECISION];
+		pkt_dev->cur_pkt_size =
+			pkt_dev->imix_entries[pkt_dev->cur_imix_entry].size;
+	} else if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
 		__u32 t;
 		if (pkt_dev->flags & F_TXSIZE_RND) {
 			t = random32() %
@@ -2983,11 +3359,15 @@ static struct sk_buff *fill_packet(struct net_device *odev,
 
 static void pktgen_clear_counters(struct pktgen_dev *pkt_dev)
 {
+	unsigned int i;
+
 	pkt_dev->seq_num = 1;
 	pkt_dev->idle_acc = 0;
 	pkt_dev->sofar = 0;
 	pkt_dev->tx_bytes = 0;
 	pkt_dev->errors = 0;
+	for (i = 0; i < pkt_dev->n_imix; i++)
+		pkt_dev->imix_entries[i].count_so_far = 0;
 }
 
 /* Set up structure for sending pkts, clear counters */
@@ -3147,7 +3527,12 @@ static void show_results(struct pktgen_dev *pkt_dev, int nr_frags)
 	pps = div64_u64(pkt_dev->sofar * NSEC_PER_SEC,
 			ktime_to_ns(elapsed));
 
-	bps = pps * 8 * pkt_dev->cur_pkt_size;
+	/* Sizes vary with IMIX, count what was actually sent */
+	if (pkt_dev->n_imix)
+		bps = div64_u64(pkt_dev->tx_bytes * 8 * NSEC_PER_SEC,
+				ktime_to_ns(elapsed));
+	else
+		bps = pps * 8 * pkt_dev->cur_pkt_size;
 
 	mbps = bps;
 	do_div(mbps, 1000000);
@@ -3302,6 +3687,7 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 	netdev_tx_t (*xmit)(struct sk_buff *, struct net_device *)
 		= odev->netdev_ops->ndo_start_xmit;
 	struct netdev_queue *txq;
+	int burst = pkt_dev->burst;
 	u16 queue_map;
 	int ret;
 
@@ -3350,7 +3736,11 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 		pkt_dev->last_ok = 0;
 		goto unlock;
 	}
-	atomic_inc(&(pkt_dev->skb->users));
+	/* One reference per transmit of the burst, the driver consumes one
+	 * each time it takes the skb. What is left is dropped below. */
+	atomic_add(burst, &(pkt_dev->skb->users));
+xmit_more:
+	burst--;
 	ret = (*xmit)(pkt_dev->skb, odev);
 
 	switch (ret) {
@@ -3360,6 +3750,10 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 		pkt_dev->sofar++;
 		pkt_dev->seq_num++;
 		pkt_dev->tx_bytes += pkt_dev->last_pkt_size;
+		if (pkt_dev->n_imix)
+			pkt_dev->imix_entries[pkt_dev->cur_imix_entry].count_so_far++;
+		if (burst > 0 && !netif_tx_queue_frozen_or_stopped(txq))
+			goto xmit_more;
 		break;
 	case NET_XMIT_DROP:
 	case NET_XMIT_CN:
@@ -3378,6 +3772,8 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 		atomic_dec(&(pkt_dev->skb->users));
 		pkt_dev->last_ok = 0;
 	}
+	if (unlikely(burst))
+		atomic_sub(burst, &(pkt_dev->skb->users));
 unlock:
 	__netif_tx_unlock_bh(txq);
 
@@ -3574,6 +3970,7 @@ static int pktgen_add_device(struct pktgen_thread *t, const char *ifname)
 	pkt_dev->svlan_cfi = 0;
 	pkt_dev->svlan_id = 0xffff;
 	pkt_dev->node = -1;
+	pkt_dev->burst = 1;
 
 	err = pktgen_setup_dev(pkt_dev, ifname);
 	if (err)
@@ -3727,6 +4124,14 @@ static int __init pg_init(void)
 		goto remove_dir;
 	}
 
+	pe = proc_create(PGRX, 0400, pg_proc_dir, &pktgen_rx_fops);
+	if (pe == NULL) {
+		pr_err("ERROR: cannot create %s procfs entry\n", PGRX);
+		ret = -EINVAL;
+		goto remove_ctrl;
+	}
+	pktgen_rx_reset();
+
 	register_netdevice_notifier(&pktgen_notifier_block);
 
 	for_each_online_cpu(cpu) {
@@ -3748,6 +4153,8 @@ static int __init pg_init(void)
 
  unregister:
 	unregister_netdevice_notifier(&pktgen_notifier_block);
+	remove_proc_entry(PGRX, pg_proc_dir);
+ remove_ctrl:
 	remove_proc_entry(PGCTRL, pg_proc_dir);
  remove_dir:
 	proc_net_remove(&init_net, PG_PROC_DIR);
@@ -3777,7 +4184,12 @@ static void __exit pg_cleanup(void)
 	/* Un-register us from receiving netdevice events */
 	unregister_netdevice_notifier(&pktgen_notifier_block);
 
+	mutex_lock(&pktgen_rx_lock);
+	pktgen_rx_stop();
+	mutex_unlock(&pktgen_rx_lock);
+
 	/* Clean up proc file system */
+	remove_proc_entry(PGRX, pg_proc_dir);
 	remove_proc_entry(PGCTRL, pg_proc_dir);
 	proc_net_remove(&init_net, PG_PROC_DIR);
 }
@@ -16,6 +16,7 @@
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/tcp.h>
 
 #include <net/request_sock.h>
 
@@ -130,3 +131,36 @@ void reqsk_queue_destroy(struct request_sock_queue *queue)
 		kfree(lopt);
 }
 
+
+/*
+ * Called from the child socket context (socket lock held) once a TCP Fast
+ * Open child no longer needs its request_sock, i.e. after the 3WHS has
+ * completed or been aborted.
+ *
+ * The req is co-owned by the child (through tcp_sk(child)->fastopen_rsk,
+ * used to retransmit SYN-ACKs) and by the listener, whose accept queue
+ * links the req until accept(). inet_csk_accept() sets req->sk to NULL
+ * when it hands out a child that is still in TCP_SYN_RECV, and the req is
+ * then freed here. Both sides serialize on the listener's fastopenq->lock.
+ */
+void reqsk_fastopen_remove(struct sock *sk, struct request_sock *req)
+{
+	struct sock *lsk = tcp_rsk(req)->listener;
+	struct fastopen_queue *fastopenq =
+	    inet_csk(lsk)->icsk_accept_queue.fastopenq;
+	bool accepted;
+
+	tcp_sk(sk)->fastopen_rsk = NULL;
+	spin_lock_bh(&fastopenq->lock);
+	fastopenq->qlen--;
+	tcp_rsk(req)->listener = NULL;
+	accepted = (req->sk == NULL);
+	spin_unlock_bh(&fastopenq->lock);
+
+	/* A child still sitting in the accept queue keeps using the req
+	 * as its queue entry; inet_csk_accept() frees it later.
+	 */
+	if (accepted)
+		reqsk_free(req);
+	sock_put(lsk);
+}
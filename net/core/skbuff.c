@@ -86,10 +86,20 @@ static void sock_pipe_buf_get(struct pipe_inode_info *pipe,
 	get_page(buf->page);
 }
 
+/*
+ * A page may be given away once the pipe holds its only reference: a
+ * fragment page whose skb has been freed, or a page the linear data was
+ * copied into that the socket has filled and let go of.
+ */
 static int sock_pipe_buf_steal(struct pipe_inode_info *pipe,
 			       struct pipe_buffer *buf)
 {
-	return 1;
+	struct page *page = buf->page;
+
+	if (PageSlab(page) || PageCompound(page))
+		return 1;
+
+	return generic_pipe_buf_steal(pipe, buf);
 }
 
 
@@ -244,6 +254,127 @@ nodata:
 }
 EXPORT_SYMBOL(__alloc_skb);
 
+/*
+ * Receive buffer recycling.
+ *
+ * Devices flagged IFF_SKB_RECYCLE get their netdev_alloc_skb() buffers
+ * rounded up to one of a few size classes. When such a buffer is freed
+ * unshared and linear, outside of hard interrupt context, it is cleaned
+ * and kept on a per-cpu list for its class rather than going back to the
+ * slab. The next allocation of that class on that cpu takes it from
+ * there. A forwarding box thus turns the buffers freed on transmit
+ * completion straight into receive buffers. The lists are only touched
+ * with BH disabled and hold at most sysctl_skb_recycle_max buffers each.
+ */
+int sysctl_skb_recycle_max __read_mostly = 128;
+
+/* Total buffer sizes, data plus skb_shared_info, of classes 1.. */
+static const unsigned int skb_recycle_bufsize[SKB_RECYCLE_CLASSES] = {
+	2048, 4096, 16384
+};
+
+static inline unsigned int skb_recycle_len(int class)
+{
+	return SKB_WITH_OVERHEAD(skb_recycle_bufsize[class - 1]) - NET_SKB_PAD;
+}
+
+static struct sk_buff *skb_recycle_alloc(struct net_device *dev,
+					 unsigned int length, gfp_t gfp_mask)
+{
+	struct softnet_data *sd;
+	struct sk_buff *skb = NULL;
+	int class;
+
+	for (class = 1; class <= SKB_RECYCLE_CLASSES; class++)
+		if (length <= skb_recycle_len(class))
+			break;
+	if (class > SKB_RECYCLE_CLASSES)
+		return NULL;
+
+	if (likely(!in_irq() && !irqs_disabled())) {
+		local_bh_disable();
+		sd = &__get_cpu_var(softnet_data);
+		skb = sd->recycle_list[class - 1];
+		if (skb) {
+			sd->recycle_list[class - 1] = skb->next;
+			sd->recycle_count[class - 1]--;
+			sd->recycle_hit++;
+		} else {
+			sd->recycle_miss++;
+		}
+		local_bh_enable();
+	}
+
+	if (skb) {
+		/* Cleaned by skb_recycle() before it was queued */
+		skb->next = NULL;
+	} else {
+		skb = __alloc_skb(skb_recycle_len(class) + NET_SKB_PAD,
+				  gfp_mask, 0, NUMA_NO_NODE);
+		if (unlikely(!skb))
+			return NULL;
+		skb_reserve(skb, NET_SKB_PAD);
+	}
+	skb->dev = dev;
+	skb->recycle_class = class;
+	return skb;
+}
+
+static void skb_release_data(struct sk_buff *skb);
+static void kfree_skbmem(struct sk_buff *skb);
+
+/* Returns true if the skb was consumed */
+static bool skb_recycle_put(struct sk_buff *skb)
+{
+	int class = skb->recycle_class;
+	struct softnet_data *sd;
+
+	if (in_irq() || !skb_is_recycleable(skb, skb_recycle_len(class)))
+		return false;
+
+	skb_recycle(skb);
+	skb->recycle_class = class;
+	atomic_set(&skb->users, 1);
+
+	local_bh_disable();
+	sd = &__get_cpu_var(softnet_data);
+	if (likely(sd->recycle_count[class - 1] < sysctl_skb_recycle_max)) {
+		skb->next = sd->recycle_list[class - 1];
+		sd->recycle_list[class - 1] = skb;
+		sd->recycle_count[class - 1]++;
+		sd->recycle_put++;
+		skb = NULL;
+	} else {
+		sd->recycle_full++;
+	}
+	local_bh_enable();
+
+	if (skb) {
+		skb_release_data(skb);
+		kfree_skbmem(skb);
+	}
+	return true;
+}
+
+/**
+ *	skb_recycle_flush - free the recycled buffers of a cpu
+ *	@sd: softnet_data of a cpu that is offline
+ */
+void skb_recycle_flush(struct softnet_data *sd)
+{
+	struct sk_buff *skb;
+	int i;
+
+	for (i = 0; i < SKB_RECYCLE_CLASSES; i++) {
+		while ((skb = sd->recycle_list[i]) != NULL) {
+			sd->recycle_list[i] = skb->next;
+			skb_release_data(skb);
+			kfree_skbmem(skb);
+		}
+		sd->recycle_count[i] = 0;
+	}
+}
+
 /**
  *	__netdev_alloc_skb - allocate an skbuff for rx on a specific device
  *	@dev: network device to receive on
@@ -262,6 +393,12 @@ struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 {
 	struct sk_buff *skb;
 
+	if (dev && (dev->priv_flags & IFF_SKB_RECYCLE)) {
+		skb = skb_recycle_alloc(dev, length, gfp_mask);
+		if (skb)
+			return skb;
+	}
+
 	skb = __alloc_skb(length + NET_SKB_PAD, gfp_mask, 0, NUMA_NO_NODE);
 	if (likely(skb)) {
 		skb_reserve(skb, NET_SKB_PAD);
@@ -329,7 +466,7 @@ static void skb_clone_fraglist(struct sk_buff *skb)
 		skb_get(list);
 }
 
-static inline void skb_release_data(struct sk_buff *skb)
+static void skb_release_data(struct sk_buff *skb)
 {
 	if (!skb->cloned ||
 	    !atomic_sub_return(skb->nohdr ? (1 << SKB_DATAREF_SHIFT) + 1 : 1,
@@ -370,7 +507,7 @@ static inline void skb_release_data(struct sk_buff *skb)
 /*
  *	Free an skbuff by memory without cleaning the state.
  */
-static inline void kfree_skbmem(struct sk_buff *skb)
+static void kfree_skbmem(struct sk_buff *skb)
 {
 	struct sk_buff *other;
 	atomic_t *fclone_ref;
@@ -453,6 +590,8 @@ void __kfree_skb(struct sk_buff *skb)
 	if (skb->skb_recycle && !skb->skb_recycle(skb))
 		return;
 #endif /* CONFIG_NET_SKB_RECYCLE */
+	if (skb->recycle_class && skb_recycle_put(skb))
+		return;
  
 	skb_release_all(skb);
 	kfree_skbmem(skb);
@@ -609,6 +748,7 @@ static struct sk_buff *__skb_clone(struct sk_buff *n, struct sk_buff *skb)
 	n->cloned = 1;
 	n->nohdr = 0;
 	n->destructor = NULL;
+	n->recycle_class = 0;
 
 #ifdef CONFIG_NET_SKB_RECYCLE
 	n->skb_recycle = NULL;
@@ -1519,6 +1659,13 @@ static void sock_spd_release(struct splice_pipe_desc *spd, unsigned int i)
 	put_page(spd->pages[i]);
 }
 
+/*
+ * Copy linear data into the socket's page. Pages are filled back to back
+ * without gaps, so that the stream is laid out in them as it is in the
+ * file it may end up in, and the socket lets go of a page as soon as it
+ * is full: the pipe then holds the only references and splicing on to a
+ * file may move the page rather than copy it again.
+ */
 static inline struct page *linear_to_page(struct page *page, unsigned int *len,
 					  unsigned int *offset,
 					  struct sk_buff *skb, struct sock *sk)
@@ -1526,37 +1673,49 @@ static inline struct page *linear_to_page(struct page *page, unsigned int *len,
 	struct page *p = sk->sk_sndmsg_page;
 	unsigned int off;
 
+	if (p && sk->sk_sndmsg_off == PAGE_SIZE) {
+		put_page(p);
+		p = sk->sk_sndmsg_page = NULL;
+	}
+
 	if (!p) {
-new_page:
 		p = sk->sk_sndmsg_page = alloc_pages(sk->sk_allocation, 0);
 		if (!p)
 			return NULL;
 
-		off = sk->sk_sndmsg_off = 0;
+		sk->sk_sndmsg_off = 0;
 		/* hold one ref to this page until it's full */
-	} else {
-		unsigned int mlen;
-
-		off = sk->sk_sndmsg_off;
-		mlen = PAGE_SIZE - off;
-		if (mlen < 64 && mlen < *len) {
-			put_page(p);
-			goto new_page;
-		}
-
-		*len = min_t(unsigned int, *len, mlen);
 	}
 
+	off = sk->sk_sndmsg_off;
+	*len = min_t(unsigned int, *len, PAGE_SIZE - off);
+
 	memcpy(page_address(p) + off, page_address(page) + *offset, *len);
 	sk->sk_sndmsg_off += *len;
 	*offset = off;
 	get_page(p);
 
+	if (sk->sk_sndmsg_off == PAGE_SIZE) {
+		put_page(p);
+		sk->sk_sndmsg_page = NULL;
+	}
+
 	return p;
 }
 
+static inline bool spd_can_coalesce(const struct splice_pipe_desc *spd,
+				    struct page *page, unsigned int offset)
+{
+	return spd->nr_pages &&
+	       spd->pages[spd->nr_pages - 1] == page &&
+	       (spd->partial[spd->nr_pages - 1].offset +
+		spd->partial[spd->nr_pages - 1].len == offset);
+}
+
 /*
- * Fill page/offset/length into spd, if it can hold more pages.
+ * Fill page/offset/length into spd, if it can hold more pages. Data that
+ * continues the previous entry in the same page extends it, so a page
+ * filled in several pieces still reaches the pipe as one buffer.
  */
 static inline int spd_fill_page(struct splice_pipe_desc *spd,
 				struct pipe_inode_info *pipe, struct page *page,
@@ -1571,7 +1730,16 @@ static inline int spd_fill_page(struct splice_pipe_desc *spd,
 		page = linear_to_page(page, len, &offset, skb, sk);
 		if (!page)
 			return 1;
-	} else
+	}
+
+	if (spd_can_coalesce(spd, page, offset)) {
+		spd->partial[spd->nr_pages - 1].len += *len;
+		if (linear)
+			put_page(page);
+		return 0;
+	}
+
+	if (!linear)
 		get_page(page);
 
 	spd->pages[spd->nr_pages] = page;
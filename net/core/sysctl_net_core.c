@@ -18,6 +18,7 @@
 #include <net/ip.h>
 #include <net/sock.h>
 #include <net/net_ratelimit.h>
+#include <net/flow.h>
 
 #ifdef CONFIG_RPS
 static int rps_sock_flow_sysctl(ctl_table *table, int write,
@@ -79,6 +80,27 @@ static int rps_sock_flow_sysctl(ctl_table *table, int write,
 }
 #endif /* CONFIG_RPS */
 
+#ifdef CONFIG_XFRM
+static int flow_cache_shift_sysctl(ctl_table *table, int write,
+				   void __user *buffer, size_t *lenp,
+				   loff_t *ppos)
+{
+	unsigned int shift = flow_cache_hash_shift();
+	ctl_table tmp = {
+		.data = &shift,
+		.maxlen = sizeof(shift),
+		.mode = table->mode
+	};
+	int ret;
+
+	ret = proc_dointvec(&tmp, write, buffer, lenp, ppos);
+	if (write && !ret)
+		ret = flow_cache_resize(shift);
+
+	return ret;
+}
+#endif /* CONFIG_XFRM */
+
 static struct ctl_table net_core_table[] = {
 #ifdef CONFIG_NET
 	{
@@ -168,7 +190,22 @@ static struct ctl_table net_core_table[] = {
 		.proc_handler	= rps_sock_flow_sysctl
 	},
 #endif
+#ifdef CONFIG_XFRM
+	{
+		.procname	= "flow_cache_hash_shift",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= flow_cache_shift_sysctl
+	},
+#endif
 #endif /* CONFIG_NET */
+	{
+		.procname	= "skb_recycle_max",
+		.data		= &sysctl_skb_recycle_max,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec
+	},
 	{
 		.procname	= "netdev_budget",
 		.data		= &netdev_budget,
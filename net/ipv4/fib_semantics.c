@@ -149,6 +149,7 @@ static void free_fib_info_rcu(struct rcu_head *head)
 	change_nexthops(fi) {
 		if (nexthop_nh->nh_dev)
 			dev_put(nexthop_nh->nh_dev);
+		free_percpu(nexthop_nh->nh_pcpu_rth_input);
 	} endfor_nexthops(fi);
 
 	release_net(fi->fib_net);
@@ -180,6 +181,9 @@ void fib_release_info(struct fib_info *fi)
 			hlist_del(&nexthop_nh->nh_hash);
 		} endfor_nexthops(fi)
 		fi->fib_dead = 1;
+		change_nexthops(fi) {
+			ip_rt_nh_cache_release(nexthop_nh);
+		} endfor_nexthops(fi)
 		fib_info_put(fi);
 	}
 	spin_unlock_bh(&fib_info_lock);
@@ -865,6 +869,15 @@ struct fib_info *fib_create_info(struct fib_config *cfg)
 
 	change_nexthops(fi) {
 		fib_info_update_nh_saddr(net, nexthop_nh);
+		if (cfg->fc_type == RTN_UNICAST && nexthop_nh->nh_gw &&
+		    nexthop_nh->nh_scope == RT_SCOPE_LINK) {
+			nexthop_nh->nh_pcpu_rth_input =
+				alloc_percpu(struct rtable __rcu *);
+			if (!nexthop_nh->nh_pcpu_rth_input) {
+				err = -ENOBUFS;
+				goto failure;
+			}
+		}
 	} endfor_nexthops(fi)
 
 link_it:
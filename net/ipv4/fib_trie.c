@@ -73,6 +73,8 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/prefetch.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
 #include <linux/export.h>
 #include <net/net_namespace.h>
 #include <net/ip.h>
@@ -102,13 +104,6 @@ struct rt_trie_node {
 	t_key key;
 };
 
-struct leaf {
-	unsigned long parent;
-	t_key key;
-	struct hlist_head list;
-	struct rcu_head rcu;
-};
-
 struct leaf_info {
 	struct hlist_node hlist;
 	int plen;
@@ -117,6 +112,17 @@ struct leaf_info {
 	struct rcu_head rcu;
 };
 
+struct leaf {
+	unsigned long parent;
+	t_key key;
+	struct hlist_head list;
+	struct rcu_head rcu;
+	/* Most leaves hold a single prefix: it is allocated with the leaf
+	 * so that a lookup finds it in the cache lines it already touched.
+	 */
+	struct leaf_info li;
+};
+
 struct tnode {
 	unsigned long parent;
 	t_key key;
@@ -133,6 +139,7 @@ struct tnode {
 };
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
+/* Kept per cpu, lookups run in parallel on all of them */
 struct trie_use_stats {
 	unsigned int gets;
 	unsigned int backtrack;
@@ -140,6 +147,8 @@ struct trie_use_stats {
 	unsigned int semantic_match_miss;
 	unsigned int null_node_hit;
 	unsigned int resize_node_skipped;
+	unsigned int depth[MAX_STAT_DEPTH];	/* nodes visited per lookup */
+	u64 lookup_ns;
 };
 #endif
 
@@ -150,13 +159,15 @@ struct trie_stat {
 	unsigned int leaves;
 	unsigned int nullpointers;
 	unsigned int prefixes;
+	unsigned int inleaf_prefixes;
 	unsigned int nodesizes[MAX_STAT_DEPTH];
+	unsigned int leafdepths[MAX_STAT_DEPTH];
 };
 
 struct trie {
 	struct rt_trie_node __rcu *trie;
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-	struct trie_use_stats stats;
+	struct trie_use_stats __percpu *stats;
 #endif
 };
 
@@ -350,6 +361,13 @@ static const int inflate_threshold = 50;
 static const int halve_threshold_root = 15;
 static const int inflate_threshold_root = 30;
 
+/*
+ * Every lookup goes through the nodes indexing the first bits of the key,
+ * so these are kept as large as the root: a wider stride there saves a
+ * level, and a likely cache miss, on each lookup.
+ */
+#define TOP_LEVEL_BITS 16
+
 static void __alias_free_mem(struct rcu_head *head)
 {
 	struct fib_alias *fa = container_of(head, struct fib_alias, rcu);
@@ -372,9 +390,11 @@ static inline void free_leaf(struct leaf *l)
 	call_rcu_bh(&l->rcu, __leaf_free_rcu);
 }
 
-static inline void free_leaf_info(struct leaf_info *leaf)
+static inline void free_leaf_info(struct leaf *l, struct leaf_info *li)
 {
-	kfree_rcu(leaf, rcu);
+	/* The one allocated with the leaf goes away with it */
+	if (li != &l->li)
+		kfree_rcu(li, rcu);
 }
 
 static struct tnode *tnode_alloc(size_t size)
@@ -438,12 +458,16 @@ static void tnode_free_flush(void)
 	}
 }
 
-static struct leaf *leaf_new(void)
+static struct leaf *leaf_new(t_key key, int plen)
 {
 	struct leaf *l = kmem_cache_alloc(trie_leaf_kmem, GFP_KERNEL);
 	if (l) {
 		l->parent = T_LEAF;
+		l->key = key;
 		INIT_HLIST_HEAD(&l->list);
+		l->li.plen = plen;
+		l->li.mask_plen = ntohl(inet_make_mask(plen));
+		INIT_LIST_HEAD(&l->li.falh);
 	}
 	return l;
 }
@@ -621,9 +645,10 @@ static struct rt_trie_node *resize(struct trie *t, struct tnode *tn)
 
 	check_tnode(tn);
 
-	/* Keep root node larger  */
+	/* Keep root and top level nodes larger */
 
-	if (!node_parent((struct rt_trie_node *)tn)) {
+	if (!node_parent((struct rt_trie_node *)tn) ||
+	    tn->pos < TOP_LEVEL_BITS) {
 		inflate_threshold_use = inflate_threshold_root;
 		halve_threshold_use = halve_threshold_root;
 	} else {
@@ -643,7 +668,7 @@ static struct rt_trie_node *resize(struct trie *t, struct tnode *tn)
 		if (IS_ERR(tn)) {
 			tn = old_tn;
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			t->stats.resize_node_skipped++;
+			this_cpu_inc(t->stats->resize_node_skipped);
 #endif
 			break;
 		}
@@ -670,7 +695,7 @@ static struct rt_trie_node *resize(struct trie *t, struct tnode *tn)
 		if (IS_ERR(tn)) {
 			tn = old_tn;
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			t->stats.resize_node_skipped++;
+			this_cpu_inc(t->stats->resize_node_skipped);
 #endif
 			break;
 		}
@@ -1104,19 +1129,12 @@ static struct list_head *fib_insert_node(struct trie *t, u32 key, int plen)
 		insert_leaf_info(&l->list, li);
 		goto done;
 	}
-	l = leaf_new();
+	l = leaf_new(key, plen);
 
 	if (!l)
 		return NULL;
 
-	l->key = key;
-	li = leaf_info_new(plen);
-
-	if (!li) {
-		free_leaf(l);
-		return NULL;
-	}
-
+	li = &l->li;
 	fa_head = &li->falh;
 	insert_leaf_info(&l->list, li);
 
@@ -1148,7 +1166,6 @@ static struct list_head *fib_insert_node(struct trie *t, u32 key, int plen)
 		}
 
 		if (!tn) {
-			free_leaf_info(li);
 			free_leaf(l);
 			return NULL;
 		}
@@ -1380,7 +1397,7 @@ static int check_leaf(struct fib_table *tb, struct trie *t, struct leaf *l,
 			err = fib_props[fa->fa_type].error;
 			if (err) {
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-				t->stats.semantic_match_passed++;
+				this_cpu_inc(t->stats->semantic_match_passed);
 #endif
 				return err;
 			}
@@ -1395,7 +1412,7 @@ static int check_leaf(struct fib_table *tb, struct trie *t, struct leaf *l,
 					continue;
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-				t->stats.semantic_match_passed++;
+				this_cpu_inc(t->stats->semantic_match_passed);
 #endif
 				res->prefixlen = li->plen;
 				res->nh_sel = nhsel;
@@ -1411,7 +1428,7 @@ static int check_leaf(struct fib_table *tb, struct trie *t, struct leaf *l,
 		}
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-		t->stats.semantic_match_miss++;
+		this_cpu_inc(t->stats->semantic_match_miss);
 #endif
 	}
 
@@ -1432,6 +1449,10 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 	unsigned int current_prefix_length = KEYLENGTH;
 	struct tnode *cn;
 	t_key pref_mismatch;
+#ifdef CONFIG_IP_FIB_TRIE_STATS
+	unsigned int depth = 0;
+	u64 start = sched_clock();
+#endif
 
 	rcu_read_lock();
 
@@ -1440,7 +1461,7 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 		goto failed;
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-	t->stats.gets++;
+	this_cpu_inc(t->stats->gets);
 #endif
 
 	/* Just a leaf? */
@@ -1461,10 +1482,13 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 						   pos, bits);
 
 		n = tnode_get_child_rcu(pn, cindex);
+#ifdef CONFIG_IP_FIB_TRIE_STATS
+		depth++;
+#endif
 
 		if (n == NULL) {
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			t->stats.null_node_hit++;
+			this_cpu_inc(t->stats->null_node_hit);
 #endif
 			goto backtrace;
 		}
@@ -1478,6 +1502,11 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 
 		cn = (struct tnode *)n;
 
+		/* Start fetching the child slot the next level will most
+		 * likely read while the skipped bits are checked.
+		 */
+		prefetch(&cn->child[tkey_extract_bits(key, cn->pos, cn->bits)]);
+
 		/*
 		 * It's a tnode, and we can do some extra checks here if we
 		 * like, to avoid descending into a dead-end branch.
@@ -1598,7 +1627,7 @@ backtrace:
 			chopped_off = 0;
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			t->stats.backtrack++;
+			this_cpu_inc(t->stats->backtrack);
 #endif
 			goto backtrace;
 		}
@@ -1606,6 +1635,11 @@ backtrace:
 failed:
 	ret = 1;
 found:
+#ifdef CONFIG_IP_FIB_TRIE_STATS
+	this_cpu_inc(t->stats->depth[min_t(unsigned int, depth,
+					   MAX_STAT_DEPTH - 1)]);
+	this_cpu_add(t->stats->lookup_ns, sched_clock() - start);
+#endif
 	rcu_read_unlock();
 	return ret;
 }
@@ -1704,7 +1738,7 @@ int fib_table_delete(struct fib_table *tb, struct fib_config *cfg)
 
 	if (list_empty(fa_head)) {
 		hlist_del_rcu(&li->hlist);
-		free_leaf_info(li);
+		free_leaf_info(l, li);
 	}
 
 	if (hlist_empty(&l->list))
@@ -1748,7 +1782,7 @@ static int trie_flush_leaf(struct leaf *l)
 
 		if (list_empty(&li->falh)) {
 			hlist_del_rcu(&li->hlist);
-			free_leaf_info(li);
+			free_leaf_info(l, li);
 		}
 	}
 	return found;
@@ -1851,6 +1885,11 @@ int fib_table_flush(struct fib_table *tb)
 
 void fib_free_table(struct fib_table *tb)
 {
+#ifdef CONFIG_IP_FIB_TRIE_STATS
+	struct trie *t = (struct trie *)tb->tb_data;
+
+	free_percpu(t->stats);
+#endif
 	kfree(tb);
 }
 
@@ -1974,8 +2013,7 @@ void __init fib_trie_init(void)
 					  0, SLAB_PANIC, NULL);
 
 	trie_leaf_kmem = kmem_cache_create("ip_fib_trie",
-					   max(sizeof(struct leaf),
-					       sizeof(struct leaf_info)),
+					   sizeof(struct leaf),
 					   0, SLAB_PANIC, NULL);
 }
 
@@ -1996,6 +2034,13 @@ struct fib_table *fib_trie_table(u32 id)
 
 	t = (struct trie *) tb->tb_data;
 	memset(t, 0, sizeof(*t));
+#ifdef CONFIG_IP_FIB_TRIE_STATS
+	t->stats = alloc_percpu(struct trie_use_stats);
+	if (!t->stats) {
+		kfree(tb);
+		return NULL;
+	}
+#endif
 
 	return tb;
 }
@@ -2098,9 +2143,14 @@ static void trie_collect_stats(struct trie *t, struct trie_stat *s)
 			s->totdepth += iter.depth;
 			if (iter.depth > s->maxdepth)
 				s->maxdepth = iter.depth;
+			if (iter.depth < MAX_STAT_DEPTH)
+				s->leafdepths[iter.depth]++;
 
-			hlist_for_each_entry_rcu(li, tmp, &l->list, hlist)
+			hlist_for_each_entry_rcu(li, tmp, &l->list, hlist) {
 				++s->prefixes;
+				if (li == &l->li)
+					++s->inleaf_prefixes;
+			}
 		} else {
 			const struct tnode *tn = (const struct tnode *) n;
 			int i;
@@ -2133,11 +2183,23 @@ static void trie_show_stats(struct seq_file *seq, struct trie_stat *stat)
 		   avdepth / 100, avdepth % 100);
 	seq_printf(seq, "\tMax depth:      %u\n", stat->maxdepth);
 
+	max = MAX_STAT_DEPTH;
+	while (max > 0 && stat->leafdepths[max-1] == 0)
+		max--;
+
+	seq_printf(seq, "\tLeaf depths:   ");
+	for (i = 0; i < max; i++)
+		if (stat->leafdepths[i] != 0)
+			seq_printf(seq, "  %u: %u", i, stat->leafdepths[i]);
+	seq_putc(seq, '\n');
+
 	seq_printf(seq, "\tLeaves:         %u\n", stat->leaves);
 	bytes = sizeof(struct leaf) * stat->leaves;
 
-	seq_printf(seq, "\tPrefixes:       %u\n", stat->prefixes);
-	bytes += sizeof(struct leaf_info) * stat->prefixes;
+	seq_printf(seq, "\tPrefixes:       %u (%u in leaf)\n",
+		   stat->prefixes, stat->inleaf_prefixes);
+	bytes += sizeof(struct leaf_info) *
+		 (stat->prefixes - stat->inleaf_prefixes);
 
 	seq_printf(seq, "\tInternal nodes: %u\n\t", stat->tnodes);
 	bytes += sizeof(struct tnode) * stat->tnodes;
@@ -2162,18 +2224,49 @@ static void trie_show_stats(struct seq_file *seq, struct trie_stat *stat)
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 static void trie_show_usage(struct seq_file *seq,
-			    const struct trie_use_stats *stats)
-{
+			    const struct trie_use_stats __percpu *stats)
+{
+	struct trie_use_stats s = { 0 };
+	unsigned int i, max;
+	int cpu;
+
+	/* loop over all cpus, lookups update them without locking */
+	for_each_possible_cpu(cpu) {
+		const struct trie_use_stats *pcpu = per_cpu_ptr(stats, cpu);
+
+		s.gets += pcpu->gets;
+		s.backtrack += pcpu->backtrack;
+		s.semantic_match_passed += pcpu->semantic_match_passed;
+		s.semantic_match_miss += pcpu->semantic_match_miss;
+		s.null_node_hit += pcpu->null_node_hit;
+		s.resize_node_skipped += pcpu->resize_node_skipped;
+		for (i = 0; i < MAX_STAT_DEPTH; i++)
+			s.depth[i] += pcpu->depth[i];
+		s.lookup_ns += pcpu->lookup_ns;
+	}
+
 	seq_printf(seq, "\nCounters:\n---------\n");
-	seq_printf(seq, "gets = %u\n", stats->gets);
-	seq_printf(seq, "backtracks = %u\n", stats->backtrack);
+	seq_printf(seq, "gets = %u\n", s.gets);
+	seq_printf(seq, "backtracks = %u\n", s.backtrack);
 	seq_printf(seq, "semantic match passed = %u\n",
-		   stats->semantic_match_passed);
+		   s.semantic_match_passed);
 	seq_printf(seq, "semantic match miss = %u\n",
-		   stats->semantic_match_miss);
-	seq_printf(seq, "null node hit= %u\n", stats->null_node_hit);
-	seq_printf(seq, "skipped node resize = %u\n\n",
-		   stats->resize_node_skipped);
+		   s.semantic_match_miss);
+	seq_printf(seq, "null node hit= %u\n", s.null_node_hit);
+	seq_printf(seq, "skipped node resize = %u\n", s.resize_node_skipped);
+
+	max = MAX_STAT_DEPTH;
+	while (max > 0 && s.depth[max-1] == 0)
+		max--;
+	seq_printf(seq, "lookup depths =");
+	for (i = 0; i < max; i++)
+		if (s.depth[i] != 0)
+			seq_printf(seq, "  %u: %u", i, s.depth[i]);
+	seq_putc(seq, '\n');
+
+	seq_printf(seq, "lookup time = %llu ns (%llu ns per lookup)\n\n",
+		   (unsigned long long)s.lookup_ns,
+		   (unsigned long long)div_u64(s.lookup_ns, s.gets ? : 1));
 }
 #endif /*  CONFIG_IP_FIB_TRIE_STATS */
 
@@ -2215,7 +2308,7 @@ static int fib_triestat_seq_show(struct seq_file *seq, void *v)
 			trie_collect_stats(t, &stat);
 			trie_show_stats(seq, &stat);
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			trie_show_usage(seq, &t->stats);
+			trie_show_usage(seq, t->stats);
 #endif
 		}
 	}
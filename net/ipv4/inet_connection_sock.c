@@ -15,6 +15,7 @@
 
 #include <linux/module.h>
 #include <linux/jhash.h>
+#include <linux/tcp.h>
 
 #include <net/inet_connection_sock.h>
 #include <net/inet_hashtables.h>
@@ -266,6 +267,8 @@ static int inet_csk_wait_for_connect(struct sock *sk, long timeo)
 struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
+	struct request_sock_queue *queue = &icsk->icsk_accept_queue;
+	struct request_sock *req;
 	struct sock *newsk;
 	int error;
 
@@ -292,8 +295,26 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 			goto out_err;
 	}
 
-	newsk = reqsk_queue_get_child(&icsk->icsk_accept_queue, sk);
-	WARN_ON(newsk->sk_state == TCP_SYN_RECV);
+	req = reqsk_queue_remove(queue);
+	newsk = req->sk;
+	WARN_ON(newsk == NULL);
+	sk_acceptq_removed(sk);
+
+	if (sk->sk_protocol == IPPROTO_TCP && queue->fastopenq != NULL) {
+		spin_lock_bh(&queue->fastopenq->lock);
+		if (tcp_rsk(req)->listener) {
+			/* A Fast Open child still waiting for the final ACK
+			 * of its 3WHS needs req to retransmit the SYN-ACK.
+			 * Clear req->sk so reqsk_fastopen_remove() frees it.
+			 */
+			req->sk = NULL;
+			req = NULL;
+		}
+		spin_unlock_bh(&queue->fastopenq->lock);
+	}
+	WARN_ON(newsk->sk_state == TCP_SYN_RECV && req != NULL);
+	if (req)
+		__reqsk_free(req);
 out:
 	release_sock(sk);
 	return newsk;
@@ -716,6 +737,24 @@ void inet_csk_listen_stop(struct sock *sk)
 		WARN_ON(sock_owned_by_user(child));
 		sock_hold(child);
 
+		if (sk->sk_protocol == IPPROTO_TCP && tcp_rsk(req)->listener) {
+			struct fastopen_queue *fastopenq =
+				icsk->icsk_accept_queue.fastopenq;
+
+			BUG_ON(tcp_sk(child)->fastopen_rsk != req);
+			BUG_ON(sk != tcp_rsk(req)->listener);
+
+			/* Fast Open child still in TCP_SYN_RECV: detach it
+			 * from req before it is destroyed below.
+			 */
+			tcp_sk(child)->fastopen_rsk = NULL;
+			spin_lock(&fastopenq->lock);
+			fastopenq->qlen--;
+			tcp_rsk(req)->listener = NULL;
+			spin_unlock(&fastopenq->lock);
+			sock_put(sk);
+		}
+
 		sk->sk_prot->disconnect(child, O_NONBLOCK);
 
 		sock_orphan(child);
@@ -140,6 +140,7 @@ static int ip_rt_mtu_expires __read_mostly	= 10 * 60 * HZ;
 static int ip_rt_min_pmtu __read_mostly		= 512 + 20 + 20;
 static int ip_rt_min_advmss __read_mostly	= 256;
 static int rt_chain_length_max __read_mostly	= 20;
+static int ip_rt_forward_nocache __read_mostly;
 static int redirect_genid;
 
 static struct delayed_work expires_work;
@@ -2284,6 +2285,150 @@ static int __mkroute_input(struct sk_buff *skb,
 	return err;
 }
 
+/*
+ * Forwarding without the route cache (route/forward_nocache).
+ *
+ * The FIB lookup is done for every packet, which is then sent through a
+ * route kept per nexthop and per CPU instead of one hashed per flow.
+ * Such a route may not carry anything derived from the packet addresses,
+ * so only gatewayed nexthops out of another interface qualify. Packets
+ * with IP options or classified by source fall back to the route cache.
+ *
+ * called in rcu_read_lock() section, with BHs disabled
+ */
+static int ip_mkroute_input_nh(struct sk_buff *skb,
+			       const struct fib_result *res,
+			       struct in_device *in_dev,
+			       __be32 daddr, __be32 saddr, u32 tos)
+{
+	struct fib_info *fi = res->fi;
+	struct fib_nh *nh = &FIB_RES_NH(*res);
+	struct in_device *out_dev;
+	struct rtable *rth, *orth;
+	struct rtable **p;
+	__be32 spec_dst;
+	u32 itag;
+	int err;
+
+	if (!nh->nh_pcpu_rth_input || fi->fib_dead ||
+	    ip_hdr(skb)->ihl > 5 || skb->protocol != htons(ETH_P_IP))
+		return -EAGAIN;
+
+	out_dev = __in_dev_get_rcu(nh->nh_dev);
+	if (out_dev == NULL || out_dev == in_dev)
+		return -EAGAIN;
+
+	err = fib_validate_source(skb, saddr, daddr, tos, FIB_RES_OIF(*res),
+				  in_dev->dev, &spec_dst, &itag);
+	if (err < 0) {
+		ip_handle_martian_source(in_dev->dev, in_dev, skb, daddr,
+					 saddr);
+		return err;
+	}
+#ifdef CONFIG_IP_ROUTE_CLASSID
+	if (itag)
+		return -EAGAIN;
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+	if (fib_rules_tclass(res))
+		return -EAGAIN;
+#endif
+#endif
+
+	p = (struct rtable **)__this_cpu_ptr(nh->nh_pcpu_rth_input);
+	rth = rcu_dereference(*p);
+	if (rth && rth->rt_iif == in_dev->dev->ifindex &&
+	    !rt_is_expired(rth)) {
+		dst_use(&rth->dst, jiffies);
+		skb_dst_set(skb, &rth->dst);
+		return 0;
+	}
+
+	rth = rt_dst_alloc(out_dev->dev,
+			   IN_DEV_CONF_GET(in_dev, NOPOLICY),
+			   IN_DEV_CONF_GET(out_dev, NOXFRM));
+	if (!rth)
+		return -ENOBUFS;
+
+	rth->rt_key_dst	= nh->nh_gw;
+	rth->rt_key_src	= 0;
+	rth->rt_genid = rt_genid(dev_net(rth->dst.dev));
+	rth->rt_flags = 0;
+	rth->rt_type = RTN_UNICAST;
+	rth->rt_key_tos	= 0;
+	rth->rt_dst	= nh->nh_gw;
+	rth->rt_src	= 0;
+	rth->rt_route_iif = in_dev->dev->ifindex;
+	rth->rt_iif 	= in_dev->dev->ifindex;
+	rth->rt_oif 	= 0;
+	rth->rt_mark    = 0;
+	rth->rt_gateway	= nh->nh_gw;
+	/* spec_dst depends on the packet; only local replies and options use it */
+	rth->rt_spec_dst= 0;
+	rth->rt_peer_genid = 0;
+	rth->peer = NULL;
+	rth->fi = NULL;
+#if defined(CONFIG_MV_ETH_NFP_FIB_LEARN)
+	rth->nfp = false;
+#endif
+
+	rth->dst.input = ip_forward;
+	rth->dst.output = ip_output;
+
+	/* Metrics come from the FIB only: a peer is per destination */
+	if (fi->fib_metrics != (u32 *) dst_default_metrics) {
+		rth->fi = fi;
+		atomic_inc(&fi->fib_clntref);
+	}
+	dst_init_metrics(&rth->dst, fi->fib_metrics, true);
+	if (dst_mtu(&rth->dst) > IP_MAX_MTU)
+		dst_metric_set(&rth->dst, RTAX_MTU, IP_MAX_MTU);
+#ifdef CONFIG_IP_ROUTE_CLASSID
+	rth->dst.tclassid = nh->nh_tclassid;
+#endif
+
+	err = rt_bind_neighbour(rth);
+	if (err) {
+		rt_drop(rth);
+		return err;
+	}
+
+	/* The slot does not own a reference, like a route cache chain */
+	orth = xchg(p, rth);
+	if (orth)
+		rt_free(orth);
+
+	/* Raced with ip_rt_nh_cache_release(): do not leave rth behind */
+	if (fi->fib_dead) {
+		orth = xchg(p, NULL);
+		if (orth)
+			rt_free(orth);
+	}
+
+	skb_dst_set(skb, &rth->dst);
+	return 0;
+}
+
+/*
+ * Drops the forwarding routes of a nexthop whose fib_info is going away.
+ * fib_dead is already set, so ip_mkroute_input_nh() will not refill it.
+ */
+void ip_rt_nh_cache_release(struct fib_nh *nh)
+{
+	int cpu;
+
+	if (!nh->nh_pcpu_rth_input)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct rtable **p, *rt;
+
+		p = (struct rtable **)per_cpu_ptr(nh->nh_pcpu_rth_input, cpu);
+		rt = xchg(p, NULL);
+		if (rt)
+			rt_free(rt);
+	}
+}
+
 static int ip_mkroute_input(struct sk_buff *skb,
 			    struct fib_result *res,
 			    const struct flowi4 *fl4,
@@ -2299,6 +2444,12 @@ static int ip_mkroute_input(struct sk_buff *skb,
 		fib_select_multipath(res);
 #endif
 
+	if (ip_rt_forward_nocache && res->fi) {
+		err = ip_mkroute_input_nh(skb, res, in_dev, daddr, saddr, tos);
+		if (err != -EAGAIN)
+			return err;
+	}
+
 	/* create a routing cache entry */
 	err = __mkroute_input(skb, res, in_dev, daddr, saddr, tos, &rth);
 	if (err)
@@ -3414,6 +3565,13 @@ static ctl_table ipv4_route_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec,
 	},
+	{
+		.procname	= "forward_nocache",
+		.data		= &ip_rt_forward_nocache,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec,
+	},
 	{ }
 };
 
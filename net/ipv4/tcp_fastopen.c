@@ -0,0 +1,129 @@
+/*
+ * TCP Fast Open: server side cookie generation and the client side
+ * cookie cache.
+ *
+ * A server hands out a cookie bound to the client address in the SYN-ACK
+ * of a regular handshake. A client that presents it in a later SYN may
+ * have the data carried in that SYN delivered to the application before
+ * the 3WHS completes, saving one RTT on repeat connections.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/cryptohash.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <net/inetpeer.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+static __u32 tcp_fastopen_secret[16 - 2 + SHA_DIGEST_WORDS] __read_mostly;
+
+static DEFINE_PER_CPU(__u32 [16 + SHA_DIGEST_WORDS + SHA_WORKSPACE_WORDS],
+		      tcp_fastopen_scratch);
+
+static __init int tcp_fastopen_init(void)
+{
+	get_random_bytes(tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	return 0;
+}
+__initcall(tcp_fastopen_init);
+
+/* Computes the cookie the server expects from client @saddr connecting to
+ * local address @daddr. Called from softirq context.
+ */
+void tcp_fastopen_cookie_gen(__be32 saddr, __be32 daddr,
+			     struct tcp_fastopen_cookie *foc)
+{
+	__u32 *tmp = __get_cpu_var(tcp_fastopen_scratch);
+
+	tmp[0] = (__force u32)saddr;
+	tmp[1] = (__force u32)daddr;
+	memcpy(tmp + 2, tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	sha_transform(tmp + 16, (char *)tmp, tmp + 16 + SHA_DIGEST_WORDS);
+
+	memcpy(foc->val, tmp + 16, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+/* The client side cache lives in the inet_peer of the destination, next to
+ * the TIME-WAIT timestamps. Readers and writers of the cookie may race from
+ * different sockets, so the multi-word copy is guarded by a seqlock.
+ */
+static DEFINE_SEQLOCK(tcp_fastopen_seqlock);
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	struct inet_peer *peer;
+	bool release_it;
+	unsigned int seq;
+
+	cookie->len = 0;
+	*syn_loss = 0;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	do {
+		seq = read_seqbegin(&tcp_fastopen_seqlock);
+		if (peer->tcp_fastopen_mss)
+			*mss = peer->tcp_fastopen_mss;
+		cookie->len = peer->tcp_fastopen_cookie_len;
+		if (cookie->len > 0)
+			memcpy(cookie->val, peer->tcp_fastopen_cookie,
+			       cookie->len);
+		*syn_loss = peer->tcp_fastopen_syn_loss;
+		*last_syn_loss = *syn_loss ?
+				 peer->tcp_fastopen_last_syn_loss : 0;
+	} while (read_seqretry(&tcp_fastopen_seqlock, seq));
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	write_seqlock_bh(&tcp_fastopen_seqlock);
+	peer->tcp_fastopen_mss = mss;
+	if (syn_lost) {
+		peer->tcp_fastopen_syn_loss++;
+		peer->tcp_fastopen_last_syn_loss = jiffies;
+	} else {
+		peer->tcp_fastopen_syn_loss = 0;
+	}
+	if (cookie->len > 0) {
+		memcpy(peer->tcp_fastopen_cookie, cookie->val, cookie->len);
+		peer->tcp_fastopen_cookie_len = cookie->len;
+	}
+	write_sequnlock_bh(&tcp_fastopen_seqlock);
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+void tcp_free_fastopen_req(struct tcp_sock *tp)
+{
+	if (tp->fastopen_req != NULL) {
+		kfree(tp->fastopen_req);
+		tp->fastopen_req = NULL;
+	}
+}
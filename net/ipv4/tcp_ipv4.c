@@ -1252,10 +1252,158 @@ static const struct tcp_request_sock_ops tcp_request_sock_ipv4_ops = {
 };
 #endif
 
+/* Decides whether the data in a SYN may be accepted before the 3WHS
+ * completes. @valid_foc is filled in with the cookie to return in the
+ * SYN-ACK when the client asked for one or presented a stale one.
+ */
+static bool tcp_fastopen_check(struct sock *sk, struct sk_buff *skb,
+			       struct request_sock *req,
+			       struct tcp_fastopen_cookie *foc,
+			       struct tcp_fastopen_cookie *valid_foc)
+{
+	struct fastopen_queue *fastopenq;
+	bool skip_cookie = false;
+
+	if (likely(!fastopen_cookie_present(foc))) {
+		if ((sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_REQD) &&
+		    TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1)
+			skip_cookie = true;
+		else
+			return false;
+	}
+
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+
+	/* Check the listener before spending cycles on the cookie */
+	fastopenq = inet_csk(sk)->icsk_accept_queue.fastopenq;
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    fastopenq == NULL || fastopenq->max_qlen == 0)
+		return false;
+
+	if (fastopenq->qlen >= fastopenq->max_qlen) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		/* Not a failed cookie: keep PASSIVEFAIL out of it */
+		foc->len = -1;
+		return false;
+	}
+
+	if (skip_cookie) {
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		return true;
+	}
+
+	tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, ip_hdr(skb)->daddr,
+				valid_foc);
+	if (foc->len == TCP_FASTOPEN_COOKIE_SIZE) {
+		if (!(sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_CHKED) &&
+		    memcmp(foc->val, valid_foc->val,
+			   TCP_FASTOPEN_COOKIE_SIZE) != 0)
+			return false;
+		/* Client already holds a good cookie, do not echo it */
+		valid_foc->len = -1;
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		return true;
+	}
+	if (foc->len == 0)
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+	return false;
+}
+
+/* Creates the child socket straight from the SYN and queues it for
+ * accept(), together with any data the SYN carried. The request_sock
+ * stays attached to the child until the SYN-ACK is acknowledged, to
+ * drive SYN-ACK retransmits from the child's retransmit timer.
+ */
+static int tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				    struct dst_entry *dst,
+				    struct request_sock *req,
+				    struct request_values *rvp)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	const struct inet_request_sock *ireq = inet_rsk(req);
+	struct sk_buff *skb_synack;
+	struct tcp_sock *tp;
+	struct sock *child;
+	struct flowi4 fl4;
+	int err;
+
+	if (!dst && (dst = inet_csk_route_req(sk, &fl4, req)) == NULL)
+		return -1;
+
+	skb_synack = tcp_make_synack(sk, dst, req, rvp);
+	if (skb_synack == NULL) {
+		dst_release(dst);
+		return -1;
+	}
+	__tcp_v4_send_check(skb_synack, ireq->loc_addr, ireq->rmt_addr);
+
+	req->retrans = 0;
+	req->sk = NULL;
+	/* No RTT sample can be taken from a handshake not yet completed */
+	tcp_rsk(req)->snt_synack = 0;
+
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
+	if (child == NULL) {
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		kfree_skb(skb_synack);
+		return -1;
+	}
+
+	err = ip_build_and_send_pkt(skb_synack, sk, ireq->loc_addr,
+				    ireq->rmt_addr, ireq->opt);
+	if (!net_xmit_eval(err))
+		tcp_rsk(req)->snt_synack = tcp_time_stamp;
+
+	spin_lock(&queue->fastopenq->lock);
+	queue->fastopenq->qlen++;
+	spin_unlock(&queue->fastopenq->lock);
+
+	tp = tcp_sk(child);
+	tp->fastopen_rsk = req;
+	/* The listener must outlive the req, see reqsk_fastopen_remove() */
+	sock_hold(sk);
+	tcp_rsk(req)->listener = sk;
+
+	/* RFC1323: the window in SYN segments is never scaled */
+	tp->snd_wnd = ntohs(tcp_hdr(skb)->window);
+
+	/* The req never enters the SYN table, so the child retransmits
+	 * the SYN-ACK off its own timer.
+	 */
+	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT, TCP_RTO_MAX);
+
+	inet_csk_reqsk_queue_add(sk, req, child);
+
+	inet_csk(child)->icsk_af_ops->rebuild_header(child);
+	tcp_init_congestion_control(child);
+	tcp_mtup_init(child);
+	tcp_init_buffer_space(child);
+	tcp_init_metrics(child);
+
+	if (TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1) {
+		/* The caller frees the SYN, hence the extra reference */
+		skb = skb_get(skb);
+		skb_dst_drop(skb);
+		__skb_pull(skb, tcp_hdr(skb)->doff * 4);
+		skb_set_owner_r(skb, child);
+		__skb_queue_tail(&child->sk_receive_queue, skb);
+		tp->syn_data_acked = 1;
+	}
+	tp->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+
+	sk->sk_data_ready(sk, 0);
+	bh_unlock_sock(child);
+	sock_put(child);
+	return 0;
+}
+
 int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_extend_values tmp_ext;
 	struct tcp_options_received tmp_opt;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
 	const u8 *hash_location;
 	struct request_sock *req;
 	struct inet_request_sock *ireq;
@@ -1265,6 +1413,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	__be32 daddr = ip_hdr(skb)->daddr;
 	__u32 isn = TCP_SKB_CB(skb)->when;
 	int want_cookie = 0;
+	bool do_fastopen = false;
 
 	/* Never answer to SYNs send to broadcast or multicast */
 	if (skb_rtable(skb)->rt_flags & (RTCF_BROADCAST | RTCF_MULTICAST))
@@ -1299,7 +1448,8 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_clear_options(&tmp_opt);
 	tmp_opt.mss_clamp = TCP_MSS_DEFAULT;
 	tmp_opt.user_mss  = tp->rx_opt.user_mss;
-	tcp_parse_options(skb, &tmp_opt, &hash_location, 0);
+	tcp_parse_options(skb, &tmp_opt, &hash_location, 0,
+			  want_cookie ? NULL : &foc);
 
 	if (tmp_opt.cookie_plus > 0 &&
 	    tmp_opt.saw_tstamp &&
@@ -1334,6 +1484,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 		goto drop_and_release;
 	}
 	tmp_ext.cookie_in_always = tp->rx_opt.cookie_in_always;
+	tmp_ext.fastopen_cookie.len = -1;
 
 	if (want_cookie && !tmp_opt.saw_tstamp)
 		tcp_clear_options(&tmp_opt);
@@ -1405,12 +1556,24 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_rsk(req)->snt_isn = isn;
 	tcp_rsk(req)->snt_synack = tcp_time_stamp;
 
-	if (tcp_v4_send_synack(sk, dst, req,
-			       (struct request_values *)&tmp_ext) ||
-	    want_cookie)
+	if (!want_cookie)
+		do_fastopen = tcp_fastopen_check(sk, skb, req, &foc,
+						 &tmp_ext.fastopen_cookie);
+
+	if (likely(!do_fastopen)) {
+		if (tcp_v4_send_synack(sk, dst, req,
+				       (struct request_values *)&tmp_ext) ||
+		    want_cookie)
+			goto drop_and_free;
+
+		inet_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+		if (fastopen_cookie_present(&foc) && foc.len != 0)
+			NET_INC_STATS_BH(sock_net(sk),
+					 LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+	} else if (tcp_v4_conn_req_fastopen(sk, skb, dst, req,
+					    (struct request_values *)&tmp_ext)) {
 		goto drop_and_free;
-
-	inet_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+	}
 	return 0;
 
 drop_and_release:
@@ -1974,6 +2137,11 @@ void tcp_v4_destroy_sock(struct sock *sk)
 		sk->sk_sndmsg_page = NULL;
 	}
 
+	/* A Fast Open child aborted before its 3WHS completed */
+	if (tp->fastopen_rsk != NULL)
+		reqsk_fastopen_remove(sk, tp->fastopen_rsk);
+	tcp_free_fastopen_req(tp);
+
 	/* TCP Cookie Transactions */
 	if (tp->cookie_values != NULL) {
 		kref_put(&tp->cookie_values->kref,
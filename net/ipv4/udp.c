@@ -94,6 +94,7 @@
 #include <linux/timer.h>
 #include <linux/mm.h>
 #include <linux/inet.h>
+#include <linux/jump_label.h>
 #include <linux/netdevice.h>
 #include <linux/slab.h>
 #include <net/tcp_states.h>
@@ -123,6 +124,11 @@ EXPORT_SYMBOL(sysctl_udp_wmem_min);
 atomic_long_t udp_memory_allocated;
 EXPORT_SYMBOL(udp_memory_allocated);
 
+/* Switched on by the first socket that sets UDP_GRO. Until then GRO does
+ * not look up UDP sockets at all.
+ */
+static struct jump_label_key udp_gro_needed __read_mostly;
+
 #define MAX_UDP_PORTS 65536
 #define PORTS_PER_CHAIN (MAX_UDP_PORTS / UDP_HTABLE_SIZE_MIN)
 
@@ -707,7 +713,8 @@ static void udp4_hwcsum(struct sk_buff *skb, __be32 src, __be32 dst)
 	}
 }
 
-static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4)
+static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4,
+			unsigned int gso_size)
 {
 	struct sock *sk = skb->sk;
 	struct inet_sock *inet = inet_sk(sk);
@@ -716,6 +723,7 @@ static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4)
 	int is_udplite = IS_UDPLITE(sk);
 	int offset = skb_transport_offset(skb);
 	int len = skb->len - offset;
+	int datalen = len - sizeof(*uh);
 	__wsum csum = 0;
 
 	/*
@@ -727,6 +735,30 @@ static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4)
 	uh->len = htons(len);
 	uh->check = 0;
 
+	if (gso_size) {
+		/* Every segment must fit the path mtu on its own, and the
+		 * segments are always checksummed.
+		 */
+		if (offset + sizeof(*uh) + gso_size > dst_mtu(skb_dst(skb)) ||
+		    datalen > gso_size * UDP_MAX_SEGMENTS ||
+		    is_udplite || sk->sk_no_check == UDP_CSUM_NOXMIT) {
+			kfree_skb(skb);
+			return -EINVAL;
+		}
+
+		if (datalen > gso_size) {
+			skb_shinfo(skb)->gso_size = gso_size;
+			skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+			skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(datalen,
+								 gso_size);
+
+			/* Checksums are filled in per segment */
+			skb->ip_summed = CHECKSUM_PARTIAL;
+			udp4_hwcsum(skb, fl4->saddr, fl4->daddr);
+			goto send;
+		}
+	}
+
 	if (is_udplite)  				 /*     UDP-Lite      */
 		csum = udplite_csum(skb);
 
@@ -778,7 +810,7 @@ static int udp_push_pending_frames(struct sock *sk)
 	if (!skb)
 		goto out;
 
-	err = udp_send_skb(skb, fl4);
+	err = udp_send_skb(skb, fl4, 0);
 
 out:
 	up->len = 0;
@@ -786,6 +818,26 @@ out:
 	return err;
 }
 
+/* A UDP_SEGMENT control message overrides the socket's segment size for
+ * one send. Other SOL_IP messages are left to ip_cmsg_send().
+ */
+static int udp_cmsg_send(struct msghdr *msg, u16 *gso_size)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (!CMSG_OK(msg, cmsg))
+			return -EINVAL;
+		if (cmsg->cmsg_level != SOL_UDP)
+			continue;
+		if (cmsg->cmsg_type != UDP_SEGMENT ||
+		    cmsg->cmsg_len != CMSG_LEN(sizeof(__u16)))
+			return -EINVAL;
+		*gso_size = *(__u16 *)CMSG_DATA(cmsg);
+	}
+	return 0;
+}
+
 int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		size_t len)
 {
@@ -819,6 +871,7 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	ipc.opt = NULL;
 	ipc.tx_flags = 0;
+	ipc.gso_size = up->gso_size;
 
 	getfrag = is_udplite ? udplite_getfrag : ip_generic_getfrag;
 
@@ -873,6 +926,9 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	if (err)
 		return err;
 	if (msg->msg_controllen) {
+		err = udp_cmsg_send(msg, &ipc.gso_size);
+		if (err)
+			return err;
 		err = ip_cmsg_send(sock_net(sk), msg, &ipc);
 		if (err)
 			return err;
@@ -963,7 +1019,7 @@ back_from_confirm:
 				  msg->msg_flags);
 		err = PTR_ERR(skb);
 		if (skb && !IS_ERR(skb))
-			err = udp_send_skb(skb, fl4);
+			err = udp_send_skb(skb, fl4, ipc.gso_size);
 		goto out;
 	}
 
@@ -1233,6 +1289,11 @@ try_again:
 	}
 	if (inet->cmsg_flags)
 		ip_cmsg_recv(msg, skb);
+	if (udp_sk(sk)->gro_enabled && skb_is_gso(skb)) {
+		int gso_size = skb_shinfo(skb)->gso_size;
+
+		put_cmsg(msg, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+	}
 
 	err = copied;
 	if (flags & MSG_TRUNC)
@@ -1384,7 +1445,7 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
  * Note that in the success and error cases, the skb is assumed to
  * have either been requeued or freed.
  */
-int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+static int udp_queue_rcv_one_skb(struct sock *sk, struct sk_buff *skb)
 {
 	struct udp_sock *up = udp_sk(sk);
 	int rc;
@@ -1492,6 +1553,69 @@ drop:
 	return -1;
 }
 
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb, u32 features);
+
+/* Splits a datagram coalesced by GRO, or sent over loopback with
+ * UDP_SEGMENT, back into the datagrams it was built from. The segments
+ * start at the UDP header, like the skb handed to udp_queue_rcv_skb().
+ */
+static struct sk_buff *udp_rcv_segment(struct sock *sk, struct sk_buff *skb)
+{
+	struct sk_buff *segs, *seg;
+	int is_udplite = IS_UDPLITE(sk);
+
+	segs = udp4_gso_segment(skb, NETIF_F_SG | NETIF_F_HW_CSUM);
+	if (IS_ERR_OR_NULL(segs)) {
+		UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS, is_udplite);
+		atomic_inc(&sk->sk_drops);
+		kfree_skb(skb);
+		return NULL;
+	}
+	consume_skb(skb);
+
+	for (seg = segs; seg; seg = seg->next) {
+		struct iphdr *iph = ip_hdr(seg);
+		__be16 newlen = htons(seg->len - skb_network_offset(seg));
+
+		csum_replace2(&iph->check, iph->tot_len, newlen);
+		iph->tot_len = newlen;
+		__skb_pull(seg, skb_transport_offset(seg));
+
+		/* The coalesced datagram was verified as a whole */
+		seg->ip_summed = CHECKSUM_UNNECESSARY;
+	}
+	return segs;
+}
+
+/* returns:
+ *  -1: error
+ *   0: success
+ *  >0: "udp encap" protocol resubmission
+ *
+ * A coalesced datagram is only queued as is to sockets that asked for it
+ * with UDP_GRO; everyone else gets the original datagrams.
+ */
+int udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	struct udp_sock *up = udp_sk(sk);
+	struct sk_buff *next;
+	int ret;
+
+	if (likely(!skb_is_gso(skb)) ||
+	    (up->gro_enabled && !up->encap_type))
+		return udp_queue_rcv_one_skb(sk, skb);
+
+	for (skb = udp_rcv_segment(sk, skb); skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		ret = udp_queue_rcv_one_skb(sk, skb);
+		/* Segments cannot be resubmitted to another protocol */
+		if (ret > 0)
+			kfree_skb(skb);
+	}
+	return 0;
+}
+
 
 static void flush_stack(struct sock **stack, unsigned int count,
 			struct sk_buff *skb, unsigned int final)
@@ -1771,6 +1895,23 @@ int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 		}
 		break;
 
+	/* Segmentation and coalescing offloads, IPv4 UDP only. */
+	case UDP_SEGMENT:
+		if (is_udplite || sk->sk_family != AF_INET)
+			return -ENOPROTOOPT;
+		if (val < 0 || val > USHRT_MAX)
+			return -EINVAL;
+		up->gso_size = val;
+		break;
+
+	case UDP_GRO:
+		if (is_udplite || sk->sk_family != AF_INET)
+			return -ENOPROTOOPT;
+		if (val && !jump_label_enabled(&udp_gro_needed))
+			jump_label_inc(&udp_gro_needed);
+		up->gro_enabled = !!val;
+		break;
+
 	/*
 	 * 	UDP-Lite's partial checksum coverage (RFC 3828).
 	 */
@@ -1853,6 +1994,14 @@ int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 		val = up->encap_type;
 		break;
 
+	case UDP_SEGMENT:
+		val = up->gso_size;
+		break;
+
+	case UDP_GRO:
+		val = up->gro_enabled;
+		break;
+
 	/* The following two cannot be changed on UDP sockets, the return is
 	 * always 0 (which corresponds to the full checksum coverage of UDP). */
 	case UDPLITE_SEND_CSCOV:
@@ -2247,6 +2396,51 @@ int udp4_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+/* Cuts a SKB_GSO_UDP_L4 datagram into datagrams of gso_size payload, each
+ * with its own UDP length and checksum. IP headers are left to the caller.
+ */
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb, u32 features)
+{
+	const struct iphdr *iph;
+	struct sk_buff *segs, *seg;
+	struct udphdr *uh;
+	unsigned int len;
+
+	if (unlikely(!pskb_may_pull(skb, sizeof(*uh))))
+		return ERR_PTR(-EINVAL);
+	if (unlikely(skb->len <= sizeof(*uh) + skb_shinfo(skb)->gso_size))
+		return ERR_PTR(-EINVAL);
+
+	iph = ip_hdr(skb);
+	__skb_pull(skb, sizeof(*uh));
+
+	segs = skb_segment(skb, features);
+	if (IS_ERR_OR_NULL(segs))
+		return segs;
+
+	for (seg = segs; seg; seg = seg->next) {
+		uh = udp_hdr(seg);
+		len = seg->len - skb_transport_offset(seg);
+		uh->len = htons(len);
+
+		if (seg->ip_summed == CHECKSUM_PARTIAL) {
+			seg->csum_start = skb_transport_header(seg) - seg->head;
+			seg->csum_offset = offsetof(struct udphdr, check);
+			uh->check = ~csum_tcpudp_magic(iph->saddr, iph->daddr,
+						       len, IPPROTO_UDP, 0);
+		} else {
+			/* skb_segment() summed the payload while copying */
+			uh->check = 0;
+			uh->check = csum_tcpudp_magic(iph->saddr, iph->daddr,
+					len, IPPROTO_UDP,
+					csum_partial(uh, sizeof(*uh), seg->csum));
+			if (uh->check == 0)
+				uh->check = CSUM_MANGLED_0;
+		}
+	}
+	return segs;
+}
+
 struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features)
 {
 	struct sk_buff *segs = ERR_PTR(-EINVAL);
@@ -2254,6 +2448,9 @@ struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features)
 	int offset;
 	__wsum csum;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return udp4_gso_segment(skb, features);
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
@@ -2289,3 +2486,115 @@ out:
 	return segs;
 }
 
+/* Bound the truesize a flood of small datagrams can pile up in one skb */
+#define UDP_GRO_CNT_MAX 64
+
+/* Coalesces datagrams of one flow into a single skb for sockets that set
+ * UDP_GRO. All but the last datagram must carry the same payload size,
+ * which is kept in gso_size so that the datagrams can be restored.
+ */
+struct sk_buff **udp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
+{
+	const struct iphdr *iph = skb_gro_network_header(skb);
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	struct udphdr *uh, *uh2;
+	unsigned int hlen, off, ulen;
+	struct sock *sk;
+	int gro = 0;
+
+	if (!static_branch(&udp_gro_needed))
+		goto flush;
+
+	/* Fragments and the like, as found by inet_gro_receive() */
+	if (NAPI_GRO_CB(skb)->flush)
+		goto flush;
+
+	off = skb_gro_offset(skb);
+	hlen = off + sizeof(*uh);
+	uh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		uh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!uh))
+			goto flush;
+	}
+
+	/* Segments get a checksum of their own, so one is required here */
+	ulen = ntohs(uh->len);
+	if (ulen != skb_gro_len(skb) || ulen <= sizeof(*uh) || !uh->check)
+		goto flush;
+
+	switch (skb->ip_summed) {
+	case CHECKSUM_COMPLETE:
+		if (!csum_tcpudp_magic(iph->saddr, iph->daddr, ulen,
+				       IPPROTO_UDP, skb->csum)) {
+			skb->ip_summed = CHECKSUM_UNNECESSARY;
+			break;
+		}
+
+		/* fall through */
+	case CHECKSUM_NONE:
+		goto flush;
+	}
+
+	sk = __udp4_lib_lookup(dev_net(skb->dev), iph->saddr, uh->source,
+			       iph->daddr, uh->dest, skb->dev->ifindex,
+			       &udp_table);
+	if (sk) {
+		gro = udp_sk(sk)->gro_enabled && !udp_sk(sk)->encap_type;
+		sock_put(sk);
+	}
+	if (!gro)
+		goto flush;
+
+	skb_gro_pull(skb, sizeof(*uh));
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = udp_hdr(p);
+		if (*(u32 *)&uh->source != *(u32 *)&uh2->source) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		/* The IP headers differ in more than the length */
+		if (NAPI_GRO_CB(p)->flush)
+			return head;
+
+		/* A datagram larger than the ones held starts a new train,
+		 * a shorter one ends the current train.
+		 */
+		if (skb_gro_len(skb) > skb_shinfo(p)->gso_size ||
+		    skb_gro_receive(head, skb) ||
+		    NAPI_GRO_CB(*head)->count >= UDP_GRO_CNT_MAX ||
+		    uh->len != uh2->len)
+			pp = head;
+		return pp;
+	}
+	return NULL;
+
+flush:
+	NAPI_GRO_CB(skb)->flush = 1;
+	return NULL;
+}
+
+int udp4_gro_complete(struct sk_buff *skb)
+{
+	const struct iphdr *iph = ip_hdr(skb);
+	struct udphdr *uh = udp_hdr(skb);
+	unsigned int len = skb->len - skb_transport_offset(skb);
+
+	uh->len = htons(len);
+	uh->check = ~csum_tcpudp_magic(iph->saddr, iph->daddr, len,
+				       IPPROTO_UDP, 0);
+	skb->csum_start = skb_transport_header(skb) - skb->head;
+	skb->csum_offset = offsetof(struct udphdr, check);
+	skb->ip_summed = CHECKSUM_PARTIAL;
+
+	skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+	skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+
+	return 0;
+}
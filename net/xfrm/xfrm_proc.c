@@ -43,6 +43,10 @@ static const struct snmp_mib xfrm_mib_list[] = {
 	SNMP_MIB_ITEM("XfrmOutPolDead", LINUX_MIB_XFRMOUTPOLDEAD),
 	SNMP_MIB_ITEM("XfrmOutPolError", LINUX_MIB_XFRMOUTPOLERROR),
 	SNMP_MIB_ITEM("XfrmFwdHdrError", LINUX_MIB_XFRMFWDHDRERROR),
+	SNMP_MIB_ITEM("XfrmPolicyLookup", LINUX_MIB_XFRMPOLLOOKUP),
+	SNMP_MIB_ITEM("XfrmPolicyInexactWalk", LINUX_MIB_XFRMPOLINEXACTWALK),
+	SNMP_MIB_ITEM("XfrmStateLookup", LINUX_MIB_XFRMSTATELOOKUP),
+	SNMP_MIB_ITEM("XfrmStateLookupRetry", LINUX_MIB_XFRMSTATELOOKUPRETRY),
 	SNMP_MIB_SENTINEL
 };
 
@@ -33,6 +33,11 @@
    1. Hash table by (spi,daddr,ah/esp) to find SA by SPI. (input,ctl)
    2. Hash table by (daddr,family,reqid) to find what SAs exist for given
       destination/tunnel endpoint. (output)
+
+   The SPI table is walked under RCU by xfrm_state_lookup(), all other
+   users and every writer hold xfrm_state_lock. A resize bumps
+   state_hash_generation so that a lookup which misses while entries are
+   being moved to the new table tries again.
  */
 
 static DEFINE_SPINLOCK(xfrm_state_lock);
@@ -92,7 +97,7 @@ static void xfrm_hash_transfer(struct hlist_head *list,
 			h = __xfrm_spi_hash(&x->id.daddr, x->id.spi,
 					    x->id.proto, x->props.family,
 					    nhashmask);
-			hlist_add_head(&x->byspi, nspitable+h);
+			hlist_add_head_rcu(&x->byspi, nspitable+h);
 		}
 	}
 }
@@ -131,6 +136,7 @@ static void xfrm_hash_resize(struct work_struct *work)
 	}
 
 	spin_lock_bh(&xfrm_state_lock);
+	write_seqcount_begin(&net->xfrm.state_hash_generation);
 
 	nhashmask = (nsize / sizeof(struct hlist_head)) - 1U;
 	for (i = net->xfrm.state_hmask; i >= 0; i--)
@@ -144,11 +150,17 @@ static void xfrm_hash_resize(struct work_struct *work)
 
 	net->xfrm.state_bydst = ndst;
 	net->xfrm.state_bysrc = nsrc;
-	net->xfrm.state_byspi = nspi;
+	rcu_assign_pointer(net->xfrm.state_byspi, nspi);
+	/* Pairs with the smp_rmb() in __xfrm_state_lookup(): a reader that
+	 * sees the larger mask also sees the larger table. */
+	smp_wmb();
 	net->xfrm.state_hmask = nhashmask;
 
+	write_seqcount_end(&net->xfrm.state_hash_generation);
 	spin_unlock_bh(&xfrm_state_lock);
 
+	synchronize_rcu();
+
 	osize = (ohashmask + 1) * sizeof(struct hlist_head);
 	xfrm_hash_free(odst, osize);
 	xfrm_hash_free(osrc, osize);
@@ -383,6 +395,9 @@ static void xfrm_state_gc_task(struct work_struct *work)
 	hlist_move_list(&net->xfrm.state_gc_list, &gc_list);
 	spin_unlock_bh(&xfrm_state_gc_lock);
 
+	/* Lockless SPI lookups may still be looking at these */
+	synchronize_rcu();
+
 	hlist_for_each_entry_safe(x, entry, tmp, &gc_list, gclist)
 		xfrm_state_gc_destroy(x);
 
@@ -537,7 +552,7 @@ int __xfrm_state_delete(struct xfrm_state *x)
 		hlist_del(&x->bydst);
 		hlist_del(&x->bysrc);
 		if (x->id.spi)
-			hlist_del(&x->byspi);
+			hlist_del_rcu(&x->byspi);
 		net->xfrm.state_num--;
 		spin_unlock(&xfrm_state_lock);
 
@@ -679,10 +694,14 @@ static struct xfrm_state *__xfrm_state_lookup(struct net *net, u32 mark,
 					      unsigned short family)
 {
 	unsigned int h = xfrm_spi_hash(net, daddr, spi, proto, family);
+	struct hlist_head *table;
 	struct xfrm_state *x;
 	struct hlist_node *entry;
 
-	hlist_for_each_entry(x, entry, net->xfrm.state_byspi+h, byspi) {
+	smp_rmb();
+	table = rcu_dereference_check(net->xfrm.state_byspi,
+				      lockdep_is_held(&xfrm_state_lock));
+	hlist_for_each_entry_rcu(x, entry, table + h, byspi) {
 		if (x->props.family != family ||
 		    x->id.spi       != spi ||
 		    x->id.proto     != proto ||
@@ -691,7 +710,9 @@ static struct xfrm_state *__xfrm_state_lookup(struct net *net, u32 mark,
 
 		if ((mark & x->mark.m) != x->mark.v)
 			continue;
-		xfrm_state_hold(x);
+		/* Unhashed and on its way to the gc list */
+		if (!atomic_inc_not_zero(&x->refcnt))
+			continue;
 		return x;
 	}
 
@@ -870,7 +891,7 @@ found:
 			hlist_add_head(&x->bysrc, net->xfrm.state_bysrc+h);
 			if (x->id.spi) {
 				h = xfrm_spi_hash(net, &x->id.daddr, x->id.spi, x->id.proto, encap_family);
-				hlist_add_head(&x->byspi, net->xfrm.state_byspi+h);
+				hlist_add_head_rcu(&x->byspi, net->xfrm.state_byspi+h);
 			}
 			x->lft.hard_add_expires_seconds = net->xfrm.sysctl_acq_expires;
 			tasklet_hrtimer_start(&x->mtimer, ktime_set(net->xfrm.sysctl_acq_expires, 0), HRTIMER_MODE_REL);
@@ -946,7 +967,7 @@ static void __xfrm_state_insert(struct xfrm_state *x)
 		h = xfrm_spi_hash(net, &x->id.daddr, x->id.spi, x->id.proto,
 				  x->props.family);
 
-		hlist_add_head(&x->byspi, net->xfrm.state_byspi+h);
+		hlist_add_head_rcu(&x->byspi, net->xfrm.state_byspi+h);
 	}
 
 	tasklet_hrtimer_start(&x->mtimer, ktime_set(1, 0), HRTIMER_MODE_REL);
@@ -1386,10 +1407,20 @@ xfrm_state_lookup(struct net *net, u32 mark, const xfrm_address_t *daddr, __be32
 		  u8 proto, unsigned short family)
 {
 	struct xfrm_state *x;
+	unsigned int seq;
 
-	spin_lock_bh(&xfrm_state_lock);
+	XFRM_INC_STATS(net, LINUX_MIB_XFRMSTATELOOKUP);
+
+	rcu_read_lock();
+	seq = read_seqcount_begin(&net->xfrm.state_hash_generation);
 	x = __xfrm_state_lookup(net, mark, daddr, spi, proto, family);
-	spin_unlock_bh(&xfrm_state_lock);
+	while (!x && read_seqcount_retry(&net->xfrm.state_hash_generation,
+					 seq)) {
+		XFRM_INC_STATS(net, LINUX_MIB_XFRMSTATELOOKUPRETRY);
+		seq = read_seqcount_begin(&net->xfrm.state_hash_generation);
+		x = __xfrm_state_lookup(net, mark, daddr, spi, proto, family);
+	}
+	rcu_read_unlock();
 	return x;
 }
 EXPORT_SYMBOL(xfrm_state_lookup);
@@ -1549,7 +1580,7 @@ int xfrm_alloc_spi(struct xfrm_state *x, u32 low, u32 high)
 	if (x->id.spi) {
 		spin_lock_bh(&xfrm_state_lock);
 		h = xfrm_spi_hash(net, &x->id.daddr, x->id.spi, x->id.proto, x->props.family);
-		hlist_add_head(&x->byspi, net->xfrm.state_byspi+h);
+		hlist_add_head_rcu(&x->byspi, net->xfrm.state_byspi+h);
 		spin_unlock_bh(&xfrm_state_lock);
 
 		err = 0;
@@ -2029,6 +2060,7 @@ int __net_init xfrm_state_init(struct net *net)
 	net->xfrm.state_hmask = ((sz / sizeof(struct hlist_head)) - 1);
 
 	net->xfrm.state_num = 0;
+	seqcount_init(&net->xfrm.state_hash_generation);
 	INIT_WORK(&net->xfrm.state_hash_work, xfrm_hash_resize);
 	INIT_HLIST_HEAD(&net->xfrm.state_gc_list);
 	INIT_WORK(&net->xfrm.state_gc_work, xfrm_state_gc_task);
@@ -12,6 +12,8 @@ ifenslave bond0 eth0 eth1 eth2 eth3
 
 ifconfig bond0 down
 echo balance-alb > /sys/class/net/bond0/bonding/mode
+#echo 802.3ad > /sys/class/net/bond0/bonding/mode
+#echo layer3+4 > /sys/class/net/bond0/bonding/xmit_hash_policy
 ifconfig bond0 up
 #ifconfig bond0 10.4.53.196 netmask 255.255.255.0 up
 
@@ -0,0 +1,179 @@
+/*
+ * ct_rate - conntrack new connection rate benchmark
+ *
+ * Starts one sender thread per requested CPU. Every datagram a thread
+ * sends uses a fresh source port, so each one creates, confirms and
+ * later destroys a conntrack entry on the way out. The peer is expected
+ * to drop the packets; what is measured is the rate at which the local
+ * conntrack table accepts new flows. See ct_rate.sh for a veth setup.
+ *
+ *	ct_rate -d 10.99.0.2 -t 4 -s 10
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define CT_COUNT	"/proc/sys/net/netfilter/nf_conntrack_count"
+#define CT_MAX		"/proc/sys/net/netfilter/nf_conntrack_max"
+
+struct sender {
+	pthread_t thread;
+	int cpu;
+	unsigned long sent;
+	unsigned long failed;
+};
+
+static struct in_addr daddr;
+static unsigned short dport = 9;
+static volatile int stop;
+
+static void *sender_run(void *arg)
+{
+	struct sender *s = arg;
+	struct sockaddr_in dst;
+	unsigned short port;
+	cpu_set_t set;
+	char buf[16];
+
+	CPU_ZERO(&set);
+	CPU_SET(s->cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		fprintf(stderr, "cannot bind to cpu %d\n", s->cpu);
+
+	memset(&dst, 0, sizeof(dst));
+	dst.sin_family = AF_INET;
+	dst.sin_addr = daddr;
+	memset(buf, 0, sizeof(buf));
+
+	/* Spread the threads over distinct source port ranges */
+	port = 1024 + s->cpu * 4096;
+	while (!stop) {
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+		if (fd < 0) {
+			perror("socket");
+			break;
+		}
+		/* Unbound socket: the kernel picks a new ephemeral port,
+		 * vary the destination port as well to make every tuple
+		 * unique even once the port space wraps. */
+		dst.sin_port = htons(dport + (port++ & 0x3fff));
+		if (sendto(fd, buf, sizeof(buf), 0,
+			   (struct sockaddr *)&dst, sizeof(dst)) < 0)
+			s->failed++;
+		else
+			s->sent++;
+		close(fd);
+	}
+	return NULL;
+}
+
+static long read_long(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	long val = -1;
+
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -d <peer address> [-p <base port>] [-t <threads>]"
+		" [-s <seconds>]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned long sent = 0, failed = 0;
+	struct sender *senders;
+	int seconds = 10;
+	double start, elapsed;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "d:p:t:s:")) != -1) {
+		switch (c) {
+		case 'd':
+			if (!inet_aton(optarg, &daddr))
+				usage(argv[0]);
+			break;
+		case 'p':
+			dport = atoi(optarg);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!daddr.s_addr || nthreads < 1 || seconds < 1)
+		usage(argv[0]);
+
+	senders = calloc(nthreads, sizeof(*senders));
+	if (!senders) {
+		perror("calloc");
+		return 1;
+	}
+
+	start = now();
+	for (i = 0; i < nthreads; i++) {
+		senders[i].cpu = i;
+		errno = pthread_create(&senders[i].thread, NULL, sender_run,
+				       &senders[i]);
+		if (errno) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	printf("conntrack entries: %ld (max %ld)\n",
+	       read_long(CT_COUNT), read_long(CT_MAX));
+	stop = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(senders[i].thread, NULL);
+		sent += senders[i].sent;
+		failed += senders[i].failed;
+	}
+	elapsed = now() - start;
+
+	printf("threads %d: %lu flows in %.2fs, %.0f flows/sec, %lu dropped\n",
+	       nthreads, sent, elapsed, sent / elapsed, failed);
+	free(senders);
+	return 0;
+}
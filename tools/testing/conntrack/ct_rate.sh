@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Measure the conntrack new flow rate over a veth pair for 1..N sender
+# threads. The peer end lives in its own network namespace and drops
+# everything, so only the local conntrack path is exercised.
+#
+#	./ct_rate.sh [seconds]
+
+SECONDS_PER_RUN=${1:-10}
+NS=ct_rate_peer
+LOCAL=10.99.0.1
+PEER=10.99.0.2
+NCPU=$(getconf _NPROCESSORS_ONLN)
+
+RULE="OUTPUT -o ct_rate0 -m state --state NEW -j ACCEPT"
+
+cleanup() {
+	iptables -D $RULE 2>/dev/null
+	ip link del ct_rate0 2>/dev/null
+	ip netns del $NS 2>/dev/null
+}
+trap cleanup EXIT
+
+set -e
+cleanup
+ip netns add $NS
+ip link add ct_rate0 type veth peer name ct_rate1
+ip link set ct_rate1 netns $NS
+ip addr add $LOCAL/24 dev ct_rate0
+ip link set ct_rate0 up
+ip netns exec $NS ip addr add $PEER/24 dev ct_rate1
+ip netns exec $NS ip link set ct_rate1 up
+ip netns exec $NS ip link set lo up
+ip netns exec $NS iptables -A INPUT -p udp -j DROP
+
+# Make sure conntrack is loaded and tracking, and never fills up
+iptables -A $RULE
+echo 4194304 > /proc/sys/net/netfilter/nf_conntrack_max
+echo 2 > /proc/sys/net/netfilter/nf_conntrack_udp_timeout
+set +e
+
+# Resolve the neighbour once so it is not part of the measurement
+ping -c 1 -W 1 $PEER >/dev/null
+
+cd $(dirname $0)
+make -s ct_rate || exit 1
+
+t=1
+while [ $t -le $NCPU ]; do
+	./ct_rate -d $PEER -t $t -s $SECONDS_PER_RUN
+	# let the entries of the previous run expire
+	sleep 3
+	t=$((t + 1))
+done
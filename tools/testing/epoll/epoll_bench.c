@@ -0,0 +1,296 @@
+/*
+ * epoll_bench - epoll wakeup scalability benchmark
+ *
+ * Two tests, both with one thread pinned per cpu:
+ *
+ * herd:  every thread has its own epoll set watching one shared
+ *        eventfd, the way accept loops share a listening socket. A
+ *        producer posts one event at a time and waits for it to be
+ *        consumed. Reports events/sec and how many times the waiters
+ *        were woken per event, counted as context switches since
+ *        epoll hides the wakeups that find nothing to do. Run with -x
+ *        to add the fd with EPOLLEXCLUSIVE.
+ *
+ * ready: every thread signals its own eventfds, all of which sit in
+ *        one shared epoll set drained by a single consumer, so that
+ *        the poll callbacks of all cpus hit the same ready list.
+ *        Reports callbacks/sec and events/sec.
+ *
+ *	epoll_bench -t herd -x -n 8 -s 5
+ *	epoll_bench -t ready -n 8 -f 64 -s 5
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1u << 28)
+#endif
+
+struct worker {
+	pthread_t thread;
+	int cpu;
+	int epfd;
+	int *fds;
+	unsigned long events;
+	unsigned long wakeups;
+};
+
+static int nthreads;
+static int nfds = 16;
+static int exclusive;
+static volatile int stop;
+static volatile unsigned long consumed;
+static int shared_fd;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void bind_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *herd_waiter(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event ev;
+	struct rusage ru;
+	uint64_t val;
+	long nvcsw;
+
+	bind_cpu(w->cpu);
+	getrusage(RUSAGE_THREAD, &ru);
+	nvcsw = ru.ru_nvcsw;
+	while (!stop) {
+		if (epoll_wait(w->epfd, &ev, 1, 100) <= 0)
+			continue;
+		if (read(shared_fd, &val, sizeof(val)) == sizeof(val)) {
+			w->events++;
+			__sync_fetch_and_add(&consumed, 1);
+		}
+	}
+	getrusage(RUSAGE_THREAD, &ru);
+	w->wakeups = ru.ru_nvcsw - nvcsw;
+	return NULL;
+}
+
+static void run_herd(struct worker *workers, int seconds)
+{
+	unsigned long posted = 0, events = 0, wakeups = 0;
+	uint64_t one = 1;
+	double start, end;
+	int i;
+
+	shared_fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE);
+	if (shared_fd < 0)
+		die("eventfd");
+
+	for (i = 0; i < nthreads; i++) {
+		struct epoll_event ev = {
+			.events = EPOLLIN | (exclusive ? EPOLLEXCLUSIVE : 0),
+		};
+
+		workers[i].epfd = epoll_create1(0);
+		if (workers[i].epfd < 0)
+			die("epoll_create1");
+		if (epoll_ctl(workers[i].epfd, EPOLL_CTL_ADD, shared_fd, &ev))
+			die("epoll_ctl");
+		if (pthread_create(&workers[i].thread, NULL, herd_waiter,
+				   &workers[i]))
+			die("pthread_create");
+	}
+
+	/* let everybody go to sleep in epoll_wait() */
+	usleep(100000);
+
+	start = now();
+	end = start + seconds;
+	while (now() < end) {
+		if (write(shared_fd, &one, sizeof(one)) != sizeof(one))
+			die("write");
+		posted++;
+		while (consumed < posted)
+			sched_yield();
+	}
+	end = now();
+	stop = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		events += workers[i].events;
+		wakeups += workers[i].wakeups;
+		close(workers[i].epfd);
+	}
+
+	printf("herd%s threads %d: %.0f events/sec, %.2f wakeups/event\n",
+	       exclusive ? " exclusive" : "", nthreads,
+	       events / (end - start), events ? (double)wakeups / events : 0.0);
+}
+
+static void *ready_signaler(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t one = 1;
+	int i = 0;
+
+	bind_cpu(w->cpu);
+	while (!stop) {
+		if (write(w->fds[i], &one, sizeof(one)) == sizeof(one))
+			w->events++;
+		if (++i == nfds)
+			i = 0;
+	}
+	return NULL;
+}
+
+static void run_ready(struct worker *workers, int seconds)
+{
+	struct epoll_event *evs;
+	unsigned long callbacks = 0, events = 0;
+	double start, end;
+	uint64_t val;
+	int epfd, i, j, n;
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		die("epoll_create1");
+	evs = calloc(nthreads * nfds, sizeof(*evs));
+	if (!evs)
+		die("calloc");
+
+	for (i = 0; i < nthreads; i++) {
+		workers[i].fds = calloc(nfds, sizeof(int));
+		if (!workers[i].fds)
+			die("calloc");
+		for (j = 0; j < nfds; j++) {
+			struct epoll_event ev = { .events = EPOLLIN | EPOLLET };
+			int fd = eventfd(0, EFD_NONBLOCK);
+
+			if (fd < 0)
+				die("eventfd");
+			ev.data.fd = fd;
+			if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+				die("epoll_ctl");
+			workers[i].fds[j] = fd;
+		}
+	}
+
+	start = now();
+	end = start + seconds;
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&workers[i].thread, NULL, ready_signaler,
+				   &workers[i]))
+			die("pthread_create");
+
+	while (now() < end) {
+		n = epoll_wait(epfd, evs, nthreads * nfds, 100);
+		for (i = 0; i < n; i++)
+			if (read(evs[i].data.fd, &val, sizeof(val)) ==
+			    sizeof(val))
+				events++;
+	}
+	end = now();
+	stop = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		callbacks += workers[i].events;
+		for (j = 0; j < nfds; j++)
+			close(workers[i].fds[j]);
+		free(workers[i].fds);
+	}
+	close(epfd);
+	free(evs);
+
+	printf("ready threads %d fds %d: %.0f callbacks/sec, %.0f events/sec\n",
+	       nthreads, nthreads * nfds, callbacks / (end - start),
+	       events / (end - start));
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -t herd|ready [-x] [-n <threads>] [-f <fds per thread>]"
+		" [-s <seconds>]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *workers;
+	const char *test = NULL;
+	int seconds = 5;
+	int i, c;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "t:xn:f:s:")) != -1) {
+		switch (c) {
+		case 't':
+			test = optarg;
+			break;
+		case 'x':
+			exclusive = 1;
+			break;
+		case 'n':
+			nthreads = atoi(optarg);
+			break;
+		case 'f':
+			nfds = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!test || nthreads < 1 || nfds < 1 || seconds < 1)
+		usage(argv[0]);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+	for (i = 0; i < nthreads; i++)
+		workers[i].cpu = i;
+
+	if (!strcmp(test, "herd"))
+		run_herd(workers, seconds);
+	else if (!strcmp(test, "ready"))
+		run_ready(workers, seconds);
+	else
+		usage(argv[0]);
+
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * fault_storm - page fault scalability against mmap_sem writers
+ *
+ * Runs fault threads, one pinned per cpu, that each touch every page of
+ * their own anonymous area and then drop it with MADV_DONTNEED so that
+ * the next pass faults again, while one more thread keeps mapping,
+ * mprotecting and unmapping a scratch area, which takes mmap_sem for
+ * writing every time.  Reports page faults/sec, the writer's
+ * operations/sec, and how many of the faults were handled without
+ * mmap_sem, from speculative_pgfault in /proc/vmstat.  Run with -w 0
+ * for the fault rate without the writer.
+ *
+ *	fault_storm -n 4 -m 16 -s 5
+ *	fault_storm -n 4 -w 0
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+struct worker {
+	pthread_t thread;
+	int cpu;
+	unsigned long faults;
+};
+
+static int nthreads;
+static size_t area_size = 16 << 20;
+static int writer = 1;
+static volatile int stop;
+static long page_size;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void bind_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* -1 if the kernel does not count speculative faults */
+static long speculative_faults(void)
+{
+	char name[64];
+	long val = -1, v;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return -1;
+	while (fscanf(f, "%63s %ld", name, &v) == 2) {
+		if (!strcmp(name, "speculative_pgfault")) {
+			val = v;
+			break;
+		}
+	}
+	fclose(f);
+	return val;
+}
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	char *area;
+	size_t off;
+
+	bind_cpu(w->cpu);
+	area = mmap(NULL, area_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		die("mmap");
+	/* Huge pages would hide the faults this is about */
+	madvise(area, area_size, MADV_NOHUGEPAGE);
+
+	while (!stop) {
+		for (off = 0; off < area_size && !stop; off += page_size) {
+			area[off] = 1;
+			w->faults++;
+		}
+		if (madvise(area, area_size, MADV_DONTNEED))
+			die("madvise");
+	}
+	munmap(area, area_size);
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	unsigned long *ops = arg;
+	char *p;
+
+	while (!stop) {
+		p = mmap(NULL, 4 * page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			die("mmap");
+		p[0] = 1;
+		if (mprotect(p, page_size, PROT_READ))
+			die("mprotect");
+		munmap(p, 4 * page_size);
+		(*ops)++;
+	}
+	return NULL;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n <fault threads>] [-m <MB per thread>]"
+		" [-w 0|1] [-s <seconds>]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long faults = 0, ops = 0;
+	struct worker *workers;
+	pthread_t wthread;
+	long spf_start, spf_end;
+	double start, end;
+	int seconds = 5;
+	int i, c;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "n:m:w:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			nthreads = atoi(optarg);
+			break;
+		case 'm':
+			area_size = (size_t)atoi(optarg) << 20;
+			break;
+		case 'w':
+			writer = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nthreads < 1 || !area_size || seconds < 1)
+		usage(argv[0]);
+
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!workers)
+		die("calloc");
+
+	spf_start = speculative_faults();
+	start = now();
+	for (i = 0; i < nthreads; i++) {
+		workers[i].cpu = i;
+		if (pthread_create(&workers[i].thread, NULL, fault_thread,
+				   &workers[i]))
+			die("pthread_create");
+	}
+	if (writer && pthread_create(&wthread, NULL, writer_thread, &ops))
+		die("pthread_create");
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		faults += workers[i].faults;
+	}
+	if (writer)
+		pthread_join(wthread, NULL);
+	end = now();
+	spf_end = speculative_faults();
+
+	printf("threads %d%s: %.0f faults/sec", nthreads,
+	       writer ? " + writer" : "", faults / (end - start));
+	if (writer)
+		printf(", %.0f writer ops/sec", ops / (end - start));
+	if (spf_start >= 0 && spf_end >= 0)
+		printf(", %.1f%% speculative",
+		       faults ? 100.0 * (spf_end - spf_start) / faults : 0.0);
+	printf("\n");
+
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * splice_recv - network to disk ingest benchmark
+ *
+ * Receives a TCP stream and writes it to a file, the way a backup target
+ * does, in one of three ways:
+ *
+ * copy:   read() into a user buffer, then write() it out.
+ * splice: splice() the socket into a pipe and the pipe into the file.
+ * move:   as splice, with SPLICE_F_MOVE on the pipe to file step so that
+ *         whole received pages are moved into the page cache.
+ *
+ * Without -l a sender thread streams to the receiver over loopback; with
+ * -l the receiver listens on the given port for a remote sender, e.g.
+ * "nc host 5001 < /dev/zero". Reports throughput, the system time spent,
+ * and for the splice modes how many bytes the pipe to file step moved
+ * rather than copied, from splice_pgmoved in /proc/vmstat.
+ *
+ *	splice_recv -m move -o /mnt/disk/ingest -b 4096 -s 10
+ *	splice_recv -m splice -l 5001 -o /mnt/disk/ingest
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define PIPE_SIZE	(64 * 1024)
+
+enum { MODE_COPY, MODE_SPLICE, MODE_MOVE };
+
+static int mode = MODE_MOVE;
+static size_t chunk = PIPE_SIZE;
+static volatile int stop;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void bind_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double sys_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static unsigned long vmstat(const char *name)
+{
+	unsigned long val = 0, v;
+	FILE *f = fopen("/proc/vmstat", "r");
+	char key[64];
+
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %lu", key, &v) == 2)
+		if (!strcmp(key, name)) {
+			val = v;
+			break;
+		}
+	fclose(f);
+	return val;
+}
+
+static void *sender_run(void *arg)
+{
+	struct sockaddr_in *addr = arg;
+	char *buf;
+	int fd;
+
+	bind_cpu(1);
+	buf = calloc(1, chunk);
+	if (!buf)
+		die("calloc");
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)))
+		die("connect");
+	while (!stop)
+		if (write(fd, buf, chunk) < 0)
+			break;
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+static unsigned long long receive(int sock, int out, double end)
+{
+	unsigned long long total = 0;
+	unsigned int flags = SPLICE_F_MORE;
+	int pfd[2] = { -1, -1 };
+	char *buf = NULL;
+	ssize_t n, w;
+
+	if (mode == MODE_COPY) {
+		buf = malloc(chunk);
+		if (!buf)
+			die("malloc");
+	} else if (pipe(pfd)) {
+		die("pipe");
+	}
+	if (mode == MODE_MOVE)
+		flags |= SPLICE_F_MOVE;
+
+	while (now() < end) {
+		if (mode == MODE_COPY) {
+			n = read(sock, buf, chunk);
+			if (n <= 0)
+				break;
+			if (write(out, buf, n) != n)
+				die("write");
+		} else {
+			n = splice(sock, NULL, pfd[1], NULL, chunk, SPLICE_F_MORE);
+			if (n <= 0)
+				break;
+			for (w = 0; w < n; ) {
+				ssize_t r = splice(pfd[0], NULL, out, NULL,
+						   n - w, flags);
+
+				if (r <= 0)
+					die("splice");
+				w += r;
+			}
+		}
+		total += n;
+	}
+
+	if (buf)
+		free(buf);
+	if (pfd[0] >= 0) {
+		close(pfd[0]);
+		close(pfd[1]);
+	}
+	return total;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -o <file> [-m copy|splice|move] [-l <port>]"
+		" [-b <chunk bytes>] [-s <seconds>]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long moved;
+	struct sockaddr_in addr;
+	unsigned long long total;
+	const char *path = NULL;
+	pthread_t sender;
+	int seconds = 10, port = 0;
+	int lfd, sock, out, c, one = 1;
+	long page = sysconf(_SC_PAGESIZE);
+	double start, elapsed, stime;
+	socklen_t len = sizeof(addr);
+
+	while ((c = getopt(argc, argv, "o:m:l:b:s:")) != -1) {
+		switch (c) {
+		case 'o':
+			path = optarg;
+			break;
+		case 'm':
+			if (!strcmp(optarg, "copy"))
+				mode = MODE_COPY;
+			else if (!strcmp(optarg, "splice"))
+				mode = MODE_SPLICE;
+			else if (!strcmp(optarg, "move"))
+				mode = MODE_MOVE;
+			else
+				usage(argv[0]);
+			break;
+		case 'l':
+			port = atoi(optarg);
+			break;
+		case 'b':
+			chunk = atol(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!path || !chunk || chunk > PIPE_SIZE || seconds < 1)
+		usage(argv[0]);
+
+	out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0)
+		die(path);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		die("socket");
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(port ? INADDR_ANY : INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)))
+		die("bind");
+	if (listen(lfd, 1))
+		die("listen");
+	if (getsockname(lfd, (struct sockaddr *)&addr, &len))
+		die("getsockname");
+
+	if (!port && pthread_create(&sender, NULL, sender_run, &addr))
+		die("pthread_create");
+
+	sock = accept(lfd, NULL, NULL);
+	if (sock < 0)
+		die("accept");
+	bind_cpu(0);
+
+	moved = vmstat("splice_pgmoved");
+	stime = sys_time();
+	start = now();
+	total = receive(sock, out, start + seconds);
+	elapsed = now() - start;
+	stime = sys_time() - stime;
+	moved = vmstat("splice_pgmoved") - moved;
+
+	stop = 1;
+	close(sock);
+	if (!port)
+		pthread_join(sender, NULL);
+	close(lfd);
+	if (fsync(out))
+		perror("fsync");
+	close(out);
+
+	printf("%s: %llu bytes in %.2fs, %.1f MB/s, %.2fs system\n",
+	       mode == MODE_COPY ? "copy" : mode == MODE_SPLICE ? "splice" : "move",
+	       total, elapsed, total / elapsed / 1e6, stime);
+	if (mode != MODE_COPY)
+		printf("pipe to file: %llu bytes moved, %llu bytes copied\n",
+		       (unsigned long long)moved * page,
+		       total - (unsigned long long)moved * page);
+	return 0;
+}
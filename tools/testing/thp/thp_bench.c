@@ -0,0 +1,152 @@
+/*
+ * thp_bench - TLB miss bound access benchmark for transparent hugepages
+ *
+ * Maps a buffer much larger than the TLB reach with small pages, twice,
+ * once madvised MADV_NOHUGEPAGE and once MADV_HUGEPAGE, and times random
+ * 4 byte reads spread over it, so that nearly every access misses the
+ * TLB.  Reports the nanoseconds an access costs on each and how much of
+ * the huge buffer AnonHugePages says was really mapped huge:
+ *
+ *	thp_bench -m 256 -n 50
+ *
+ * The buffer is aligned to a hugepage, and touched once before the
+ * timing so that the faults are not counted.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE	14
+#define MADV_NOHUGEPAGE	15
+#endif
+
+#define HPAGE_SIZE	(2UL << 20)
+
+static size_t size = 256UL << 20;
+static unsigned long accesses = 50UL << 20;
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long anon_huge_kb(void)
+{
+	unsigned long kb, total = 0;
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/self/smaps", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+			total += kb;
+	fclose(f);
+	return total;
+}
+
+static uint32_t *map_buffer(int advice)
+{
+	char *raw, *buf;
+
+	/* over-allocate by a hugepage so the buffer can be aligned */
+	raw = mmap(NULL, size + HPAGE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		die("mmap");
+	buf = (char *)(((uintptr_t)raw + HPAGE_SIZE - 1) & ~(HPAGE_SIZE - 1));
+	if (madvise(buf, size, advice))
+		die("madvise");
+	memset(buf, 1, size);
+	return (uint32_t *)buf;
+}
+
+/*
+ * Random reads, with the next index depending on the value read so that
+ * the loads cannot be overlapped.
+ */
+static double run(uint32_t *buf)
+{
+	unsigned long words = size / sizeof(*buf), i;
+	uint64_t x = 88172645463325252ULL;
+	uint32_t sum = 0;
+	double start;
+
+	start = now();
+	for (i = 0; i < accesses; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		sum += buf[(x + sum) % words];
+	}
+	start = now() - start;
+
+	/* keep the loads */
+	if (sum == 0x12345678)
+		printf("\n");
+	return start * 1e9 / accesses;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-m <MB>] [-n <million accesses>]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	double small_ns, huge_ns;
+	unsigned long before;
+	uint32_t *buf;
+	int c;
+
+	while ((c = getopt(argc, argv, "m:n:")) != -1) {
+		switch (c) {
+		case 'm':
+			size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'n':
+			accesses = strtoul(optarg, NULL, 0) << 20;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (size < HPAGE_SIZE || !accesses)
+		usage(argv[0]);
+
+	buf = map_buffer(MADV_NOHUGEPAGE);
+	small_ns = run(buf);
+	munmap(buf, size);
+
+	before = anon_huge_kb();
+	buf = map_buffer(MADV_HUGEPAGE);
+	huge_ns = run(buf);
+
+	printf("%zu MB, %lu accesses: %.1f ns small pages, %.1f ns hugepages "
+	       "(%lu of %zu MB huge)\n", size >> 20, accesses, small_ns,
+	       huge_ns, (anon_huge_kb() - before) >> 10, size >> 20);
+	return 0;
+}